@@ -0,0 +1,103 @@
+//
+// nvFileView.h - Common support class
+//
+// Access to whole files for the model and image loaders. Files are
+// memory mapped where available, otherwise read in one piece.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef NV_FILE_VIEW_H
+#define NV_FILE_VIEW_H
+
+#include <stdio.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace nv {
+
+//
+// View of a whole file, memory mapped where available. A copy on
+// write view can be modified in memory, the file is never changed
+//
+////////////////////////////////////////////////////////////
+class FileView {
+public:
+    FileView() : _data(0), _size(0), _mapped(false) {}
+    ~FileView() { close(); }
+
+    bool open( const char *file, bool copyOnWrite = false) {
+#ifndef WIN32
+        int fd = ::open( file, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat( fd, &st) == 0 && st.st_size > 0) {
+            int prot = copyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ;
+            void *data = mmap( 0, st.st_size, prot, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                madvise( data, st.st_size, MADV_SEQUENTIAL);
+                _data = (char*)data;
+                _size = st.st_size;
+                _mapped = true;
+                ::close(fd);
+                return true;
+            }
+        }
+        ::close(fd);
+#endif
+        FILE *fp = fopen( file, "rb");
+        if (!fp)
+            return false;
+
+        fseek( fp, 0, SEEK_END);
+        long size = ftell( fp);
+        fseek( fp, 0, SEEK_SET);
+
+        _data = new char[size > 0 ? size : 1];
+        _size = (size > 0) ? fread( _data, 1, size, fp) : 0;
+        fclose(fp);
+        return true;
+    }
+
+    void close() {
+        if (!_data)
+            return;
+#ifndef WIN32
+        if (_mapped)
+            munmap( _data, _size);
+        else
+#endif
+            delete [] _data;
+        _data = 0;
+        _size = 0;
+        _mapped = false;
+    }
+
+    const char* begin() const { return _data; }
+    const char* end() const { return _data + _size; }
+    size_t size() const { return _size; }
+
+    //only writable for views opened copy on write
+    char* data() { return _data; }
+
+private:
+    char *_data;
+    size_t _size;
+    bool _mapped;
+
+    FileView( const FileView&);
+    FileView& operator=( const FileView&);
+};
+
+};
+
+#endif
@@ -0,0 +1,70 @@
+//
+// nvHalf.h - Common support class
+//
+// Float to half float conversion for the model and image libraries,
+// so packed vertices and decoded images round the same way.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef NV_HALF_H
+#define NV_HALF_H
+
+#include <string.h>
+
+namespace nv {
+
+//
+// Round to nearest float to half conversion, denormals are kept.
+// Values too large for a half become infinity, or the largest half
+// when saturating. Nan stays nan
+//
+////////////////////////////////////////////////////////////
+inline unsigned short floatToHalf( float f, bool saturate) {
+    unsigned int x;
+    memcpy( &x, &f, sizeof(x));
+
+    unsigned int sign = (x >> 16) & 0x8000;
+    int exponent = (int)((x >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = x & 0x7fffff;
+    unsigned int overflow = sign | (saturate ? 0x7bff : 0x7c00);
+
+    if (((x >> 23) & 0xff) == 0xff) {
+        if (mantissa)
+            return (unsigned short)(sign | 0x7e00);
+        return (unsigned short)overflow;
+    }
+
+    if (exponent >= 31)
+        return (unsigned short)overflow;
+
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return (unsigned short)sign;
+
+        //denormal, shift in the implicit one and round
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        unsigned int half = mantissa >> shift;
+        unsigned int rest = mantissa & ((1u << shift) - 1);
+        unsigned int mid = 1u << (shift - 1);
+        if (rest > mid || (rest == mid && (half & 1)))
+            half++;
+        return (unsigned short)(sign | half);
+    }
+
+    unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+    unsigned int rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        //may carry into the exponent, which rounds up to the next power of two or infinity
+        half++;
+    if ((half & 0x7fff) >= 0x7c00)
+        return (unsigned short)overflow;
+    return (unsigned short)half;
+}
+
+};
+
+#endif
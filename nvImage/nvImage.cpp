@@ -15,8 +15,23 @@
 
 #include <string.h>
 #include <algorithm>
+#include <thread>
+
+#ifdef WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
 
 #include "nvImage.h"
+#include "nvFileView.h"
+#include "nvImageAllocator.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NV_IMAGE_SSE2
+#include <emmintrin.h>
+#endif
 
 using std::vector;
 using std::max;
@@ -25,20 +40,32 @@ using std::max;
 #define strcasecmp _stricmp
 #endif
 
+//files a worker gets at least when probing a directory
+#define MIN_FILES_PER_THREAD 8
+
 namespace nv {
 
 Image::FormatInfo Image::formatTable[] = {
-    { "png", Image::readPng, Image::writePng},
-    { "dds", Image::readDDS, 0},
-    { "hdr", Image::readHdr, 0}
+    { "png", Image::readPng, Image::writePng, Image::probePng},
+    { "dds", Image::readDDS, Image::writeDDS, Image::probeDDS},
+    { "hdr", Image::readHdr, 0, Image::probeHdr}
 };
 
 
+//
+//
+////////////////////////////////////////////////////////////
+static std::shared_ptr<ImageAllocator>& defaultAllocator() {
+    static std::shared_ptr<ImageAllocator> allocator = ImageAllocator::heap();
+    return allocator;
+}
+
 //
 //
 ////////////////////////////////////////////////////////////
 Image::Image() : _width(0), _height(0), _depth(0), _levelCount(0), _faces(0), _format(GL_RGBA),
-    _internalFormat(GL_RGBA8), _type(GL_UNSIGNED_BYTE), _elementSize(0) {
+    _internalFormat(GL_RGBA8), _type(GL_UNSIGNED_BYTE), _elementSize(0), _allocator(defaultAllocator()),
+    _flipOnLoad(true), _halfFloatOnLoad(false) {
 }
 
 //
@@ -52,10 +79,57 @@ Image::~Image() {
 //
 ////////////////////////////////////////////////////////////
 void Image::freeData() {
-    for (vector<GLubyte*>::iterator it = _data.begin(); it != _data.end(); it++) {
-        delete []*it;
-    }
+    for (vector<GLubyte*>::iterator it = _data.begin(); it != _data.end(); it++)
+        releaseData( *it);
     _data.clear();
+    _file.reset();
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+GLubyte* Image::allocData( size_t size) {
+    return (GLubyte*)_allocator->allocate( size);
+}
+
+//
+//  releaseData
+//
+//    Gives a level back to the allocator, unless it points into
+//  the mapped file
+////////////////////////////////////////////////////////////
+void Image::releaseData( GLubyte *data) {
+    if (!isMappedData( data))
+        _allocator->release( data);
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+void Image::setAllocator( const std::shared_ptr<ImageAllocator> &allocator) {
+    freeData();
+    _allocator = (allocator) ? allocator : ImageAllocator::heap();
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+void Image::setDefaultAllocator( const std::shared_ptr<ImageAllocator> &allocator) {
+    defaultAllocator() = (allocator) ? allocator : ImageAllocator::heap();
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+const std::shared_ptr<ImageAllocator>& Image::getDefaultAllocator() {
+    return defaultAllocator();
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+bool Image::isMappedData( const GLubyte *data) const {
+    return _file && (const char*)data >= _file->begin() && (const char*)data < _file->end();
 }
 
 //
@@ -104,33 +178,207 @@ void* Image::getLevel( int level, GLenum face) {
 }
 
 //
+//  findFormat
 //
+//    Matches the extension of a file against the format table
 ////////////////////////////////////////////////////////////
-bool Image::loadImageFromFile( const char* file) {
+const Image::FormatInfo* Image::findFormat( const char* file) {
     const char* extension;
     extension = strrchr( file, '.');
 
     if (extension)
         extension++; //start looking after the .
     else
-        return false;
+        return 0;
 
     int formatCount = sizeof(Image::formatTable) / sizeof(Image::FormatInfo);
 
-    //try to match by format first
     for ( int ii = 0; ii < formatCount; ii++) {
-        if ( ! strcasecmp( formatTable[ii].extension, extension)) {
-            //extension matches, load it
-            return formatTable[ii].reader( file, *this);
-        }
+        if ( ! strcasecmp( formatTable[ii].extension, extension))
+            return &formatTable[ii];
     }
 
+    return 0;
+}
 
-    return false;
+//
+//
+////////////////////////////////////////////////////////////
+bool Image::loadImageFromFile( const char* file) {
+    const FormatInfo *format = findFormat( file);
+    if (!format)
+        return false;
+
+    //extension matches, load it
+    freeData();
+    return format->reader( file, *this);
 }
 
 //
+//  probe
 //
+//    The prober of the format fills the layout of an image
+//  that never gets levels
+////////////////////////////////////////////////////////////
+bool Image::probe( const char* file, Info &info) const {
+    const FormatInfo *format = findFormat( file);
+    if (!format || !format->prober)
+        return false;
+
+    Image layout;
+    layout._flipOnLoad = _flipOnLoad;
+    layout._halfFloatOnLoad = _halfFloatOnLoad;
+    if (!format->prober( file, layout))
+        return false;
+
+    info.file = file;
+    info.width = layout._width;
+    info.height = layout._height;
+    info.depth = layout._depth;
+    info.levels = layout._levelCount;
+    info.faces = layout._faces;
+    info.format = layout._format;
+    info.internalFormat = layout._internalFormat;
+    info.type = layout._type;
+
+    info.size = 0;
+    for (int level = 0; level < layout._levelCount; level++)
+        info.size += layout.getImageSize( level);
+    info.size *= (layout._faces) ? layout._faces : 1;
+
+    return true;
+}
+
+//
+//  listDirectory
+//
+//    Returns the names of the entries of a directory
+////////////////////////////////////////////////////////////
+static bool listDirectory( const char *directory, vector<std::string> &names) {
+#ifdef WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA( (std::string( directory) + "\\*").c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE)
+        return false;
+    do {
+        if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            names.push_back( entry.cFileName);
+    } while (FindNextFileA( find, &entry));
+    FindClose( find);
+#else
+    DIR *dir = opendir( directory);
+    if (!dir)
+        return false;
+    while (struct dirent *entry = readdir( dir))
+        names.push_back( entry->d_name);
+    closedir( dir);
+#endif
+    return true;
+}
+
+//
+//  probeDirectory
+//
+//    Only the headers are read, so the files are probed in
+//  parallel ranges with the calling thread taking the first
+////////////////////////////////////////////////////////////
+bool Image::probeDirectory( const char* directory, vector<Info> &infos) const {
+    vector<std::string> names;
+    if (!listDirectory( directory, names))
+        return false;
+    std::sort( names.begin(), names.end());
+
+    std::string path = directory;
+    if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+        path += '/';
+
+    vector<std::string> files;
+    for (size_t ii = 0; ii < names.size(); ii++) {
+        const FormatInfo *format = findFormat( names[ii].c_str());
+        if (format && format->prober)
+            files.push_back( path + names[ii]);
+    }
+
+    vector<Info> probed( files.size());
+    vector<char> valid( files.size(), 0);
+
+    auto probeFiles = [&]( size_t begin, size_t end) {
+        for (size_t ii = begin; ii < end; ii++)
+            valid[ii] = probe( files[ii].c_str(), probed[ii]);
+    };
+
+    size_t count = files.size();
+    size_t workers = count / MIN_FILES_PER_THREAD;
+    size_t cores = std::thread::hardware_concurrency();
+    workers = std::max( std::min( workers, cores), (size_t)1);
+
+    vector<std::thread> threads;
+    for (size_t ii = 1; ii < workers; ii++)
+        threads.push_back( std::thread( probeFiles, count * ii / workers, count * (ii + 1) / workers));
+    probeFiles( 0, count / workers);
+    for (size_t ii = 0; ii < threads.size(); ii++)
+        threads[ii].join();
+
+    infos.clear();
+    for (size_t ii = 0; ii < count; ii++) {
+        if (valid[ii])
+            infos.push_back( probed[ii]);
+    }
+
+    return true;
+}
+
+//
+//  swapRows
+//
+//    Exchanges two rows in place, 64 bytes at a time with SSE2
+////////////////////////////////////////////////////////////
+static void swapRows( GLubyte *a, GLubyte *b, unsigned int size) {
+    unsigned int ii = 0;
+
+#ifdef NV_IMAGE_SSE2
+    for (; ii + 64 <= size; ii += 64) {
+        __m128i a0 = _mm_loadu_si128( (const __m128i*)(a + ii));
+        __m128i a1 = _mm_loadu_si128( (const __m128i*)(a + ii + 16));
+        __m128i a2 = _mm_loadu_si128( (const __m128i*)(a + ii + 32));
+        __m128i a3 = _mm_loadu_si128( (const __m128i*)(a + ii + 48));
+        __m128i b0 = _mm_loadu_si128( (const __m128i*)(b + ii));
+        __m128i b1 = _mm_loadu_si128( (const __m128i*)(b + ii + 16));
+        __m128i b2 = _mm_loadu_si128( (const __m128i*)(b + ii + 32));
+        __m128i b3 = _mm_loadu_si128( (const __m128i*)(b + ii + 48));
+        _mm_storeu_si128( (__m128i*)(a + ii), b0);
+        _mm_storeu_si128( (__m128i*)(a + ii + 16), b1);
+        _mm_storeu_si128( (__m128i*)(a + ii + 32), b2);
+        _mm_storeu_si128( (__m128i*)(a + ii + 48), b3);
+        _mm_storeu_si128( (__m128i*)(b + ii), a0);
+        _mm_storeu_si128( (__m128i*)(b + ii + 16), a1);
+        _mm_storeu_si128( (__m128i*)(b + ii + 32), a2);
+        _mm_storeu_si128( (__m128i*)(b + ii + 48), a3);
+    }
+    for (; ii + 16 <= size; ii += 16) {
+        __m128i a0 = _mm_loadu_si128( (const __m128i*)(a + ii));
+        __m128i b0 = _mm_loadu_si128( (const __m128i*)(b + ii));
+        _mm_storeu_si128( (__m128i*)(a + ii), b0);
+        _mm_storeu_si128( (__m128i*)(b + ii), a0);
+    }
+#endif
+
+    for (; ii + 8 <= size; ii += 8) {
+        unsigned long long a0, b0;
+        memcpy( &a0, a + ii, 8);
+        memcpy( &b0, b + ii, 8);
+        memcpy( a + ii, &b0, 8);
+        memcpy( b + ii, &a0, 8);
+    }
+    for (; ii < size; ii++)
+        std::swap( a[ii], b[ii]);
+}
+
+//
+//  flipSurface
+//
+//    Rows are swapped in place, compressed rows of blocks are
+//  flipped and swapped in a single pass
 ////////////////////////////////////////////////////////////
 void Image::flipSurface(GLubyte *surf, int width, int height, int depth)
 {
@@ -142,33 +390,28 @@ void Image::flipSurface(GLubyte *surf, int width, int height, int depth)
         lineSize = _elementSize * width;
         unsigned int sliceSize = lineSize * height;
 
-        GLubyte *tempBuf = new GLubyte[lineSize];
-
         for ( int ii = 0; ii < depth; ii++) {
             GLubyte *top = surf + ii*sliceSize;
             GLubyte *bottom = top + (sliceSize - lineSize);
     
             for ( int jj = 0; jj < (height >> 1); jj++) {
-                memcpy( tempBuf, top, lineSize);
-                memcpy( top, bottom, lineSize);
-                memcpy( bottom, tempBuf, lineSize);
+                swapRows( top, bottom, lineSize);
 
                 top += lineSize;
                 bottom -= lineSize;
             }
         }
-
-        delete []tempBuf;
     }
     else
     {
-        void (*flipblocks)(GLubyte*, unsigned int);
+        void (*flipblocks)(GLubyte*, GLubyte*, unsigned int);
         width = (width + 3) / 4;
         height = (height + 3) / 4;
         unsigned int blockSize = 0;
 
         switch (_format)
         {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: 
             case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: 
                 blockSize = 8;
                 flipblocks = &Image::flip_blocks_dxtc1; 
@@ -181,35 +424,33 @@ void Image::flipSurface(GLubyte *surf, int width, int height, int depth)
                 blockSize = 16;
                 flipblocks = &Image::flip_blocks_dxtc5; 
                 break;
+            case GL_COMPRESSED_LUMINANCE_LATC1_EXT: 
+            case GL_COMPRESSED_SIGNED_LUMINANCE_LATC1_EXT: 
+                blockSize = 8;
+                flipblocks = &Image::flip_blocks_latc1; 
+                break;
+            case GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT: 
+            case GL_COMPRESSED_SIGNED_LUMINANCE_ALPHA_LATC2_EXT: 
+                blockSize = 16;
+                flipblocks = &Image::flip_blocks_latc2; 
+                break;
             default:
                 return;
         }
 
         lineSize = width * blockSize;
-        GLubyte *tempBuf = new GLubyte[lineSize];
 
         GLubyte *top = surf;
         GLubyte *bottom = surf + (height-1) * lineSize;
 
-        for (unsigned int j = 0; j < max( (unsigned int)height >> 1, (unsigned int)1); j++)
+        //an odd middle row is flipped in place
+        for (int j = 0; j < (height + 1) / 2; j++)
         {
-            if (top == bottom)
-            {
-                flipblocks(top, width);
-                break;
-            }
-
-            flipblocks(top, width);
-            flipblocks(bottom, width);
-
-            memcpy( tempBuf, top, lineSize);
-            memcpy( top, bottom, lineSize);
-            memcpy( bottom, tempBuf, lineSize);
+            flipblocks(top, bottom, width);
 
             top += lineSize;
             bottom -= lineSize;
         }
-        delete []tempBuf;
     }
 }    
 
@@ -242,7 +483,7 @@ bool Image::convertCrossToCubemap() {
     //remove the old pointer from the vector
     _data.pop_back();
     
-    GLubyte *face = new GLubyte[ fWidth * fHeight * _elementSize];
+    GLubyte *face = allocData( fWidth * fHeight * _elementSize);
     GLubyte *ptr;
 
     //extract the faces
@@ -256,7 +497,7 @@ bool Image::convertCrossToCubemap() {
     _data.push_back(face);
 
     // negative X
-    face = new GLubyte[ fWidth * fHeight * _elementSize];
+    face = allocData( fWidth * fHeight * _elementSize);
     ptr = face;
     for (int j=0; j<fHeight; j++) {
         memcpy( ptr, &data[(_height - (fHeight + j + 1))*_width*_elementSize], fWidth*_elementSize);
@@ -265,7 +506,7 @@ bool Image::convertCrossToCubemap() {
     _data.push_back(face);
 
     // positive Y
-    face = new GLubyte[ fWidth * fHeight * _elementSize];
+    face = allocData( fWidth * fHeight * _elementSize);
     ptr = face;
     for (int j=0; j<fHeight; j++) {
         memcpy( ptr, &data[((4 * fHeight - j - 1)*_width + fWidth)*_elementSize], fWidth*_elementSize);
@@ -274,7 +515,7 @@ bool Image::convertCrossToCubemap() {
     _data.push_back(face);
 
     // negative Y
-    face = new GLubyte[ fWidth * fHeight * _elementSize];
+    face = allocData( fWidth * fHeight * _elementSize);
     ptr = face;
     for (int j=0; j<fHeight; j++) {
         memcpy( ptr, &data[((2*fHeight - j - 1)*_width + fWidth)*_elementSize], fWidth*_elementSize);
@@ -283,7 +524,7 @@ bool Image::convertCrossToCubemap() {
     _data.push_back(face);
 
     // positive Z
-    face = new GLubyte[ fWidth * fHeight * _elementSize];
+    face = allocData( fWidth * fHeight * _elementSize);
     ptr = face;
     for (int j=0; j<fHeight; j++) {
         memcpy( ptr, &data[((_height - (fHeight + j + 1))*_width + fWidth) * _elementSize], fWidth*_elementSize);
@@ -292,7 +533,7 @@ bool Image::convertCrossToCubemap() {
     _data.push_back(face);
 
     // negative Z
-    face = new GLubyte[ fWidth * fHeight * _elementSize];
+    face = allocData( fWidth * fHeight * _elementSize);
     ptr = face;
     for (int j=0; j<fHeight; j++) {
         for (int i=0; i<fWidth; i++) {
@@ -307,8 +548,8 @@ bool Image::convertCrossToCubemap() {
     _width = fWidth;
     _height = fHeight;
 
-    //delete the old pointer
-    delete []data;
+    //release the old pointer, unless it points into the mapped file
+    releaseData( data);
 
     return true;
 }
@@ -442,7 +683,7 @@ bool Image::setImage( int width, int height, GLenum format, GLenum type, const v
     //clear old data
     freeData();
 
-    GLubyte *newImage = new GLubyte[width*height*elementSize];
+    GLubyte *newImage = allocData( width*height*elementSize);
     memcpy( newImage, data, width*height*elementSize);
 
     _data.push_back(newImage);
@@ -464,28 +705,13 @@ bool Image::setImage( int width, int height, GLenum format, GLenum type, const v
 //
 ////////////////////////////////////////////////////////////
 bool Image::saveImageToFile( const char* file) {
-    const char* extension;
-    extension = strrchr( file, '.');
-
-    if (extension)
-        extension++; //start looking after the .
-    else
-        return false;
-
-    int formatCount = sizeof(Image::formatTable) / sizeof(Image::FormatInfo);
-
-    //try to match by format first
-    for ( int ii = 0; ii < formatCount; ii++) {
-        if ( ! strcasecmp( formatTable[ii].extension, extension)) {
-            //extension matches, load it
-            if (formatTable[ii].writer) {
-                return formatTable[ii].writer( file, *this);
-            }
-        }
-    }
+    const FormatInfo *format = findFormat( file);
 
+    //extension matches, save it
+    if (format && format->writer)
+        return format->writer( file, *this);
 
     return false;
 }
 
-};
\ No newline at end of file
+};
\ No newline at end of file
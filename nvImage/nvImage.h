@@ -16,6 +16,8 @@
 
 
 #include <vector>
+#include <memory>
+#include <string>
 #include <assert.h>
 
 #define GLEW_STATIC
@@ -23,6 +25,9 @@
 
 namespace nv {
 
+    class FileView;
+    class ImageAllocator;
+
     class Image {
     public:
 
@@ -78,6 +83,30 @@ namespace nv {
         //return whether the image represents a volume
         bool isVolume() const { return _depth > 0; }
 
+        //return whether the levels are views into the mapped file rather than copies
+        bool isMapped() const { return _file.get() != 0; }
+
+        //set whether loaded images are flipped to the OpenGL convention of the first row at the bottom (the default)
+        //  unflipped images keep the file order with the first row at the top, so t has to be flipped when sampling,
+        //  dds levels are then used straight from the mapped file without touching the data,
+        //  the writers keep the row order the image was loaded with
+        void setFlipOnLoad( bool flip) { _flipOnLoad = flip; }
+        bool getFlipOnLoad() const { return _flipOnLoad; }
+
+        //set whether hdr images are loaded as half floats (GL_HALF_FLOAT_ARB) rather than floats, at half the size
+        void setHalfFloatOnLoad( bool half) { _halfFloatOnLoad = half; }
+        bool getHalfFloatOnLoad() const { return _halfFloatOnLoad; }
+
+        //set the allocator of the level data, the current data is freed first
+        //  mapped dds levels are not allocated and stay with the file
+        void setAllocator( const std::shared_ptr<ImageAllocator> &allocator);
+        const std::shared_ptr<ImageAllocator>& getAllocator() const { return _allocator; }
+
+        //set the allocator images get on construction, the heap unless set
+        //  set it before images are created on other threads
+        static void setDefaultAllocator( const std::shared_ptr<ImageAllocator> &allocator);
+        static const std::shared_ptr<ImageAllocator>& getDefaultAllocator();
+
         //get a pointer to level data
         const void* getLevel( int level, GLenum face = GL_TEXTURE_CUBE_MAP_POSITIVE_X) const;
         void* getLevel( int level, GLenum face = GL_TEXTURE_CUBE_MAP_POSITIVE_X);
@@ -85,15 +114,83 @@ namespace nv {
         //initialize an image from a file
         bool loadImageFromFile( const char* file);
 
+        //
+        // Size and format of an image file, as it would be loaded
+        //
+        //////////////////////////////////////////////////////////////
+        struct Info {
+            std::string file;
+            int width;
+            int height;
+            int depth;
+            int levels;
+            int faces;
+            GLenum format;
+            GLenum internalFormat;
+            GLenum type;
+            size_t size;    // bytes of all levels and faces
+        };
+
+        //read the layout of an image file from its header without decoding it (returns false for unsupported or broken files)
+        //  the load settings of this image apply, hdr files probe as half floats when they would load as them
+        bool probe( const char* file, Info &info) const;
+
+        //probe the png, dds and hdr files of a directory in parallel, sorted by name (returns false for unreadable directories)
+        //  files that fail to probe are left out, subdirectories are not searched
+        bool probeDirectory( const char* directory, std::vector<Info> &infos) const;
+
         //convert a suitable image from a cubemap cross to a cubemap (returns false for unsuitable images)
         bool convertCrossToCubemap();
 
+        //compress all levels and faces of an 8 bit image (returns false for unsupported formats)
+        //  GL_COMPRESSED_RGB(A)_S3TC_DXT1_EXT (BC1) and GL_COMPRESSED_RGBA_S3TC_DXT5_EXT (BC3) for colour,
+        //  GL_COMPRESSED_LUMINANCE_LATC1_EXT (BC4) for the first channel of heightmaps and masks,
+        //  GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT (BC5) for luminance alpha or the red and green of normal maps
+        bool compress( GLenum format);
+
+        //decode all levels and faces of a compressed image to 8 bit (returns false for unsupported formats)
+        //  DXT1 becomes GL_RGB or GL_RGBA, DXT3 and DXT5 GL_RGBA, LATC1 GL_LUMINANCE and LATC2 GL_LUMINANCE_ALPHA
+        bool decompress();
+
+        //filters for generateMipmaps
+        enum MipmapFilter {
+            emfBox,     // average of the covered pixels, the fastest
+            emfKaiser   // Kaiser windowed sinc, sharper levels with less aliasing
+        };
+
+        //replace the levels below the base level with a full chain down to 1x1 (returns false for volumes and unsupported formats)
+        //  8 bit and float images are filtered directly, compressed images are decoded and the new levels encoded in the same format,
+        //  srgb filters the colour channels in linear space, alpha always is
+        bool generateMipmaps( MipmapFilter filter = emfKaiser, bool srgb = false);
+
         //load an image from memory, for the purposes of saving
         bool setImage( int width, int height, GLenum format, GLenum type, const void* data);
 
         //save an image to a file
         bool saveImageToFile( const char* file);
 
+        //
+        // Receives the rows of a streamed image
+        //
+        //////////////////////////////////////////////////////////////
+        class RowReader {
+        public:
+            virtual ~RowReader() {}
+
+            //called with the layout of the image before the first row, returning false cancels the read
+            virtual bool begin( const Image &layout) = 0;
+
+            //return where to decode a row, or 0 to use a temporary row
+            virtual void* rowBuffer( int /*row*/) { return 0; }
+
+            //called for every decoded row in file order, the first row at the top
+            virtual void row( int row, const void *data) = 0;
+        };
+
+        //decode a png file a row at a time without holding the whole image, interlaced files excepted
+        //  16 bit samples are delivered in native byte order
+        static bool readPngRows( const char *file, RowReader &reader);
+
     protected:
         int _width;
         int _height;
@@ -105,10 +202,22 @@ namespace nv {
         GLenum _type;
         int _elementSize;
 
-        //pointers to the levels
+        //pointers to the levels, either allocated or into the mapped file
         std::vector<GLubyte*> _data;
 
+        //mapping of files whose levels are used in place, copy on write
+        std::shared_ptr<FileView> _file;
+
+        //memory of the allocated levels
+        std::shared_ptr<ImageAllocator> _allocator;
+
+        bool _flipOnLoad;
+        bool _halfFloatOnLoad;
+
         void freeData();
+        bool isMappedData( const GLubyte *data) const;
+        GLubyte* allocData( size_t size);
+        void releaseData( GLubyte *data);
         void flipSurface(GLubyte *surf, int width, int height, int depth);
 
 
@@ -120,22 +229,34 @@ namespace nv {
             const char* extension;
             bool (*reader)( const char* file, Image& i);
             bool (*writer)( const char* file, Image& i);
+            bool (*prober)( const char* file, Image& i);
         };
 
         static FormatInfo formatTable[]; 
 
+        static const FormatInfo* findFormat( const char* file);
+
         static bool readPng( const char *file, Image& i);
         static bool readDDS( const char *file, Image& i);
         static bool readHdr( const char *file, Image& i);
 
+        //set the layout only, the image is left without levels
+        static bool probePng( const char *file, Image& i);
+        static bool probeDDS( const char *file, Image& i);
+        static bool probeHdr( const char *file, Image& i);
+        static bool readDDSHeader( const void *header, Image& i);
+
         static bool writePng( const char *file, Image& i);
-        //static bool writeDDS( const char *file, Image& i);
+        static bool writeDDS( const char *file, Image& i);
         //static bool writeHdr( const char *file, Image& i);
 
-        static void flip_blocks_dxtc1(GLubyte *ptr, unsigned int numBlocks);
-        static void flip_blocks_dxtc3(GLubyte *ptr, unsigned int numBlocks);
-        static void flip_blocks_dxtc5(GLubyte *ptr, unsigned int numBlocks);
+        //flip the blocks of two block rows and swap the rows, top and bottom may be the same row
+        static void flip_blocks_dxtc1(GLubyte *top, GLubyte *bottom, unsigned int numBlocks);
+        static void flip_blocks_dxtc3(GLubyte *top, GLubyte *bottom, unsigned int numBlocks);
+        static void flip_blocks_dxtc5(GLubyte *top, GLubyte *bottom, unsigned int numBlocks);
+        static void flip_blocks_latc1(GLubyte *top, GLubyte *bottom, unsigned int numBlocks);
+        static void flip_blocks_latc2(GLubyte *top, GLubyte *bottom, unsigned int numBlocks);
     };
 };
 
-#endif //NV_IMAGE_H
\ No newline at end of file
+#endif //NV_IMAGE_H
\ No newline at end of file
@@ -0,0 +1,146 @@
+//
+// nvImageAllocator.cpp - Image support class
+//
+// The nvImage class implements an interface for a multipurpose image
+// object. This class is useful for loading and formating images
+// for use as textures. The class supports dds, png, and hdr formats.
+//
+// This file implements the allocators for the level data. Every
+// pool block starts with a header holding its size class, so
+// blocks are released without their size.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <new>
+
+#include "nvImageAllocator.h"
+
+//bytes in front of a pool block, keeps the block aligned like malloc
+#define POOL_HEADER_SIZE 16
+
+//size class of blocks too large for the pool
+#define POOL_NO_CLASS SIZE_MAX
+
+using std::vector;
+
+namespace nv {
+
+//
+//  HeapAllocator
+//
+//    The allocator images had before there were allocators
+////////////////////////////////////////////////////////////
+class HeapAllocator : public ImageAllocator {
+public:
+    void* allocate( size_t size) { return new char[size]; }
+    void release( void *data) { delete [](char*)data; }
+};
+
+//
+//
+////////////////////////////////////////////////////////////
+const std::shared_ptr<ImageAllocator>& ImageAllocator::heap() {
+    static const std::shared_ptr<ImageAllocator> allocator( new HeapAllocator);
+    return allocator;
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+PoolAllocator::PoolAllocator( size_t maxCached, size_t maxBlock) : _maxCached(maxCached), _cached(0) {
+    //a quarter step between classes wastes at most a fifth of a block
+    for (size_t base = 64; base <= maxBlock; base *= 2) {
+        for (size_t quarter = 4; quarter < 8 && base * quarter / 4 <= maxBlock; quarter++)
+            _classSizes.push_back( base * quarter / 4);
+    }
+    _free.resize( _classSizes.size());
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+PoolAllocator::~PoolAllocator() {
+    trim();
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+void* PoolAllocator::allocate( size_t size) {
+    size_t sizeClass = std::lower_bound( _classSizes.begin(), _classSizes.end(), size) - _classSizes.begin();
+    char *block = 0;
+
+    if (sizeClass < _classSizes.size()) {
+        std::lock_guard<std::mutex> lock( _lock);
+        vector<void*> &blocks = _free[sizeClass];
+        if (!blocks.empty()) {
+            block = (char*)blocks.back();
+            blocks.pop_back();
+            _cached -= _classSizes[sizeClass];
+        }
+        size = _classSizes[sizeClass];
+    }
+    else {
+        sizeClass = POOL_NO_CLASS;
+    }
+
+    if (!block) {
+        block = (char*)malloc( size + POOL_HEADER_SIZE);
+        if (!block)
+            throw std::bad_alloc();
+    }
+
+    *(size_t*)block = sizeClass;
+    return block + POOL_HEADER_SIZE;
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+void PoolAllocator::release( void *data) {
+    if (!data)
+        return;
+
+    char *block = (char*)data - POOL_HEADER_SIZE;
+    size_t sizeClass = *(size_t*)block;
+
+    if (sizeClass != POOL_NO_CLASS) {
+        std::lock_guard<std::mutex> lock( _lock);
+        if (_cached + _classSizes[sizeClass] <= _maxCached) {
+            _free[sizeClass].push_back( block);
+            _cached += _classSizes[sizeClass];
+            return;
+        }
+    }
+
+    free( block);
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+void PoolAllocator::trim() {
+    std::lock_guard<std::mutex> lock( _lock);
+    for (size_t ii = 0; ii < _free.size(); ii++) {
+        for (size_t jj = 0; jj < _free[ii].size(); jj++)
+            free( _free[ii][jj]);
+        _free[ii].clear();
+    }
+    _cached = 0;
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+size_t PoolAllocator::getCachedSize() const {
+    std::lock_guard<std::mutex> lock( _lock);
+    return _cached;
+}
+
+};
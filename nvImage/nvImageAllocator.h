@@ -0,0 +1,75 @@
+//
+// nvImageAllocator.h - Image support class
+//
+// Allocators for the level data of images. Images use plain new and
+// delete unless they are given an allocator, the pool keeps released
+// blocks in size classes for the next image of a similar size.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef NV_IMAGE_ALLOCATOR_H
+#define NV_IMAGE_ALLOCATOR_H
+
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nv {
+
+//
+// Interface for the memory of image levels, allocate and release
+// are called from the loading threads and have to be thread safe
+//
+////////////////////////////////////////////////////////////
+class ImageAllocator {
+public:
+    virtual ~ImageAllocator() {}
+
+    //return a block of at least size bytes, aligned for any type
+    virtual void* allocate( size_t size) = 0;
+
+    //give back a block returned by allocate
+    virtual void release( void *data) = 0;
+
+    //the allocator of images that were not given one, plain new and delete
+    static const std::shared_ptr<ImageAllocator>& heap();
+};
+
+//
+// Pool of blocks in size classes, four per power of two from 64
+// bytes up. Released blocks are kept for reuse up to a limit, blocks
+// larger than the largest class go straight to the heap
+//
+////////////////////////////////////////////////////////////
+class PoolAllocator : public ImageAllocator {
+public:
+    explicit PoolAllocator( size_t maxCached = 256 << 20, size_t maxBlock = 64 << 20);
+    ~PoolAllocator();
+
+    void* allocate( size_t size);
+    void release( void *data);
+
+    //free all kept blocks
+    void trim();
+
+    //return the bytes of the kept blocks
+    size_t getCachedSize() const;
+
+private:
+    std::vector<size_t> _classSizes;
+    std::vector< std::vector<void*> > _free;
+    size_t _maxCached;
+    size_t _cached;
+    mutable std::mutex _lock;
+
+    PoolAllocator( const PoolAllocator&);
+    PoolAllocator& operator=( const PoolAllocator&);
+};
+
+};
+
+#endif
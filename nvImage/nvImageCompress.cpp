@@ -0,0 +1,709 @@
+//
+// nvImageCompress.cpp - Image support class
+//
+// The nvImage class implements an interface for a multipurpose image
+// object. This class is useful for loading and formating images
+// for use as textures. The class supports dds, png, and hdr formats.
+//
+// This file implements the block compression encoder. Colour blocks
+// are fit along the principal axis of their pixels and refined by a
+// least squares pass, the palette search runs on four pixels at a
+// time with SSE2 where available. The block rows of all levels are
+// encoded on all cores. The decoder expands the blocks back to 8 bit
+// pixels for filtering.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "nvImage.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NV_IMAGE_SSE2
+#include <emmintrin.h>
+#endif
+
+//block rows a worker gets at least, small images are encoded on one thread
+#define MIN_BLOCK_ROWS_PER_THREAD 16
+
+using std::vector;
+
+namespace nv {
+
+//
+//  Source of one block row, levels are split into rows of blocks
+//  that are encoded independently
+////////////////////////////////////////////////////////////
+struct BlockRow {
+    const GLubyte *src;     // first pixel row of the block row
+    GLubyte *dst;           // first block of the row
+    int width;              // pixels per row
+    int rows;               // pixel rows left in the surface, at most 4 are used
+};
+
+//
+//  Layout of an uncompressed source, the element offset of
+//  every rgba channel or -1 for channels the format lacks
+////////////////////////////////////////////////////////////
+struct SourceLayout {
+    int channel[4];
+    int elementSize;
+};
+
+//
+//
+////////////////////////////////////////////////////////////
+static bool getSourceLayout( GLenum format, GLenum type, SourceLayout &layout) {
+    if (type != GL_UNSIGNED_BYTE)
+        return false;
+
+    static const struct { GLenum format; int channel[4]; int elementSize; } layouts[] = {
+        { GL_RGB,             { 0, 1, 2, -1}, 3},
+        { GL_RGBA,            { 0, 1, 2, 3}, 4},
+        { GL_BGR,             { 2, 1, 0, -1}, 3},
+        { GL_BGRA,            { 2, 1, 0, 3}, 4},
+        { GL_LUMINANCE,       { 0, 0, 0, -1}, 1},
+        { GL_LUMINANCE_ALPHA, { 0, 0, 0, 1}, 2},
+        { GL_ALPHA,           { 0, 0, 0, 0}, 1},
+    };
+
+    for (unsigned int ii = 0; ii < sizeof(layouts) / sizeof(layouts[0]); ii++) {
+        if (layouts[ii].format == format) {
+            memcpy( layout.channel, layouts[ii].channel, sizeof(layout.channel));
+            layout.elementSize = layouts[ii].elementSize;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+//  fetchBlock
+//
+//    Gathers the 4x4 pixels of a block as rgba, blocks over the
+//  edge of the image repeat its last row and column
+////////////////////////////////////////////////////////////
+static void fetchBlock( const BlockRow &row, int bx, const SourceLayout &layout, GLubyte block[16][4]) {
+    int pitch = row.width * layout.elementSize;
+
+    for (int yy = 0; yy < 4; yy++) {
+        const GLubyte *line = row.src + std::min( yy, row.rows - 1) * pitch;
+        for (int xx = 0; xx < 4; xx++) {
+            const GLubyte *pixel = line + std::min( bx * 4 + xx, row.width - 1) * layout.elementSize;
+            for (int cc = 0; cc < 4; cc++)
+                block[yy*4 + xx][cc] = (layout.channel[cc] < 0) ? ((cc == 3) ? 255 : 0) : pixel[layout.channel[cc]];
+        }
+    }
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+static GLushort packColor( const float color[3]) {
+    int r = (int)(std::min( std::max( color[0], 0.0f), 255.0f) * (31.0f / 255.0f) + 0.5f);
+    int g = (int)(std::min( std::max( color[1], 0.0f), 255.0f) * (63.0f / 255.0f) + 0.5f);
+    int b = (int)(std::min( std::max( color[2], 0.0f), 255.0f) * (31.0f / 255.0f) + 0.5f);
+    return (GLushort)((r << 11) | (g << 5) | b);
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+static void unpackColor( GLushort packed, float color[3]) {
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = (float)((r << 3) | (r >> 2));
+    color[1] = (float)((g << 2) | (g >> 4));
+    color[2] = (float)((b << 3) | (b >> 2));
+}
+
+//
+//  findIndices
+//
+//    Picks the nearest palette entry for every pixel, returns
+//  the squared error of the block. Pixels with used[ii] == 0 get
+//  index 3 (transparent in the three colour mode) and no error.
+////////////////////////////////////////////////////////////
+static float findIndices( const float pixels[3][16], const float palette[4][3], int paletteSize, const bool used[16], int indices[16]) {
+    float error = 0.0f;
+
+#ifdef NV_IMAGE_SSE2
+    for (int ii = 0; ii < 16; ii += 4) {
+        __m128 r = _mm_loadu_ps( &pixels[0][ii]);
+        __m128 g = _mm_loadu_ps( &pixels[1][ii]);
+        __m128 b = _mm_loadu_ps( &pixels[2][ii]);
+
+        __m128 best = _mm_set1_ps( 1e30f);
+        __m128i bestIndex = _mm_setzero_si128();
+
+        for (int pp = 0; pp < paletteSize; pp++) {
+            __m128 dr = _mm_sub_ps( r, _mm_set1_ps( palette[pp][0]));
+            __m128 dg = _mm_sub_ps( g, _mm_set1_ps( palette[pp][1]));
+            __m128 db = _mm_sub_ps( b, _mm_set1_ps( palette[pp][2]));
+            __m128 dist = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dr, dr), _mm_mul_ps( dg, dg)), _mm_mul_ps( db, db));
+
+            __m128 closer = _mm_cmplt_ps( dist, best);
+            best = _mm_min_ps( dist, best);
+            bestIndex = _mm_or_si128( _mm_andnot_si128( _mm_castps_si128( closer), bestIndex),
+                _mm_and_si128( _mm_castps_si128( closer), _mm_set1_epi32( pp)));
+        }
+
+        float dist[4];
+        int index[4];
+        _mm_storeu_ps( dist, best);
+        _mm_storeu_si128( (__m128i*)index, bestIndex);
+
+        for (int jj = 0; jj < 4; jj++) {
+            indices[ii + jj] = used[ii + jj] ? index[jj] : 3;
+            error += used[ii + jj] ? dist[jj] : 0.0f;
+        }
+    }
+#else
+    for (int ii = 0; ii < 16; ii++) {
+        if (!used[ii]) {
+            indices[ii] = 3;
+            continue;
+        }
+
+        float best = 1e30f;
+        for (int pp = 0; pp < paletteSize; pp++) {
+            float dr = pixels[0][ii] - palette[pp][0];
+            float dg = pixels[1][ii] - palette[pp][1];
+            float db = pixels[2][ii] - palette[pp][2];
+            float dist = dr*dr + dg*dg + db*db;
+            if (dist < best) {
+                best = dist;
+                indices[ii] = pp;
+            }
+        }
+        error += best;
+    }
+#endif
+
+    return error;
+}
+
+//
+//  evaluateColors
+//
+//    Builds the palette of two endpoints in the block's mode and
+//  returns the error of the best indices for it
+////////////////////////////////////////////////////////////
+static float evaluateColors( GLushort c0, GLushort c1, const float pixels[3][16], const bool used[16], int indices[16]) {
+    float palette[4][3];
+    unpackColor( c0, palette[0]);
+    unpackColor( c1, palette[1]);
+
+    int paletteSize = 4;
+    for (int cc = 0; cc < 3; cc++) {
+        if (c0 > c1) {
+            palette[2][cc] = (2.0f * palette[0][cc] + palette[1][cc]) / 3.0f;
+            palette[3][cc] = (palette[0][cc] + 2.0f * palette[1][cc]) / 3.0f;
+        }
+        else {
+            //three colours and transparent black, the last one is never picked for opaque pixels
+            palette[2][cc] = 0.5f * (palette[0][cc] + palette[1][cc]);
+            paletteSize = 3;
+        }
+    }
+
+    return findIndices( pixels, palette, paletteSize, used, indices);
+}
+
+//
+//  encodeColorBlock
+//
+//    Encodes the colour of a block, pixels with an alpha below
+//  128 are made transparent when punchThrough is set. Without it
+//  the block always uses the four colour mode, as BC2 and BC3
+//  require.
+////////////////////////////////////////////////////////////
+static void encodeColorBlock( const GLubyte block[16][4], bool punchThrough, GLubyte *dst) {
+    float pixels[3][16];
+    bool used[16];
+    bool transparent = false;
+    int count = 0;
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (int ii = 0; ii < 16; ii++) {
+        used[ii] = !punchThrough || block[ii][3] >= 128;
+        transparent = transparent || !used[ii];
+        for (int cc = 0; cc < 3; cc++) {
+            pixels[cc][ii] = (float)block[ii][cc];
+            if (used[ii])
+                mean[cc] += pixels[cc][ii];
+        }
+        count += used[ii] ? 1 : 0;
+    }
+
+    GLushort c0 = 0, c1 = 0;
+    int indices[16];
+
+    if (count > 0) {
+        for (int cc = 0; cc < 3; cc++)
+            mean[cc] /= (float)count;
+
+        //covariance of the used pixels
+        float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int ii = 0; ii < 16; ii++) {
+            if (!used[ii])
+                continue;
+            float r = pixels[0][ii] - mean[0];
+            float g = pixels[1][ii] - mean[1];
+            float b = pixels[2][ii] - mean[2];
+            cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+            cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+        }
+
+        //principal axis by power iteration, starting from the luminance direction
+        float axis[3] = { 0.299f, 0.587f, 0.114f };
+        for (int iter = 0; iter < 8; iter++) {
+            float next[3] = {
+                cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2],
+                cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2],
+                cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2]
+            };
+            float len = std::max( fabsf( next[0]), std::max( fabsf( next[1]), fabsf( next[2])));
+            if (len < 1e-6f)
+                break;
+            axis[0] = next[0] / len;
+            axis[1] = next[1] / len;
+            axis[2] = next[2] / len;
+        }
+
+        //the endpoints are the extreme pixels along the axis
+        float lo = 1e30f, hi = -1e30f;
+        int loPixel = 0, hiPixel = 0;
+        for (int ii = 0; ii < 16; ii++) {
+            if (!used[ii])
+                continue;
+            float d = pixels[0][ii]*axis[0] + pixels[1][ii]*axis[1] + pixels[2][ii]*axis[2];
+            if (d < lo) { lo = d; loPixel = ii; }
+            if (d > hi) { hi = d; hiPixel = ii; }
+        }
+
+        float colorHi[3] = { pixels[0][hiPixel], pixels[1][hiPixel], pixels[2][hiPixel] };
+        float colorLo[3] = { pixels[0][loPixel], pixels[1][loPixel], pixels[2][loPixel] };
+        c0 = packColor( colorHi);
+        c1 = packColor( colorLo);
+    }
+
+    //the mode is chosen by the order of the endpoints
+    if (transparent) {
+        if (c0 > c1)
+            std::swap( c0, c1);
+    }
+    else if (c0 < c1) {
+        std::swap( c0, c1);
+    }
+
+    float error = evaluateColors( c0, c1, pixels, used, indices);
+
+    //least squares endpoints for the chosen indices, kept if they lower the error
+    if (count > 0 && !transparent && c0 != c1) {
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+
+        for (int ii = 0; ii < 16; ii++) {
+            float a = weights[indices[ii]];
+            float b = 1.0f - a;
+            aa += a*a; ab += a*b; bb += b*b;
+            for (int cc = 0; cc < 3; cc++) {
+                ax[cc] += a * pixels[cc][ii];
+                bx[cc] += b * pixels[cc][ii];
+            }
+        }
+
+        float det = aa*bb - ab*ab;
+        if (fabsf( det) > 1e-6f) {
+            float colorA[3], colorB[3];
+            for (int cc = 0; cc < 3; cc++) {
+                colorA[cc] = (ax[cc]*bb - bx[cc]*ab) / det;
+                colorB[cc] = (bx[cc]*aa - ax[cc]*ab) / det;
+            }
+
+            GLushort r0 = packColor( colorA);
+            GLushort r1 = packColor( colorB);
+            if (r0 < r1)
+                std::swap( r0, r1);
+
+            int refined[16];
+            if (r0 != r1) {
+                float refinedError = evaluateColors( r0, r1, pixels, used, refined);
+                if (refinedError < error) {
+                    c0 = r0;
+                    c1 = r1;
+                    error = refinedError;
+                    memcpy( indices, refined, sizeof(indices));
+                }
+            }
+        }
+    }
+
+    dst[0] = (GLubyte)(c0 & 0xff);
+    dst[1] = (GLubyte)(c0 >> 8);
+    dst[2] = (GLubyte)(c1 & 0xff);
+    dst[3] = (GLubyte)(c1 >> 8);
+    for (int yy = 0; yy < 4; yy++) {
+        dst[4 + yy] = (GLubyte)(indices[yy*4] | (indices[yy*4 + 1] << 2) | (indices[yy*4 + 2] << 4) | (indices[yy*4 + 3] << 6));
+    }
+}
+
+//
+//  encodeChannelBlock
+//
+//    Encodes one channel of a block in the eight value mode of
+//  BC4, the format of the DXT5 alpha block
+////////////////////////////////////////////////////////////
+static void encodeChannelBlock( const GLubyte block[16][4], int channel, GLubyte *dst) {
+    int lo = 255, hi = 0;
+    for (int ii = 0; ii < 16; ii++) {
+        lo = std::min( lo, (int)block[ii][channel]);
+        hi = std::max( hi, (int)block[ii][channel]);
+    }
+
+    dst[0] = (GLubyte)hi;
+    dst[1] = (GLubyte)lo;
+
+    unsigned long long bits = 0;
+    if (hi > lo) {
+        //value k of the palette is ((7-k)*hi + k*lo)/7 for k in 0..7, stored as 0, 2..7, 1
+        static const int codes[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+        int range = hi - lo;
+        for (int ii = 0; ii < 16; ii++) {
+            int k = ((hi - block[ii][channel]) * 14 + range) / (2 * range);
+            bits |= (unsigned long long)codes[k] << (3 * ii);
+        }
+    }
+
+    for (int ii = 0; ii < 6; ii++)
+        dst[2 + ii] = (GLubyte)(bits >> (8 * ii));
+}
+
+//
+//  encodeBlockRow
+//
+////////////////////////////////////////////////////////////
+static void encodeBlockRow( const BlockRow &row, const SourceLayout &layout, GLenum format, int secondChannel) {
+    GLubyte block[16][4];
+    GLubyte *dst = row.dst;
+    int blocks = (row.width + 3) / 4;
+
+    for (int bx = 0; bx < blocks; bx++) {
+        fetchBlock( row, bx, layout, block);
+
+        switch (format) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+                encodeColorBlock( block, false, dst);
+                dst += 8;
+                break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+                encodeColorBlock( block, true, dst);
+                dst += 8;
+                break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                encodeChannelBlock( block, 3, dst);
+                encodeColorBlock( block, false, dst + 8);
+                dst += 16;
+                break;
+            case GL_COMPRESSED_LUMINANCE_LATC1_EXT:
+                encodeChannelBlock( block, 0, dst);
+                dst += 8;
+                break;
+            case GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT:
+                encodeChannelBlock( block, 0, dst);
+                encodeChannelBlock( block, secondChannel, dst + 8);
+                dst += 16;
+                break;
+        }
+    }
+}
+
+//
+//  compress
+//
+//    All faces, levels and slices are cut into block rows first,
+//  which are then split evenly over the workers.
+////////////////////////////////////////////////////////////
+bool Image::compress( GLenum format) {
+    SourceLayout layout;
+    if (isCompressed() || !getSourceLayout( _format, _type, layout))
+        return false;
+
+    int blockSize;
+    int secondChannel = 1;
+    switch (format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_LUMINANCE_LATC1_EXT:
+            blockSize = 8;
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            blockSize = 16;
+            break;
+        case GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT:
+            //luminance alpha keeps its channels, colour images store red and green like normal maps do
+            if (_format == GL_LUMINANCE || _format == GL_ALPHA)
+                return false;
+            secondChannel = (_format == GL_LUMINANCE_ALPHA) ? 3 : 1;
+            blockSize = 16;
+            break;
+        default:
+            return false;
+    }
+
+    vector<GLubyte*> data;
+    vector<BlockRow> rows;
+
+    for (int face = 0; face < ((_faces) ? _faces : 1); face++) {
+        int w = _width, h = _height, d = (_depth) ? _depth : 1;
+        for (int level = 0; level < _levelCount; level++) {
+            int bw = (w + 3) / 4;
+            int bh = (h + 3) / 4;
+            GLubyte *dst = allocData( bw * bh * d * blockSize);
+            const GLubyte *src = _data[face*_levelCount + level];
+            data.push_back( dst);
+
+            for (int slice = 0; slice < d; slice++) {
+                for (int by = 0; by < bh; by++) {
+                    BlockRow row;
+                    row.src = src + ((size_t)slice * h + by * 4) * w * layout.elementSize;
+                    row.dst = dst + ((size_t)slice * bh + by) * bw * blockSize;
+                    row.width = w;
+                    row.rows = h - by * 4;
+                    rows.push_back( row);
+                }
+            }
+
+            w = ( w > 1) ? w >> 1 : 1;
+            h = ( h > 1) ? h >> 1 : 1;
+            d = ( d > 1) ? d >> 1 : 1;
+        }
+    }
+
+    size_t workers = rows.size() / MIN_BLOCK_ROWS_PER_THREAD;
+    size_t cores = std::thread::hardware_concurrency();
+    workers = std::max( std::min( workers, cores), (size_t)1);
+
+    auto encode = [&rows, &layout, format, secondChannel]( size_t begin, size_t end) {
+        for (size_t ii = begin; ii < end; ii++)
+            encodeBlockRow( rows[ii], layout, format, secondChannel);
+    };
+
+    //the calling thread takes the first range
+    vector<std::thread> threads;
+    for (size_t ii = 1; ii < workers; ii++)
+        threads.push_back( std::thread( encode, rows.size() * ii / workers, rows.size() * (ii + 1) / workers));
+    encode( 0, rows.size() / workers);
+    for (size_t ii = 0; ii < threads.size(); ii++)
+        threads[ii].join();
+
+    //the levels are replaced, the orientation of the rows is kept
+    freeData();
+    _data = data;
+    _format = format;
+    _internalFormat = format;
+    _type = format;
+    _elementSize = blockSize;
+
+    return true;
+}
+
+//
+//  decodeColorBlock
+//
+//    Expands a colour block to rgba. Only DXT1 blocks use the
+//  three colour mode, its fourth entry is transparent black.
+////////////////////////////////////////////////////////////
+static void decodeColorBlock( const GLubyte *src, bool dxt1, GLubyte block[16][4]) {
+    GLushort c0 = (GLushort)(src[0] | (src[1] << 8));
+    GLushort c1 = (GLushort)(src[2] | (src[3] << 8));
+    float palette[4][3];
+    GLubyte alpha[4] = { 255, 255, 255, 255};
+
+    unpackColor( c0, palette[0]);
+    unpackColor( c1, palette[1]);
+    for (int cc = 0; cc < 3; cc++) {
+        if (c0 > c1 || !dxt1) {
+            palette[2][cc] = (2.0f * palette[0][cc] + palette[1][cc]) / 3.0f;
+            palette[3][cc] = (palette[0][cc] + 2.0f * palette[1][cc]) / 3.0f;
+        }
+        else {
+            palette[2][cc] = (palette[0][cc] + palette[1][cc]) * 0.5f;
+            palette[3][cc] = 0.0f;
+            alpha[3] = 0;
+        }
+    }
+
+    for (int ii = 0; ii < 16; ii++) {
+        int index = (src[4 + ii / 4] >> (2 * (ii % 4))) & 3;
+        for (int cc = 0; cc < 3; cc++)
+            block[ii][cc] = (GLubyte)(palette[index][cc] + 0.5f);
+        block[ii][3] = alpha[index];
+    }
+}
+
+//
+//  decodeChannelBlock
+//
+//    Expands a BC4 block, the DXT5 alpha block, into one channel
+////////////////////////////////////////////////////////////
+static void decodeChannelBlock( const GLubyte *src, int channel, GLubyte block[16][4]) {
+    int a0 = src[0], a1 = src[1];
+    int palette[8];
+
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int kk = 1; kk < 7; kk++)
+            palette[kk + 1] = ((7 - kk) * a0 + kk * a1 + 3) / 7;
+    }
+    else {
+        for (int kk = 1; kk < 5; kk++)
+            palette[kk + 1] = ((5 - kk) * a0 + kk * a1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    unsigned long long bits = 0;
+    for (int ii = 0; ii < 6; ii++)
+        bits |= (unsigned long long)src[2 + ii] << (8 * ii);
+
+    for (int ii = 0; ii < 16; ii++)
+        block[ii][channel] = (GLubyte)palette[(bits >> (3 * ii)) & 7];
+}
+
+//
+//  decodeExplicitAlphaBlock
+//
+//    Expands the four bit alpha of a DXT3 block
+////////////////////////////////////////////////////////////
+static void decodeExplicitAlphaBlock( const GLubyte *src, GLubyte block[16][4]) {
+    for (int ii = 0; ii < 16; ii++)
+        block[ii][3] = (GLubyte)(((src[ii / 2] >> (4 * (ii % 2))) & 15) * 17);
+}
+
+//
+//  decompress
+//
+//    Blocks over the edge of a level are decoded whole, only the
+//  pixels inside the level are kept.
+////////////////////////////////////////////////////////////
+bool Image::decompress() {
+    //rgba channels stored for each format
+    static const int rgbChannels[] = { 0, 1, 2};
+    static const int rgbaChannels[] = { 0, 1, 2, 3};
+    static const int luminanceChannels[] = { 0};
+    static const int luminanceAlphaChannels[] = { 0, 3};
+
+    const int *channels;
+    GLenum format;
+    GLenum internalFormat;
+    int elementSize;
+
+    switch (_format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            channels = rgbChannels;
+            format = GL_RGB;
+            internalFormat = GL_RGB8;
+            elementSize = 3;
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            channels = rgbaChannels;
+            format = GL_RGBA;
+            internalFormat = GL_RGBA8;
+            elementSize = 4;
+            break;
+        case GL_COMPRESSED_LUMINANCE_LATC1_EXT:
+            channels = luminanceChannels;
+            format = GL_LUMINANCE;
+            internalFormat = GL_LUMINANCE8;
+            elementSize = 1;
+            break;
+        case GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT:
+            channels = luminanceAlphaChannels;
+            format = GL_LUMINANCE_ALPHA;
+            internalFormat = GL_LUMINANCE8_ALPHA8;
+            elementSize = 2;
+            break;
+        default:
+            return false;
+    }
+
+    vector<GLubyte*> data;
+    GLubyte block[16][4];
+
+    for (int face = 0; face < ((_faces) ? _faces : 1); face++) {
+        int w = _width, h = _height, d = (_depth) ? _depth : 1;
+        for (int level = 0; level < _levelCount; level++) {
+            int bw = (w + 3) / 4;
+            int bh = (h + 3) / 4;
+            const GLubyte *src = _data[face*_levelCount + level];
+            GLubyte *dst = allocData( w * h * d * elementSize);
+            data.push_back( dst);
+
+            for (int slice = 0; slice < d; slice++) {
+                for (int by = 0; by < bh; by++) {
+                    for (int bx = 0; bx < bw; bx++, src += _elementSize) {
+                        switch (_format) {
+                            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+                            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+                                decodeColorBlock( src, true, block);
+                                break;
+                            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+                                decodeColorBlock( src + 8, false, block);
+                                decodeExplicitAlphaBlock( src, block);
+                                break;
+                            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                                decodeColorBlock( src + 8, false, block);
+                                decodeChannelBlock( src, 3, block);
+                                break;
+                            case GL_COMPRESSED_LUMINANCE_LATC1_EXT:
+                                decodeChannelBlock( src, 0, block);
+                                break;
+                            case GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT:
+                                decodeChannelBlock( src, 0, block);
+                                decodeChannelBlock( src + 8, 3, block);
+                                break;
+                        }
+
+                        for (int yy = 0; yy < 4 && by * 4 + yy < h; yy++) {
+                            for (int xx = 0; xx < 4 && bx * 4 + xx < w; xx++) {
+                                GLubyte *pixel = dst + (((size_t)slice * h + by * 4 + yy) * w + bx * 4 + xx) * elementSize;
+                                for (int cc = 0; cc < elementSize; cc++)
+                                    pixel[cc] = block[yy*4 + xx][channels[cc]];
+                            }
+                        }
+                    }
+                }
+            }
+
+            w = ( w > 1) ? w >> 1 : 1;
+            h = ( h > 1) ? h >> 1 : 1;
+            d = ( d > 1) ? d >> 1 : 1;
+        }
+    }
+
+    //the levels are replaced, the orientation of the rows is kept
+    freeData();
+    _data = data;
+    _format = format;
+    _internalFormat = internalFormat;
+    _type = GL_UNSIGNED_BYTE;
+    _elementSize = elementSize;
+
+    return true;
+}
+
+};
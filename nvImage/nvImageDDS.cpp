@@ -15,8 +15,14 @@
 
 #include <stdio.h>
 #include <cstring>
+#include <algorithm>
 #include "nvImage.h"
+#include "nvFileView.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NV_IMAGE_SSE2
+#include <emmintrin.h>
+#endif
 
 using std::vector;
 
@@ -42,6 +48,7 @@ const unsigned long DDSF_ALPHAPIXELS    = 0x00000001l;
 const unsigned long DDSF_FOURCC         = 0x00000004l;
 const unsigned long DDSF_RGB            = 0x00000040l;
 const unsigned long DDSF_RGBA           = 0x00000041l;
+const unsigned long DDSF_LUMINANCE      = 0x00020000l;
 
 // dwCaps1 flags
 const unsigned long DDSF_COMPLEX         = 0x00000008l;
@@ -120,77 +127,44 @@ const unsigned long FOURCC_R32F          = 114;
 const unsigned long FOURCC_G32R32F       = 115;
 const unsigned long FOURCC_A32B32G32R32F = 116;
 
-struct DXTColBlock
-{
-    GLushort col0;
-    GLushort col1;
-
-    GLubyte row[4];
-};
-
-struct DXT3AlphaBlock
-{
-    GLushort row[4];
-};
-
-struct DXT5AlphaBlock
-{
-    GLubyte alpha0;
-    GLubyte alpha1;
-    
-    GLubyte row[6];
-};
-
+// the file layout uses 32 bit fields throughout
 struct DDS_PIXELFORMAT
 {
-    unsigned long dwSize;
-    unsigned long dwFlags;
-    unsigned long dwFourCC;
-    unsigned long dwRGBBitCount;
-    unsigned long dwRBitMask;
-    unsigned long dwGBitMask;
-    unsigned long dwBBitMask;
-    unsigned long dwABitMask;
+    unsigned int dwSize;
+    unsigned int dwFlags;
+    unsigned int dwFourCC;
+    unsigned int dwRGBBitCount;
+    unsigned int dwRBitMask;
+    unsigned int dwGBitMask;
+    unsigned int dwBBitMask;
+    unsigned int dwABitMask;
 };
 
 struct DDS_HEADER
 {
-    unsigned long dwSize;
-    unsigned long dwFlags;
-    unsigned long dwHeight;
-    unsigned long dwWidth;
-    unsigned long dwPitchOrLinearSize;
-    unsigned long dwDepth;
-    unsigned long dwMipMapCount;
-    unsigned long dwReserved1[11];
+    unsigned int dwSize;
+    unsigned int dwFlags;
+    unsigned int dwHeight;
+    unsigned int dwWidth;
+    unsigned int dwPitchOrLinearSize;
+    unsigned int dwDepth;
+    unsigned int dwMipMapCount;
+    unsigned int dwReserved1[11];
     DDS_PIXELFORMAT ddspf;
-    unsigned long dwCaps1;
-    unsigned long dwCaps2;
-    unsigned long dwReserved2[3];
+    unsigned int dwCaps1;
+    unsigned int dwCaps2;
+    unsigned int dwReserved2[3];
 };
 
 //
+//  readDDSHeader
 //
+//    Sets the layout of an image from a dds header, the file
+//  marker already skipped. Returns false for unsupported files.
 ////////////////////////////////////////////////////////////
-bool Image::readDDS( const char *file, Image& i) {
-
-    // open file
-    FILE *fp = fopen(file, "rb");
-    if (fp == NULL)
-        return false;
-
-    // read in file marker, make sure its a DDS file
-    char filecode[4];
-    fread(filecode, 1, 4, fp);
-    if (strncmp(filecode, "DDS ", 4) != 0)
-    {
-        fclose(fp);
-        return false;
-    }
-
-    // read in DDS header
+bool Image::readDDSHeader( const void *header, Image& i) {
     DDS_HEADER ddsh;
-    fread(&ddsh, sizeof(DDS_HEADER), 1, fp);
+    memcpy(&ddsh, header, sizeof(DDS_HEADER));
 
     // check if image is a volume texture
     if ((ddsh.dwCaps2 & DDSF_VOLUME) && (ddsh.dwDepth > 0))
@@ -202,7 +176,7 @@ bool Image::readDDS( const char *file, Image& i) {
     i._width = ddsh.dwWidth;
     i._height = ddsh.dwHeight;
     
-    if (ddsh.dwFlags & DDSF_MIPMAPCOUNT) {
+    if ((ddsh.dwFlags & DDSF_MIPMAPCOUNT) && ddsh.dwMipMapCount > 0) {
         i._levelCount = ddsh.dwMipMapCount;
     }
     else
@@ -221,7 +195,6 @@ bool Image::readDDS( const char *file, Image& i) {
 
         //check for a complete cubemap
         if ( (i._faces != 6) || (i._width != i._height) ) {
-            fclose(fp);
             return false;
         }
     }
@@ -230,7 +203,6 @@ bool Image::readDDS( const char *file, Image& i) {
         i._faces = 0;
     }
 
-    bool btcCompressed = false;
     int bytesPerElement = 0;
 
     // figure out what the image format is
@@ -243,7 +215,6 @@ bool Image::readDDS( const char *file, Image& i) {
                 i._internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
                 i._type = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
                 bytesPerElement = 8;
-                btcCompressed = true;
                 break;
 
             case FOURCC_DXT2:
@@ -252,7 +223,6 @@ bool Image::readDDS( const char *file, Image& i) {
                 i._internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
                 i._type = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
                 bytesPerElement = 16;
-                btcCompressed = true;
                 break;
 
             case FOURCC_DXT4:
@@ -261,7 +231,6 @@ bool Image::readDDS( const char *file, Image& i) {
                 i._internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
                 i._type = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
                 bytesPerElement = 16;
-                btcCompressed = true;
                 break;
 
 			case FOURCC_ATI1:
@@ -269,7 +238,6 @@ bool Image::readDDS( const char *file, Image& i) {
                 i._internalFormat = GL_COMPRESSED_LUMINANCE_LATC1_EXT;
                 i._type = GL_COMPRESSED_LUMINANCE_LATC1_EXT;
                 bytesPerElement = 8;
-                btcCompressed = true;
                 break;
 
 			case FOURCC_ATI2:
@@ -277,7 +245,6 @@ bool Image::readDDS( const char *file, Image& i) {
                 i._internalFormat = GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT;
                 i._type = GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT;
                 bytesPerElement = 16;
-                btcCompressed = true;
                 break;
 
             case FOURCC_R8G8B8:
@@ -417,7 +384,6 @@ bool Image::readDDS( const char *file, Image& i) {
             case FOURCC_G32R32F:
                 //these are unsupported for now
             default:
-                fclose(fp);
                 return false;
         }
     }
@@ -451,28 +417,60 @@ bool Image::readDDS( const char *file, Image& i) {
 	}
     else 
     {
-        fclose(fp);
         return false;
     }
 
     i._elementSize = bytesPerElement;
+    return true;
+}
+
+//
+//  readDDS
+//
+//    The file is mapped copy on write and the levels point into
+//  the mapping, so nothing is copied unless the levels get flipped.
+////////////////////////////////////////////////////////////
+bool Image::readDDS( const char *file, Image& i) {
+
+    // map the file
+    std::shared_ptr<FileView> view( new FileView);
+    if (!view->open( file, true) || view->size() < 4 + sizeof(DDS_HEADER))
+        return false;
+
+    // check the file marker, make sure its a DDS file
+    if (strncmp(view->begin(), "DDS ", 4) != 0)
+        return false;
+
+    if (!readDDSHeader( view->begin() + 4, i))
+        return false;
+
+    bool btcCompressed = i.isCompressed();
+    int bytesPerElement = i._elementSize;
+
+    GLubyte *data = (GLubyte*)view->data() + 4 + sizeof(DDS_HEADER);
+    size_t remaining = view->size() - 4 - sizeof(DDS_HEADER);
 
     for (int face = 0; face < ((i._faces) ? i._faces : 1); face++) {
         int w = i._width, h = i._height, d = (i._depth) ? i._depth : 1;
         for (int level = 0; level < i._levelCount; level++) {
-            int bw = (btcCompressed) ? (w+3)/4 : w;
-            int bh = (btcCompressed) ? (h+3)/4 : h;
-            int size = bw*bh*d*bytesPerElement;
+            size_t bw = (btcCompressed) ? (w+3)/4 : w;
+            size_t bh = (btcCompressed) ? (h+3)/4 : h;
+            size_t size = bw*bh*d*bytesPerElement;
 
-            GLubyte *data = new GLubyte[size];
-
-            fread( data, size, 1, fp);
+            //truncated file
+            if (size > remaining) {
+                i._data.clear();
+                return false;
+            }
 
             i._data.push_back(data);
 
-            if (i._faces != 6)
+            if (i._faces != 6 && i._flipOnLoad)
                 i.flipSurface( data, w, h, d);
 
+            data += size;
+            remaining -= size;
+
             //reduce mip sizes
             w = ( w > 1) ? w >> 1 : 1;
             h = ( h > 1) ? h >> 1 : 1;
@@ -490,165 +488,322 @@ bool Image::readDDS( const char *file, Image& i) {
     }
   */  
 
-    fclose(fp);
+    i._file = view;
     return true;
 }
 
 //
-// flip a DXT1 color block
+//  probeDDS
+//
+//    Reads the header only, the file size is checked against the
+//  levels like the loader does
 ////////////////////////////////////////////////////////////
-void Image::flip_blocks_dxtc1(GLubyte *ptr, unsigned int numBlocks)
-{
-    DXTColBlock *curblock = (DXTColBlock*)ptr;
-    GLubyte temp;
-
-    for (unsigned int i = 0; i < numBlocks; i++) {
-        temp = curblock->row[0];
-        curblock->row[0] = curblock->row[3];
-        curblock->row[3] = temp;
-        temp = curblock->row[1];
-        curblock->row[1] = curblock->row[2];
-        curblock->row[2] = temp;
-
-        curblock++;
-    }
+bool Image::probeDDS( const char *file, Image& i) {
+    FILE *fp = fopen( file, "rb");
+    if (!fp)
+        return false;
+
+    char header[4 + sizeof(DDS_HEADER)];
+    bool valid = fread( header, sizeof(header), 1, fp) == 1 && strncmp( header, "DDS ", 4) == 0 &&
+        readDDSHeader( header + 4, i);
+
+    fseek( fp, 0, SEEK_END);
+    long fileSize = ftell( fp);
+    fclose( fp);
+
+    if (!valid)
+        return false;
+
+    size_t size = 0;
+    for (int level = 0; level < i._levelCount; level++)
+        size += i.getImageSize( level);
+    size *= (i._faces) ? i._faces : 1;
+
+    //truncated file
+    return fileSize >= 0 && size <= (size_t)fileSize - sizeof(header);
 }
 
 //
-// flip a DXT3 color block
+//  Block flipping
+//
+//    Every 8 byte half of a block is flipped as one little endian
+//  64 bit word. Colour halves keep their endpoints in the low 32 bits
+//  with a byte of indices per row above them, DXT3 alpha has 16 bits
+//  per row, and DXT5 alpha and LATC keep their endpoints in the low 16
+//  bits with 12 bits of indices per row above them.
 ////////////////////////////////////////////////////////////
-void Image::flip_blocks_dxtc3(GLubyte *ptr, unsigned int numBlocks)
-{
-    DXTColBlock *curblock = (DXTColBlock*)ptr;
-    DXT3AlphaBlock *alphablock;
-    GLushort tempS;
-    GLubyte tempB;
+enum BlockHalf {
+    ebhColor,
+    ebhExplicitAlpha,
+    ebhInterpolatedAlpha
+};
 
-    for (unsigned int i = 0; i < numBlocks; i++)
-    {
-        alphablock = (DXT3AlphaBlock*)curblock;
+template <int HALF>
+static inline unsigned long long flipHalf( unsigned long long bits) {
+    switch (HALF) {
+        case ebhColor:
+            return (bits & 0x00000000ffffffffull) |
+                   ((bits >> 24) & 0x000000ff00000000ull) | ((bits >> 8) & 0x0000ff0000000000ull) |
+                   ((bits << 8) & 0x00ff000000000000ull) | ((bits << 24) & 0xff00000000000000ull);
+        case ebhExplicitAlpha:
+            return (bits >> 48) | ((bits >> 16) & 0x00000000ffff0000ull) |
+                   ((bits << 16) & 0x0000ffff00000000ull) | (bits << 48);
+        default:
+            return (bits & 0x000000000000ffffull) |
+                   ((bits >> 36) & 0x000000000fff0000ull) | ((bits >> 12) & 0x000000fff0000000ull) |
+                   ((bits << 12) & 0x000fff0000000000ull) | ((bits << 36) & 0xfff0000000000000ull);
+    }
+}
 
-        tempS = alphablock->row[0];
-        alphablock->row[0] = alphablock->row[3];
-        alphablock->row[3] = tempS;
-        tempS = alphablock->row[1];
-        alphablock->row[1] = alphablock->row[2];
-        alphablock->row[2] = tempS;
+#ifdef NV_IMAGE_SSE2
+template <int HALF>
+static inline __m128i flipHalves( __m128i bits) {
+    switch (HALF) {
+        case ebhColor:
+            return _mm_or_si128(
+                _mm_or_si128( _mm_and_si128( bits, _mm_set1_epi64x( 0x00000000ffffffffll)),
+                              _mm_and_si128( _mm_srli_epi64( bits, 24), _mm_set1_epi64x( 0x000000ff00000000ll))),
+                _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_srli_epi64( bits, 8), _mm_set1_epi64x( 0x0000ff0000000000ll)),
+                                            _mm_and_si128( _mm_slli_epi64( bits, 8), _mm_set1_epi64x( 0x00ff000000000000ll))),
+                              _mm_slli_epi64( _mm_srli_epi64( bits, 32), 56)));
+        case ebhExplicitAlpha:
+            return _mm_shufflehi_epi16( _mm_shufflelo_epi16( bits, _MM_SHUFFLE( 0, 1, 2, 3)), _MM_SHUFFLE( 0, 1, 2, 3));
+        default:
+            return _mm_or_si128(
+                _mm_or_si128( _mm_and_si128( bits, _mm_set1_epi64x( 0x000000000000ffffll)),
+                              _mm_and_si128( _mm_srli_epi64( bits, 36), _mm_set1_epi64x( 0x000000000fff0000ll))),
+                _mm_or_si128( _mm_or_si128( _mm_and_si128( _mm_srli_epi64( bits, 12), _mm_set1_epi64x( 0x000000fff0000000ll)),
+                                            _mm_and_si128( _mm_slli_epi64( bits, 12), _mm_set1_epi64x( 0x000fff0000000000ll))),
+                              _mm_slli_epi64( _mm_srli_epi64( bits, 16), 52)));
+    }
+}
 
-        curblock++;
+//the halves of a 16 byte block, or two 8 byte blocks
+template <int LO, int HI>
+static inline __m128i flipBlock16( __m128i bits) {
+    if (LO == HI)
+        return flipHalves<LO>( bits);
 
-        tempB = curblock->row[0];
-        curblock->row[0] = curblock->row[3];
-        curblock->row[3] = tempB;
-        tempB = curblock->row[1];
-        curblock->row[1] = curblock->row[2];
-        curblock->row[2] = tempB;
+    const __m128i lo = _mm_set_epi32( 0, 0, -1, -1);
+    return _mm_or_si128( _mm_and_si128( lo, flipHalves<LO>( bits)), _mm_andnot_si128( lo, flipHalves<HI>( bits)));
+}
+#endif
 
-        curblock++;
+//
+//  flipBlockRows
+//
+//    Flips the blocks of two block rows and swaps the rows in the
+//  same pass, top and bottom may be the same row. LO and HI are the
+//  halves of 16 byte blocks, 8 byte blocks use the same for both.
+////////////////////////////////////////////////////////////
+template <int LO, int HI>
+static void flipBlockRows( GLubyte *top, GLubyte *bottom, unsigned int size) {
+    unsigned int ii = 0;
+
+#ifdef NV_IMAGE_SSE2
+    for (; ii + 16 <= size; ii += 16) {
+        __m128i upper = _mm_loadu_si128( (const __m128i*)(top + ii));
+        __m128i lower = _mm_loadu_si128( (const __m128i*)(bottom + ii));
+        _mm_storeu_si128( (__m128i*)(top + ii), flipBlock16<LO, HI>( lower));
+        _mm_storeu_si128( (__m128i*)(bottom + ii), flipBlock16<LO, HI>( upper));
+    }
+#endif
+
+    for (; ii < size; ii += 8) {
+        unsigned long long upper, lower;
+        memcpy( &upper, top + ii, 8);
+        memcpy( &lower, bottom + ii, 8);
+        if ((ii / 8) & 1) {
+            upper = flipHalf<HI>( upper);
+            lower = flipHalf<HI>( lower);
+        }
+        else {
+            upper = flipHalf<LO>( upper);
+            lower = flipHalf<LO>( lower);
+        }
+        memcpy( top + ii, &lower, 8);
+        memcpy( bottom + ii, &upper, 8);
     }
 }
 
 //
-// flip a DXT5 alpha block
+// flip DXT1 blocks
 ////////////////////////////////////////////////////////////
-void flip_dxt5_alpha(DXT5AlphaBlock *block)
+void Image::flip_blocks_dxtc1(GLubyte *top, GLubyte *bottom, unsigned int numBlocks)
 {
-    GLubyte gBits[4][4];
-    
-    const unsigned long mask = 0x00000007;          // bits = 00 00 01 11
-    unsigned long bits = 0;
-    memcpy(&bits, &block->row[0], sizeof(unsigned char) * 3);
-
-    gBits[0][0] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[0][1] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[0][2] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[0][3] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[1][0] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[1][1] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[1][2] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[1][3] = (GLubyte)(bits & mask);
-
-    bits = 0;
-    memcpy(&bits, &block->row[3], sizeof(GLubyte) * 3);
-
-    gBits[2][0] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[2][1] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[2][2] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[2][3] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[3][0] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[3][1] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[3][2] = (GLubyte)(bits & mask);
-    bits >>= 3;
-    gBits[3][3] = (GLubyte)(bits & mask);
-
-    // clear existing alpha bits
-    memset(block->row, 0, sizeof(GLubyte) * 6);
-
-    unsigned long *pBits = ((unsigned long*) &(block->row[0]));
-
-    *pBits = *pBits | (gBits[3][0] << 0);
-    *pBits = *pBits | (gBits[3][1] << 3);
-    *pBits = *pBits | (gBits[3][2] << 6);
-    *pBits = *pBits | (gBits[3][3] << 9);
-
-    *pBits = *pBits | (gBits[2][0] << 12);
-    *pBits = *pBits | (gBits[2][1] << 15);
-    *pBits = *pBits | (gBits[2][2] << 18);
-    *pBits = *pBits | (gBits[2][3] << 21);
-
-    pBits = ((unsigned long*) &(block->row[3]));
-
-    *pBits = *pBits | (gBits[1][0] << 0);
-    *pBits = *pBits | (gBits[1][1] << 3);
-    *pBits = *pBits | (gBits[1][2] << 6);
-    *pBits = *pBits | (gBits[1][3] << 9);
-
-    *pBits = *pBits | (gBits[0][0] << 12);
-    *pBits = *pBits | (gBits[0][1] << 15);
-    *pBits = *pBits | (gBits[0][2] << 18);
-    *pBits = *pBits | (gBits[0][3] << 21);
+    flipBlockRows<ebhColor, ebhColor>(top, bottom, numBlocks * 8);
 }
 
 //
-// flip a DXT5 color block
+// flip DXT3 blocks, explicit alpha then color
 ////////////////////////////////////////////////////////////
-void Image::flip_blocks_dxtc5(GLubyte *ptr, unsigned int numBlocks)
+void Image::flip_blocks_dxtc3(GLubyte *top, GLubyte *bottom, unsigned int numBlocks)
 {
-    DXTColBlock *curblock = (DXTColBlock*)ptr;
-    DXT5AlphaBlock *alphablock;
-    GLubyte temp;
-    
-    for (unsigned int i = 0; i < numBlocks; i++)
-    {
-        alphablock = (DXT5AlphaBlock*)curblock;
-        
-        flip_dxt5_alpha(alphablock);
+    flipBlockRows<ebhExplicitAlpha, ebhColor>(top, bottom, numBlocks * 16);
+}
+
+//
+// flip DXT5 blocks, interpolated alpha then color
+////////////////////////////////////////////////////////////
+void Image::flip_blocks_dxtc5(GLubyte *top, GLubyte *bottom, unsigned int numBlocks)
+{
+    flipBlockRows<ebhInterpolatedAlpha, ebhColor>(top, bottom, numBlocks * 16);
+}
+
+//
+// flip LATC1 blocks, they have the layout of a DXT5 alpha block
+////////////////////////////////////////////////////////////
+void Image::flip_blocks_latc1(GLubyte *top, GLubyte *bottom, unsigned int numBlocks)
+{
+    flipBlockRows<ebhInterpolatedAlpha, ebhInterpolatedAlpha>(top, bottom, numBlocks * 8);
+}
+
+//
+// flip LATC2 blocks, two LATC1 blocks for luminance and alpha
+////////////////////////////////////////////////////////////
+void Image::flip_blocks_latc2(GLubyte *top, GLubyte *bottom, unsigned int numBlocks)
+{
+    flipBlockRows<ebhInterpolatedAlpha, ebhInterpolatedAlpha>(top, bottom, numBlocks * 16);
+}
+
+//
+//  writeDDS
+//
+//    Writes the levels of all faces in the order readDDS expects
+//  them. Images in the OpenGL row order are flipped back to the
+//  file order, 8 bit rgb data is stored as bgr.
+////////////////////////////////////////////////////////////
+bool Image::writeDDS( const char *file, Image& i) {
+    DDS_HEADER ddsh;
+    memset(&ddsh, 0, sizeof(DDS_HEADER));
+
+    ddsh.dwSize = sizeof(DDS_HEADER);
+    ddsh.dwFlags = DDSF_CAPS | DDSF_HEIGHT | DDSF_WIDTH | DDSF_PIXELFORMAT;
+    ddsh.dwHeight = i._height;
+    ddsh.dwWidth = i._width;
+    ddsh.ddspf.dwSize = sizeof(DDS_PIXELFORMAT);
+    ddsh.dwCaps1 = DDSF_TEXTURE;
+
+    bool swapRB = false;
+
+    if (i.isCompressed()) {
+        ddsh.dwFlags |= DDSF_LINEARSIZE;
+        ddsh.dwPitchOrLinearSize = i.getImageSize(0);
+        ddsh.ddspf.dwFlags = DDSF_FOURCC;
+
+        switch (i._format) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+                ddsh.ddspf.dwFourCC = FOURCC_DXT1;
+                break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+                ddsh.ddspf.dwFourCC = FOURCC_DXT3;
+                break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                ddsh.ddspf.dwFourCC = FOURCC_DXT5;
+                break;
+            case GL_COMPRESSED_LUMINANCE_LATC1_EXT:
+                ddsh.ddspf.dwFourCC = FOURCC_ATI1;
+                break;
+            case GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT:
+                ddsh.ddspf.dwFourCC = FOURCC_ATI2;
+                break;
+            default:
+                return false;
+        }
+    }
+    else {
+        if (i._type != GL_UNSIGNED_BYTE)
+            return false;
 
-        curblock++;
+        ddsh.dwFlags |= DDSF_PITCH;
+        ddsh.dwPitchOrLinearSize = i._width * i._elementSize;
+
+        switch (i._format) {
+            case GL_RGBA:
+                swapRB = true;
+                // fall through
+            case GL_BGRA:
+                ddsh.ddspf.dwFlags = DDSF_RGBA;
+                ddsh.ddspf.dwRGBBitCount = 32;
+                ddsh.ddspf.dwRBitMask = 0x00ff0000;
+                ddsh.ddspf.dwGBitMask = 0x0000ff00;
+                ddsh.ddspf.dwBBitMask = 0x000000ff;
+                ddsh.ddspf.dwABitMask = 0xff000000;
+                break;
+            case GL_RGB:
+                swapRB = true;
+                // fall through
+            case GL_BGR:
+                ddsh.ddspf.dwFlags = DDSF_RGB;
+                ddsh.ddspf.dwRGBBitCount = 24;
+                ddsh.ddspf.dwRBitMask = 0x00ff0000;
+                ddsh.ddspf.dwGBitMask = 0x0000ff00;
+                ddsh.ddspf.dwBBitMask = 0x000000ff;
+                break;
+            case GL_LUMINANCE:
+                ddsh.ddspf.dwFlags = DDSF_LUMINANCE;
+                ddsh.ddspf.dwRGBBitCount = 8;
+                ddsh.ddspf.dwRBitMask = 0x000000ff;
+                break;
+            default:
+                return false;
+        }
+    }
 
-        temp = curblock->row[0];
-        curblock->row[0] = curblock->row[3];
-        curblock->row[3] = temp;
-        temp = curblock->row[1];
-        curblock->row[1] = curblock->row[2];
-        curblock->row[2] = temp;
+    if (i._levelCount > 1) {
+        ddsh.dwFlags |= DDSF_MIPMAPCOUNT;
+        ddsh.dwMipMapCount = i._levelCount;
+        ddsh.dwCaps1 |= DDSF_COMPLEX | DDSF_MIPMAP;
+    }
+    if (i._faces) {
+        ddsh.dwCaps1 |= DDSF_COMPLEX;
+        ddsh.dwCaps2 = DDSF_CUBEMAP | DDSF_CUBEMAP_ALL_FACES;
+    }
+    if (i._depth) {
+        ddsh.dwFlags |= DDSF_DEPTH;
+        ddsh.dwDepth = i._depth;
+        ddsh.dwCaps1 |= DDSF_COMPLEX;
+        ddsh.dwCaps2 |= DDSF_VOLUME;
+    }
+
+    FILE *fp = fopen(file, "wb");
+    if (fp == NULL)
+        return false;
+
+    bool ok = fwrite("DDS ", 4, 1, fp) == 1;
+    ok = ok && fwrite(&ddsh, sizeof(DDS_HEADER), 1, fp) == 1;
 
-        curblock++;
+    vector<GLubyte> level;
+
+    for (int face = 0; face < ((i._faces) ? i._faces : 1) && ok; face++) {
+        int w = i._width, h = i._height, d = (i._depth) ? i._depth : 1;
+        for (int l = 0; l < i._levelCount && ok; l++) {
+            int size = i.getImageSize(l);
+            const GLubyte *data = i._data[face*i._levelCount + l];
+
+            // cubemap faces are never flipped, see readDDS
+            if ((i._flipOnLoad && i._faces != 6) || swapRB) {
+                level.assign(data, data + size);
+                if (i._flipOnLoad && i._faces != 6)
+                    i.flipSurface( &level[0], w, h, d);
+                for (int jj = 0; swapRB && jj < size; jj += i._elementSize)
+                    std::swap(level[jj], level[jj + 2]);
+                data = &level[0];
+            }
+
+            ok = fwrite(data, size, 1, fp) == 1;
+
+            //reduce mip sizes
+            w = ( w > 1) ? w >> 1 : 1;
+            h = ( h > 1) ? h >> 1 : 1;
+            d = ( d > 1) ? d >> 1 : 1;
+        }
     }
+
+    ok = (fclose(fp) == 0) && ok;
+    return ok;
 }
 
 
-};
\ No newline at end of file
+};
\ No newline at end of file
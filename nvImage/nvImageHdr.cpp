@@ -5,7 +5,10 @@
 // object. This class is useful for loading and formating images
 // for use as textures. The class supports dds, png, and hdr formats.
 //
-// This file implements the HDR specific functionality.
+// This file implements the HDR specific functionality. The file is
+// mapped and the start of every scanline found in one pass over the
+// run lengths, then the scanlines are decoded on all cores. Pixels
+// are converted through tables, straight to half floats if asked to.
 //
 // Author: Evan Hart
 // Email: sdkfeedback@nvidia.com
@@ -13,62 +16,292 @@
 // Copyright (c) NVIDIA Corporation. All rights reserved.
 ////////////////////////////////////////////////////////////////////////////////
 
-#include "rgbe.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
 
 #include "nvImage.h"
+#include "nvFileView.h"
+#include "nvHalf.h"
+
+//scanlines a worker gets at least, small images are decoded on one thread
+#define MIN_SCANLINES_PER_THREAD 16
+
+//bytes read when probing, headers are a few short lines
+#define HDR_PROBE_SIZE 65536
 
 using std::vector;
 
 namespace nv {
 
 //
-//  readHdr
+//  Conversion tables for rgbe pixels, the scale of every
+//  exponent and the half float of every mantissa and exponent.
+//  A zero exponent is a black pixel.
+////////////////////////////////////////////////////////////
+struct RgbeTables {
+    float scale[256];
+    GLushort half[256][256];
+
+    RgbeTables() {
+        scale[0] = 0.0f;
+        for (int ee = 1; ee < 256; ee++)
+            scale[ee] = ldexpf( 1.0f, ee - (128 + 8));
+
+        for (int ee = 0; ee < 256; ee++)
+            for (int mm = 0; mm < 256; mm++)
+                half[ee][mm] = floatToHalf( mm * scale[ee], true);
+    }
+};
+
+static const RgbeTables& rgbeTables() {
+    static const RgbeTables tables;
+    return tables;
+}
+
+//
+//  readHdrHeader
 //
-//    Image loader function for hdr files. 
+//    Accepts the headers rgbe.c does, lines up to the FORMAT
+//  line and then up to the resolution. Returns the start of the
+//  pixels or 0.
 ////////////////////////////////////////////////////////////
-bool Image::readHdr( const char *file, Image& i) {
-    int width, height;
-    FILE *fp = fopen(file, "rb");
-    if (!fp) {
-        return false;
+static const char* readHdrHeader( const char *data, const char *end, int &width, int &height) {
+    bool format = false;
+
+    while (data < end) {
+        const char *eol = (const char*)memchr( data, '\n', end - data);
+        if (!eol)
+            return 0;
+
+        char line[128];
+        size_t length = std::min( (size_t)(eol - data), sizeof(line) - 1);
+        memcpy( line, data, length);
+        line[length] = 0;
+        data = eol + 1;
+
+        if (!format) {
+            if (length == 0)
+                return 0;
+            format = (strcmp( line, "FORMAT=32-bit_rle_rgbe") == 0);
+        }
+        else if (sscanf( line, "-Y %d +X %d", &height, &width) == 2) {
+            return (width > 0 && height > 0) ? data : 0;
+        }
     }
+    return 0;
+}
 
-    rgbe_header_info header;
+//
+//  findScanlines
+//
+//    Walks the run lengths to find where every scanline starts.
+//  Scanlines from flat on are stored without run length encoding,
+//  like the rest of a file once one scanline is not encoded.
+////////////////////////////////////////////////////////////
+static bool findScanlines( const GLubyte *data, const GLubyte *end, int width, int height, vector<const GLubyte*> &scanlines, int &flat) {
+    scanlines.resize( height);
+    flat = (width < 8 || width > 0x7fff) ? 0 : height;
 
-    if (RGBE_ReadHeader( fp, &width, &height, &header)) {
-        fclose(fp);
-        return false;
+    for (int yy = 0; yy < height; yy++) {
+        if (yy < flat) {
+            if (end - data < 4)
+                return false;
+            if (data[0] != 2 || data[1] != 2 || (data[2] & 0x80))
+                flat = yy;
+            else if (((data[2] << 8) | data[3]) != width)
+                return false;
+        }
+
+        if (yy >= flat) {
+            if ((size_t)(end - data) < (size_t)(height - yy) * width * 4)
+                return false;
+            for (; yy < height; yy++, data += width * 4)
+                scanlines[yy] = data;
+            return true;
+        }
+
+        scanlines[yy] = data;
+        data += 4;
+        for (int channel = 0; channel < 4; channel++) {
+            for (int count = 0; count < width; ) {
+                if (end - data < 2)
+                    return false;
+                int run = data[0];
+                if (run > 128) {
+                    run -= 128;
+                    data += 2;
+                }
+                else {
+                    if (run == 0 || end - data < 1 + run)
+                        return false;
+                    data += 1 + run;
+                }
+                if (run > width - count)
+                    return false;
+                count += run;
+            }
+        }
     }
+    return true;
+}
 
-    GLubyte *data = (GLubyte*)new float[width*height*3];
-    
-    if (!data) {
-        fclose(fp);
-        return false;
+//
+//  decodeScanline
+//
+//    Expands the runs of an encoded scanline into four planes
+////////////////////////////////////////////////////////////
+static void decodeScanline( const GLubyte *data, int width, GLubyte *planes) {
+    data += 4;
+    for (int channel = 0; channel < 4; channel++) {
+        GLubyte *plane = planes + channel * width;
+        for (int count = 0; count < width; ) {
+            int run = data[0];
+            if (run > 128) {
+                run -= 128;
+                memset( plane + count, data[1], run);
+                data += 2;
+            }
+            else {
+                memcpy( plane + count, data + 1, run);
+                data += 1 + run;
+            }
+            count += run;
+        }
     }
+}
 
-    if (RGBE_ReadPixels_RLE( fp, (float*)data, width, height)) {
-        delete []data;
-        fclose(fp);
-        return false;
+//
+//  convertScanline
+//
+//    Converts rgbe pixels to rgb floats or half floats, from
+//  planes or from interleaved pixels
+////////////////////////////////////////////////////////////
+static void convertScanline( const GLubyte *rgbe, int channelStride, int step, int width, bool half, GLubyte *dst) {
+    const RgbeTables &tables = rgbeTables();
+    const GLubyte *r = rgbe;
+    const GLubyte *g = rgbe + channelStride;
+    const GLubyte *b = rgbe + 2 * channelStride;
+    const GLubyte *e = rgbe + 3 * channelStride;
+
+    if (half) {
+        GLushort *out = (GLushort*)dst;
+        for (int ii = 0; ii < width; ii++, out += 3) {
+            const GLushort *exponent = tables.half[e[ii * step]];
+            out[0] = exponent[r[ii * step]];
+            out[1] = exponent[g[ii * step]];
+            out[2] = exponent[b[ii * step]];
+        }
+    }
+    else {
+        float *out = (float*)dst;
+        for (int ii = 0; ii < width; ii++, out += 3) {
+            float scale = tables.scale[e[ii * step]];
+            out[0] = r[ii * step] * scale;
+            out[1] = g[ii * step] * scale;
+            out[2] = b[ii * step] * scale;
+        }
     }
+}
+
+//
+//  readHdr
+//
+//    Image loader function for hdr files. The scanlines are
+//  written straight to their flipped place.
+////////////////////////////////////////////////////////////
+bool Image::readHdr( const char *file, Image& i) {
+    FileView view;
+    if (!view.open( file))
+        return false;
+
+    int width, height;
+    const GLubyte *pixels = (const GLubyte*)readHdrHeader( view.begin(), view.end(), width, height);
+    if (!pixels)
+        return false;
+
+    vector<const GLubyte*> scanlines;
+    int flat;
+    if (!findScanlines( pixels, (const GLubyte*)view.end(), width, height, scanlines, flat))
+        return false;
+
+    bool half = i._halfFloatOnLoad;
+    int elementSize = (half) ? 6 : 12;
+    bool flip = i._flipOnLoad;
+    GLubyte *data = i.allocData( (size_t)width * height * elementSize);
+
+    auto decode = [&]( int begin, int end) {
+        vector<GLubyte> planes( width * 4);
+        for (int yy = begin; yy < end; yy++) {
+            //hdr images come in upside down
+            GLubyte *dst = data + (size_t)((flip) ? height - 1 - yy : yy) * width * elementSize;
+            if (yy < flat) {
+                decodeScanline( scanlines[yy], width, &planes[0]);
+                convertScanline( &planes[0], width, 1, width, half, dst);
+            }
+            else {
+                convertScanline( scanlines[yy], 1, 4, width, half, dst);
+            }
+        }
+    };
+
+    size_t workers = height / MIN_SCANLINES_PER_THREAD;
+    size_t cores = std::thread::hardware_concurrency();
+    workers = std::max( std::min( workers, cores), (size_t)1);
+
+    //the calling thread takes the first range
+    vector<std::thread> threads;
+    for (size_t ii = 1; ii < workers; ii++)
+        threads.push_back( std::thread( decode, (int)(height * ii / workers), (int)(height * (ii + 1) / workers)));
+    decode( 0, (int)(height / workers));
+    for (size_t ii = 0; ii < threads.size(); ii++)
+        threads[ii].join();
 
     //set all the parameters
     i._width = width;
     i._height = height;
     i._depth = 0;
     i._levelCount = 1;
-    i._type = GL_FLOAT;
+    i._type = (half) ? GL_HALF_FLOAT_ARB : GL_FLOAT;
     i._format = GL_RGB;
-    i._internalFormat = GL_RGB32F_ARB;
+    i._internalFormat = (half) ? GL_RGB16F_ARB : GL_RGB32F_ARB;
     i._faces = 0;
-    i._elementSize = 12;
+    i._elementSize = elementSize;
     i._data.push_back( data);
 
-    //hdr images come in upside down
-    i.flipSurface( data, i._width, i._height, i._depth);
+    return true;
+}
+
+//
+//  probeHdr
+//
+//    Reads the start of the file and parses the header there
+////////////////////////////////////////////////////////////
+bool Image::probeHdr( const char *file, Image& i) {
+    FILE *fp = fopen( file, "rb");
+    if (!fp)
+        return false;
+
+    vector<char> header( HDR_PROBE_SIZE);
+    size_t size = fread( &header[0], 1, header.size(), fp);
+    fclose( fp);
 
-    fclose(fp);
+    int width, height;
+    if (!readHdrHeader( &header[0], &header[0] + size, width, height))
+        return false;
+
+    bool half = i._halfFloatOnLoad;
+    i._width = width;
+    i._height = height;
+    i._depth = 0;
+    i._levelCount = 1;
+    i._type = (half) ? GL_HALF_FLOAT_ARB : GL_FLOAT;
+    i._format = GL_RGB;
+    i._internalFormat = (half) ? GL_RGB16F_ARB : GL_RGB32F_ARB;
+    i._faces = 0;
+    i._elementSize = (half) ? 6 : 12;
 
     return true;
 }
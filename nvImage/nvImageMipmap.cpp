@@ -0,0 +1,452 @@
+//
+// nvImageMipmap.cpp - Image support class
+//
+// The nvImage class implements an interface for a multipurpose image
+// object. This class is useful for loading and formating images
+// for use as textures. The class supports dds, png, and hdr formats.
+//
+// This file builds mipmap chains on the CPU. Every level is filtered
+// from the one above it with a separable filter, the pixels are kept
+// as four floats in linear space between the levels so nothing is
+// requantized. A pixel is filtered as one SSE vector where available
+// and the rows of every level are split over all cores.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "nvImage.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NV_IMAGE_SSE2
+#include <emmintrin.h>
+#endif
+
+//rows a worker gets at least, small levels are filtered on one thread
+#define MIN_ROWS_PER_THREAD 32
+
+//support of the Kaiser filter in pixels of the smaller level, and the shape of its window
+#define KAISER_RADIUS 3.0f
+#define KAISER_ALPHA 4.0f
+
+using std::vector;
+
+namespace nv {
+
+//
+//  Weights of a filter for every pixel of the smaller level,
+//  each pixel reads count source pixels from first[ii]
+////////////////////////////////////////////////////////////
+struct FilterTaps {
+    int count;
+    vector<int> first;
+    vector<int> index;       // count source pixels for every pixel, clamped to the edge
+    vector<float> weight;    // count weights for every pixel, adding up to one
+};
+
+//
+//  Layout of a filtered format, the number of channels and
+//  the channel that holds alpha or -1
+////////////////////////////////////////////////////////////
+struct MipmapLayout {
+    int channels;
+    int alpha;
+};
+
+//
+//
+////////////////////////////////////////////////////////////
+static bool getMipmapLayout( GLenum format, GLenum type, MipmapLayout &layout) {
+    if (type != GL_UNSIGNED_BYTE && type != GL_FLOAT)
+        return false;
+
+    static const struct { GLenum format; int channels; int alpha; } layouts[] = {
+        { GL_RGB,             3, -1},
+        { GL_RGBA,            4, 3},
+        { GL_BGR,             3, -1},
+        { GL_BGRA,            4, 3},
+        { GL_LUMINANCE,       1, -1},
+        { GL_LUMINANCE_ALPHA, 2, 1},
+        { GL_ALPHA,           1, 0},
+    };
+
+    for (unsigned int ii = 0; ii < sizeof(layouts) / sizeof(layouts[0]); ii++) {
+        if (layouts[ii].format == format) {
+            layout.channels = layouts[ii].channels;
+            layout.alpha = layouts[ii].alpha;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+//  forRows
+//
+//    Splits rows over the cores, the calling thread takes the
+//  first range
+////////////////////////////////////////////////////////////
+template <class F>
+static void forRows( int rows, const F &filter) {
+    size_t workers = rows / MIN_ROWS_PER_THREAD;
+    size_t cores = std::thread::hardware_concurrency();
+    workers = std::max( std::min( workers, cores), (size_t)1);
+
+    vector<std::thread> threads;
+    for (size_t ii = 1; ii < workers; ii++)
+        threads.push_back( std::thread( filter, (int)(rows * ii / workers), (int)(rows * (ii + 1) / workers)));
+    filter( 0, (int)(rows / workers));
+    for (size_t ii = 0; ii < threads.size(); ii++)
+        threads[ii].join();
+}
+
+//
+//  sRGB transfer functions
+//
+////////////////////////////////////////////////////////////
+static float srgbToLinear( float value) {
+    return (value <= 0.04045f) ? value / 12.92f : powf( (value + 0.055f) / 1.055f, 2.4f);
+}
+
+//
+//  the linear values of the 8 bit codes, sRGB or not
+//
+////////////////////////////////////////////////////////////
+static const float* decodeTable( bool srgb) {
+    struct Tables {
+        float linear[256];
+        float srgb[256];
+        Tables() {
+            for (int ii = 0; ii < 256; ii++) {
+                linear[ii] = ii / 255.0f;
+                srgb[ii] = srgbToLinear( ii / 255.0f);
+            }
+        }
+    };
+    static const Tables tables;
+    return (srgb) ? tables.srgb : tables.linear;
+}
+
+//
+//  encodeSrgb
+//
+//    Returns the nearest sRGB code of a linear value, the table
+//  holds the linear values halfway between neighbouring codes
+////////////////////////////////////////////////////////////
+static GLubyte encodeSrgb( float value) {
+    struct Thresholds {
+        float value[255];
+        Thresholds() {
+            for (int ii = 0; ii < 255; ii++)
+                value[ii] = srgbToLinear( (ii + 0.5f) / 255.0f);
+        }
+    };
+    static const Thresholds thresholds;
+    return (GLubyte)(std::upper_bound( thresholds.value, thresholds.value + 255, value) - thresholds.value);
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+static GLubyte encodeLinear( float value) {
+    return (GLubyte)(std::min( std::max( value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+//
+//  Filter kernels, t is the distance in pixels of the smaller
+//  level
+////////////////////////////////////////////////////////////
+static float bessel0( float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int kk = 1; kk < 32 && term > sum * 1e-8f; kk++) {
+        float half = x / (2.0f * kk);
+        term *= half * half;
+        sum += term;
+    }
+    return sum;
+}
+
+static float kaiser( float t) {
+    float ratio = t / KAISER_RADIUS;
+    if (ratio * ratio >= 1.0f)
+        return 0.0f;
+
+    float x = 3.14159265f * t;
+    float sinc = (fabsf( x) < 1e-6f) ? 1.0f : sinf( x) / x;
+    return sinc * bessel0( KAISER_ALPHA * sqrtf( 1.0f - ratio * ratio)) / bessel0( KAISER_ALPHA);
+}
+
+//
+//  buildTaps
+//
+//    The box filter weights every source pixel by how much of
+//  the destination pixel it covers, the Kaiser filter samples
+//  its kernel at the source pixel centers. Taps over the edge
+//  read the edge pixel.
+////////////////////////////////////////////////////////////
+static void buildTaps( int srcSize, int dstSize, Image::MipmapFilter filter, FilterTaps &taps) {
+    float scale = (float)srcSize / dstSize;
+    float radius = ((filter == Image::emfBox) ? 0.5f : KAISER_RADIUS) * scale;
+    int window = (int)ceilf( 2.0f * radius) + 1;
+    vector<float> weights( dstSize * window);
+
+    //the weights of every pixel, then the smallest count that holds all nonzero ones
+    taps.first.resize( dstSize);
+    taps.count = 1;
+    for (int ii = 0; ii < dstSize; ii++) {
+        float center = (ii + 0.5f) * scale;
+        int first = (int)floorf( center - radius);
+        int used = 0;
+        float sum = 0.0f;
+
+        for (int jj = 0; jj < window; jj++) {
+            float w;
+            if (filter == Image::emfBox) {
+                float lo = std::max( (float)(first + jj), center - radius);
+                float hi = std::min( (float)(first + jj + 1), center + radius);
+                w = std::max( hi - lo, 0.0f);
+            }
+            else {
+                w = kaiser( (first + jj + 0.5f - center) / scale);
+            }
+            weights[ii*window + jj] = w;
+            sum += w;
+        }
+
+        //drop the leading zeros
+        int skip = 0;
+        while (skip < window - 1 && weights[ii*window + skip] == 0.0f)
+            skip++;
+        for (int jj = 0; jj < window; jj++) {
+            float w = (jj + skip < window) ? weights[ii*window + jj + skip] / sum : 0.0f;
+            weights[ii*window + jj] = w;
+            if (w != 0.0f)
+                used = jj + 1;
+        }
+        taps.first[ii] = first + skip;
+        taps.count = std::max( taps.count, used);
+    }
+
+    taps.index.resize( dstSize * taps.count);
+    taps.weight.resize( dstSize * taps.count);
+    for (int ii = 0; ii < dstSize; ii++) {
+        for (int jj = 0; jj < taps.count; jj++) {
+            taps.index[ii*taps.count + jj] = std::min( std::max( taps.first[ii] + jj, 0), srcSize - 1);
+            taps.weight[ii*taps.count + jj] = weights[ii*window + jj];
+        }
+    }
+}
+
+//
+//  filterRow
+//
+//    Filters one row of four float pixels horizontally
+////////////////////////////////////////////////////////////
+static void filterRow( const float *src, float *dst, int width, const FilterTaps &taps) {
+    const int *index = &taps.index[0];
+    const float *weight = &taps.weight[0];
+
+    for (int xx = 0; xx < width; xx++, dst += 4) {
+#ifdef NV_IMAGE_SSE2
+        __m128 sum = _mm_setzero_ps();
+        for (int kk = 0; kk < taps.count; kk++, index++, weight++)
+            sum = _mm_add_ps( sum, _mm_mul_ps( _mm_set1_ps( *weight), _mm_loadu_ps( src + *index * 4)));
+        _mm_storeu_ps( dst, sum);
+#else
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f};
+        for (int kk = 0; kk < taps.count; kk++, index++, weight++)
+            for (int cc = 0; cc < 4; cc++)
+                sum[cc] += *weight * src[*index * 4 + cc];
+        memcpy( dst, sum, sizeof(sum));
+#endif
+    }
+}
+
+//
+//  filterColumns
+//
+//    Sums weighted rows into one row of four float pixels
+////////////////////////////////////////////////////////////
+static void filterColumns( const float *src, float *dst, int width, const int *index, const float *weight, int count) {
+    int floats = width * 4;
+    memset( dst, 0, floats * sizeof(float));
+
+    for (int kk = 0; kk < count; kk++) {
+        const float *row = src + (size_t)index[kk] * floats;
+        float w = weight[kk];
+        int xx = 0;
+#ifdef NV_IMAGE_SSE2
+        __m128 ww = _mm_set1_ps( w);
+        for (; xx < floats; xx += 4)
+            _mm_storeu_ps( dst + xx, _mm_add_ps( _mm_loadu_ps( dst + xx), _mm_mul_ps( ww, _mm_loadu_ps( row + xx))));
+#endif
+        for (; xx < floats; xx++)
+            dst[xx] += w * row[xx];
+    }
+}
+
+//
+//  generateMipmaps
+//
+//    Compressed images are decoded, the new levels are encoded
+//  in the same format while the base level keeps its blocks.
+////////////////////////////////////////////////////////////
+bool Image::generateMipmaps( MipmapFilter filter, bool srgb) {
+    if (_depth > 0)
+        return false;
+
+    int levels = 1;
+    while ((std::max( _width, _height) >> levels) > 0)
+        levels++;
+
+    int faces = (_faces) ? _faces : 1;
+
+    if (isCompressed()) {
+        if (levels == 1)
+            return true;
+
+        Image chain;
+        chain._allocator = _allocator;
+        chain._width = _width;
+        chain._height = _height;
+        chain._depth = 0;
+        chain._faces = _faces;
+        chain._levelCount = 1;
+        chain._format = _format;
+        chain._internalFormat = _internalFormat;
+        chain._type = _type;
+        chain._elementSize = _elementSize;
+        for (int face = 0; face < faces; face++) {
+            int size = getImageSize( 0);
+            GLubyte *base = chain.allocData( size);
+            memcpy( base, _data[face*_levelCount], size);
+            chain._data.push_back( base);
+        }
+
+        if (!chain.decompress() || !chain.generateMipmaps( filter, srgb))
+            return false;
+
+        //drop the decoded base level, the chain starts one level down
+        for (int face = faces - 1; face >= 0; face--) {
+            chain.releaseData( chain._data[face*chain._levelCount]);
+            chain._data.erase( chain._data.begin() + face*chain._levelCount);
+        }
+        chain._levelCount--;
+        chain._width = std::max( _width >> 1, 1);
+        chain._height = std::max( _height >> 1, 1);
+
+        if (!chain.compress( _format))
+            return false;
+
+        vector<GLubyte*> data;
+        for (int face = 0; face < faces; face++) {
+            data.push_back( _data[face*_levelCount]);
+            for (int level = 1; level < _levelCount; level++)
+                releaseData( _data[face*_levelCount + level]);
+            for (int level = 0; level < chain._levelCount; level++)
+                data.push_back( chain._data[face*chain._levelCount + level]);
+        }
+        chain._data.clear();
+
+        _data = data;
+        _levelCount = levels;
+        return true;
+    }
+
+    MipmapLayout layout;
+    if (!getMipmapLayout( _format, _type, layout))
+        return false;
+
+    //the alpha channel is always linear
+    const float *decode[4];
+    for (int cc = 0; cc < 4; cc++)
+        decode[cc] = decodeTable( srgb && cc != layout.alpha);
+
+    vector<GLubyte*> data;
+
+    for (int face = 0; face < faces; face++) {
+        const GLubyte *base = _data[face*_levelCount];
+        int w = _width, h = _height;
+        vector<float> level( (size_t)w * h * 4);
+
+        data.push_back( _data[face*_levelCount]);
+        for (int ii = 1; ii < _levelCount; ii++)
+            releaseData( _data[face*_levelCount + ii]);
+
+        //the base level in linear space, unused channels stay zero
+        forRows( h, [&]( int begin, int end) {
+            for (int yy = begin; yy < end; yy++) {
+                for (int xx = 0; xx < w; xx++) {
+                    size_t pixel = (size_t)yy * w + xx;
+                    float *dst = &level[pixel * 4];
+                    for (int cc = 0; cc < 4; cc++) {
+                        if (cc >= layout.channels)
+                            dst[cc] = 0.0f;
+                        else if (_type == GL_FLOAT)
+                            dst[cc] = ((const float*)base)[pixel * layout.channels + cc];
+                        else
+                            dst[cc] = decode[cc][base[pixel * layout.channels + cc]];
+                    }
+                }
+            }
+        });
+
+        //the temporaries only shrink down the chain, they are allocated once per face
+        vector<float> rows, next;
+        for (int ii = 1; ii < levels; ii++) {
+            int dw = std::max( w >> 1, 1);
+            int dh = std::max( h >> 1, 1);
+            FilterTaps across, down;
+            buildTaps( w, dw, filter, across);
+            buildTaps( h, dh, filter, down);
+
+            //horizontally into every source row, then down the columns
+            rows.resize( (size_t)h * dw * 4);
+            forRows( h, [&]( int begin, int end) {
+                for (int yy = begin; yy < end; yy++)
+                    filterRow( &level[(size_t)yy * w * 4], &rows[(size_t)yy * dw * 4], dw, across);
+            });
+
+            next.resize( (size_t)dw * dh * 4);
+            GLubyte *dst = allocData( dw * dh * _elementSize);
+            data.push_back( dst);
+
+            forRows( dh, [&]( int begin, int end) {
+                for (int yy = begin; yy < end; yy++) {
+                    float *row = &next[(size_t)yy * dw * 4];
+                    filterColumns( &rows[0], row, dw, &down.index[yy*down.count], &down.weight[yy*down.count], down.count);
+
+                    for (int xx = 0; xx < dw; xx++) {
+                        size_t pixel = (size_t)yy * dw + xx;
+                        for (int cc = 0; cc < layout.channels; cc++) {
+                            float value = row[xx * 4 + cc];
+                            if (_type == GL_FLOAT)
+                                ((float*)dst)[pixel * layout.channels + cc] = std::max( value, 0.0f);
+                            else if (srgb && cc != layout.alpha)
+                                dst[pixel * layout.channels + cc] = encodeSrgb( value);
+                            else
+                                dst[pixel * layout.channels + cc] = encodeLinear( value);
+                        }
+                    }
+                }
+            });
+
+            level.swap( next);
+            w = dw;
+            h = dh;
+        }
+    }
+
+    _data = data;
+    _levelCount = levels;
+    return true;
+}
+
+};
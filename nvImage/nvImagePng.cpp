@@ -56,28 +56,39 @@ void pngFlushFn( png_structp png_ptr) {
 }
 
 //
-//  readPng
+//  littleEndian
 //
-//    Image loader function for png files. The code is heavily
-//  based on the example png loader code distributed with libPNG
 ////////////////////////////////////////////////////////////
-bool Image::readPng( const char *file, Image& i) {
+static bool littleEndian() {
+    const unsigned short one = 1;
+    return *(const unsigned char*)&one == 1;
+}
+
+//
+//  readPngRows
+//
+//    Streaming png decoder. The layout goes to the reader before
+//  the first row, then the rows are decoded one at a time into the
+//  buffer the reader provides, or into a single temporary row. Only
+//  interlaced files need all rows, they are complete after the last
+//  pass. The code is based on the example png loader code
+//  distributed with libPNG
+////////////////////////////////////////////////////////////
+bool Image::readPngRows( const char *file, RowReader &reader) {
     FILE *fp = fopen( file, "rb");
 
     if ( !fp)
         return false;
 
     GLubyte signature[8];
-    fread( signature, 8, 1, fp);
-
-    png_structp png_ptr = NULL;
-    png_infop info_ptr = NULL;
-
-    if (!png_check_sig( signature, 8)) {
+    if (fread( signature, 8, 1, fp) != 1 || !png_check_sig( signature, 8)) {
         fclose(fp);
         return false;
     }
 
+    png_structp png_ptr = NULL;
+    png_infop info_ptr = NULL;
+
     png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png_ptr) {
         fclose(fp);
@@ -104,95 +115,193 @@ bool Image::readPng( const char *file, Image& i) {
 
     png_set_sig_bytes(png_ptr, 8);  // skip the sig bytes
 
-    png_read_info(png_ptr, info_ptr);  // automagically read everything to the image data
+    png_read_info(png_ptr, info_ptr);
 
-    i._width = png_get_image_width(png_ptr, info_ptr);
-    i._height = png_get_image_height(png_ptr, info_ptr);
-    i._depth = 0; // using the convention of depth == 0 for 2D images
     int colorType = png_get_color_type( png_ptr, info_ptr);
     int bitDepth = png_get_bit_depth( png_ptr, info_ptr);
 
-    if (setjmp(png_jmpbuf(png_ptr))) { 
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        fclose(fp);
-        return false;
-    }
-
     //Setup the read transforms
     // expand palette images to RGB and low-bit-depth grayscale images to 8 bits
     // convert transparency chunks to full alpha channel
+    // 16 bit samples are stored big endian, deliver them in native order
     if (colorType == PNG_COLOR_TYPE_PALETTE) {
         png_set_palette_to_rgb(png_ptr);
     }
     if (colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8) {
-        //png_set_gray_1_2_4_to_8(png_ptr);
         png_set_expand_gray_1_2_4_to_8(png_ptr);
     }
     if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
         png_set_tRNS_to_alpha(png_ptr);
     }
-
-    // now configure for reading, and allocate the memory
-    png_read_update_info(png_ptr, info_ptr);
-
-    int rowBytes = png_get_rowbytes(png_ptr, info_ptr);
-
-    GLubyte *data = new GLubyte[rowBytes * i._height];
-
-    GLubyte **rowPointers = new GLubyte*[i._height]; 
-
-    // set up the row pointers
-    for ( int ii = 0;  ii < i._height; ii++) {
-        rowPointers[ii] = data + ii*rowBytes;
+    if (bitDepth == 16 && littleEndian()) {
+        png_set_swap(png_ptr);
     }
+    int passes = png_set_interlace_handling(png_ptr);
 
-    // read the image
-    png_read_image(png_ptr, rowPointers);
-
+    png_read_update_info(png_ptr, info_ptr);
 
-    // reading is complete, configure other parameters
+    Image layout;
+    layout._width = png_get_image_width(png_ptr, info_ptr);
+    layout._height = png_get_image_height(png_ptr, info_ptr);
+    layout._depth = 0; // using the convention of depth == 0 for 2D images
+    layout._levelCount = 1;
+    layout._faces = 0;
 
-    delete []rowPointers;
-    bool use16 = bitDepth > 8;
+    bool use16 = png_get_bit_depth( png_ptr, info_ptr) > 8;
 
-    i._type = (use16) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    layout._type = (use16) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
 
     switch ((int)png_get_channels(png_ptr, info_ptr)) {
         case 1:
-            i._format = GL_LUMINANCE;
-            i._internalFormat = (use16) ? GL_LUMINANCE16 : GL_LUMINANCE8;
-            i._elementSize = (use16) ? 2 : 1;
+            layout._format = GL_LUMINANCE;
+            layout._internalFormat = (use16) ? GL_LUMINANCE16 : GL_LUMINANCE8;
+            layout._elementSize = (use16) ? 2 : 1;
             break;
         case 2:
-            i._format = GL_LUMINANCE_ALPHA;
-            i._internalFormat = (use16) ? GL_LUMINANCE16_ALPHA16 : GL_LUMINANCE8_ALPHA8;
-            i._elementSize = (use16) ? 4 : 2;
+            layout._format = GL_LUMINANCE_ALPHA;
+            layout._internalFormat = (use16) ? GL_LUMINANCE16_ALPHA16 : GL_LUMINANCE8_ALPHA8;
+            layout._elementSize = (use16) ? 4 : 2;
             break;
         case 3:
-            i._format = GL_RGB;
-            i._internalFormat = (use16) ? GL_RGB16 : GL_RGB8;
-            i._elementSize = (use16) ? 6 : 3;
+            layout._format = GL_RGB;
+            layout._internalFormat = (use16) ? GL_RGB16 : GL_RGB8;
+            layout._elementSize = (use16) ? 6 : 3;
             break;
         case 4:
-            i._format = GL_RGBA;
-            i._internalFormat = (use16) ? GL_RGBA16 : GL_RGBA8;
-            i._elementSize = (use16) ? 8 : 4;
+            layout._format = GL_RGBA;
+            layout._internalFormat = (use16) ? GL_RGBA16 : GL_RGBA8;
+            layout._elementSize = (use16) ? 8 : 4;
             break;
     }
 
+    int rowBytes = png_get_rowbytes(png_ptr, info_ptr);
+    int height = layout._height;
+
+    if (!reader.begin( layout)) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    // interlaced rows need to stay around for all passes
+    int tempRows = (passes > 1) ? height : 1;
+    GLubyte * volatile temp = NULL;
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        delete []temp;
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    for ( int pass = 0; pass < passes; pass++) {
+        for ( int ii = 0; ii < height; ii++) {
+            GLubyte *row = (GLubyte*)reader.rowBuffer( ii);
+
+            if (!row) {
+                if (!temp)
+                    temp = new GLubyte[tempRows * rowBytes];
+                row = temp + ((tempRows > 1) ? ii : 0) * rowBytes;
+            }
+
+            png_read_row( png_ptr, row, NULL);
+
+            if (pass == passes - 1)
+                reader.row( ii, row);
+        }
+    }
+
+    delete []temp;
+
     png_read_end(png_ptr, NULL);
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
     fclose(fp);
 
-    //finalize parameters
-    i._data.push_back( data);
-    i._levelCount = 1;
-    i._faces = 0;
-    i._depth = 0;
-    i.flipSurface( data, i._width, i._height, i._depth);
-    
     return true;
+}
 
+//
+//  readPng
+//
+//    Image loader function for png files. The rows are decoded
+//  straight into their place in the level.
+////////////////////////////////////////////////////////////
+bool Image::readPng( const char *file, Image& i) {
+
+    struct LevelReader : public RowReader {
+        Image &image;
+        GLubyte *data;
+        int rowBytes;
+
+        LevelReader( Image &i) : image(i), data(0), rowBytes(0) {}
+
+        bool begin( const Image &layout) {
+            image._width = layout._width;
+            image._height = layout._height;
+            image._depth = layout._depth;
+            image._levelCount = layout._levelCount;
+            image._faces = layout._faces;
+            image._format = layout._format;
+            image._internalFormat = layout._internalFormat;
+            image._type = layout._type;
+            image._elementSize = layout._elementSize;
+
+            rowBytes = image._width * image._elementSize;
+            data = image.allocData( rowBytes * image._height);
+            return true;
+        }
+
+        // flipped to the OpenGL convention while decoding, unless the file order is kept
+        void* rowBuffer( int row) {
+            return data + (image._flipOnLoad ? image._height - 1 - row : row) * rowBytes;
+        }
+
+        void row( int, const void*) {}
+    } reader( i);
+
+    if (!readPngRows( file, reader)) {
+        i.releaseData( reader.data);
+        return false;
+    }
+
+    i._data.push_back( reader.data);
+
+    return true;
+}
+
+//
+//  probePng
+//
+//    The decoder is cancelled once it has the layout, libPNG
+//  has read the chunks before the image data by then
+////////////////////////////////////////////////////////////
+bool Image::probePng( const char *file, Image& i) {
+
+    struct LayoutReader : public RowReader {
+        Image &image;
+        bool found;
+
+        LayoutReader( Image &i) : image(i), found(false) {}
+
+        bool begin( const Image &layout) {
+            image._width = layout._width;
+            image._height = layout._height;
+            image._depth = layout._depth;
+            image._levelCount = layout._levelCount;
+            image._faces = layout._faces;
+            image._format = layout._format;
+            image._internalFormat = layout._internalFormat;
+            image._type = layout._type;
+            image._elementSize = layout._elementSize;
+            found = true;
+            return false;
+        }
+
+        void row( int, const void*) {}
+    } reader( i);
+
+    readPngRows( file, reader);
+    return reader.found;
 }
 
 //
@@ -286,10 +395,10 @@ bool Image::writePng( const char *file, Image& i) {
 
     GLubyte **row_pointers = new GLubyte*[i._height]; 
 
-    // set up the row pointers
+    // set up the row pointers, images in the OpenGL row order are written bottom up
     GLubyte *data = i._data[0];
     for ( int ii = 0;  ii < i._height; ii++) {
-        row_pointers[ii] = data + (i._height - 1 - ii)*row_bytes;
+        row_pointers[ii] = data + (i._flipOnLoad ? i._height - 1 - ii : ii)*row_bytes;
     }
 
     png_write_image( png_ptr, row_pointers);
@@ -303,4 +412,4 @@ bool Image::writePng( const char *file, Image& i) {
     return true;
 }
 
-};
\ No newline at end of file
+};
\ No newline at end of file
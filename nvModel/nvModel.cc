@@ -16,9 +16,8 @@
 
 #include <stdio.h>
 
-#include <set>
-#include <map>
 #include <algorithm>
+#include <thread>
 #include <string.h>
 #include <ctype.h>
 
@@ -37,11 +36,12 @@ int strcicomp(const char *str1, const char *str2) {
 
 
 using std::vector;
-using std::set;
-using std::map;
 using std::min;
 using std::max;
 
+//meshes are split into ranges of at least this many corners for the parallel passes
+#define MIN_CORNERS_PER_THREAD (1 << 16)
+
 namespace nv {
 
 //////////////////////////////////////////////////////////////////////
@@ -51,7 +51,7 @@ namespace nv {
 //////////////////////////////////////////////////////////////////////
 
 //
-//  Index gathering and ordering structure
+//  Index gathering structure, the key of a compiled vertex
 ////////////////////////////////////////////////////////////
 struct IdxSet {
     GLuint pIndex;
@@ -60,48 +60,340 @@ struct IdxSet {
     GLuint tanIndex;
     GLuint cIndex;
 
-    bool operator< ( const IdxSet &rhs) const {
-        if (pIndex < rhs.pIndex)
-            return true;
-        else if (pIndex == rhs.pIndex) {
-            if (nIndex < rhs.nIndex)
-                return true;
-            else if (nIndex == rhs.nIndex) {
-            
-                if ( tIndex < rhs.tIndex)
-                    return true;
-                else if ( tIndex == rhs.tIndex) {
-                    if (tanIndex < rhs.tanIndex)
-                        return true;
-                    else if (tanIndex == rhs.tanIndex)
-                        return (cIndex < rhs.cIndex);
-                }
+    bool operator== ( const IdxSet &rhs) const {
+        return pIndex == rhs.pIndex && nIndex == rhs.nIndex && tIndex == rhs.tIndex &&
+               tanIndex == rhs.tanIndex && cIndex == rhs.cIndex;
+    }
+
+    GLuint hash() const {
+        GLuint h = pIndex * 0x9e3779b1u;
+        h = (h ^ (h >> 15)) + nIndex * 0x85ebca77u;
+        h = (h ^ (h >> 13)) + tIndex * 0xc2b2ae3du;
+        h = (h ^ (h >> 16)) + tanIndex * 0x27d4eb2fu;
+        h = (h ^ (h >> 15)) + cIndex * 0x165667b1u;
+        h ^= h >> 16;
+        return h;
+    }
+};
+
+//
+//  Open addressing (linear probing) table from index sets to
+//  compiled vertex numbers. It is sized up front for the worst
+//  case of every corner being unique, so it never rehashes.
+////////////////////////////////////////////////////////////
+class IdxTable {
+public:
+    IdxTable( int maxCount) : _mask(15) {
+        while (_mask < (GLuint)maxCount * 2)
+            _mask = _mask * 2 + 1;
+        _slots.resize( _mask + 1, ~0u);
+        _keys.reserve( maxCount);
+    }
+
+    // returns the vertex number of the set, adds it as the next one when new
+    GLuint insert( const IdxSet &idx, bool &added) {
+        GLuint slot = idx.hash() & _mask;
+        while (_slots[slot] != ~0u) {
+            if (_keys[_slots[slot]] == idx) {
+                added = false;
+                return _slots[slot];
             }
+            slot = (slot + 1) & _mask;
         }
+        added = true;
+        _slots[slot] = (GLuint)_keys.size();
+        _keys.push_back( idx);
+        return _slots[slot];
+    }
 
-        return false;
+    int size() const {
+        return (int)_keys.size();
     }
+
+private:
+    GLuint _mask;
+    vector<GLuint> _slots; // vertex numbers, ~0 marks an empty slot
+    vector<IdxSet> _keys;  // index set of every vertex
 };
 
 //
-//  Edge connectivity structure 
+//  Runs func(ii, begin, end) for the ranges of count items
+//  split over the workers, on threads if there are several
 ////////////////////////////////////////////////////////////
-struct Edge {
-    GLuint pIndex[2]; //position indices
+template <class Func>
+static void runWorkers( int workers, size_t count, Func func) {
+    if (workers == 1) {
+        func( 0, (size_t)0, count);
+        return;
+    }
+
+    vector<std::thread> threads;
+    for (int ii = 1; ii < workers; ii++)
+        threads.push_back( std::thread( func, ii, count * ii / workers, count * (ii + 1) / workers));
+    func( 0, (size_t)0, count / workers);
+    for (size_t ii = 0; ii < threads.size(); ii++)
+        threads[ii].join();
+}
+
+//
+//  Number of workers for the parallel passes over the corners
+////////////////////////////////////////////////////////////
+static int cornerWorkers( size_t corners) {
+    size_t workers = corners / MIN_CORNERS_PER_THREAD;
+    size_t threads = std::thread::hardware_concurrency();
+    if (workers > threads)
+        workers = threads;
+    return workers < 1 ? 1 : (int)workers;
+}
+
+//
+//  Stable LSD radix sort of the packed edge keys, the corners
+//  are carried along. The passes are split over the workers by
+//  ranges, which scatter through per worker digit offsets, so
+//  the result does not depend on the worker count.
+////////////////////////////////////////////////////////////
+static void sortEdges( vector<unsigned long long> &keys, vector<GLuint> &corners, int keyBits, int workers) {
+    const int digitBits = 11;
+    const int radix = 1 << digitBits;
+    size_t count = keys.size();
+
+    vector<unsigned long long> tmpKeys( count);
+    vector<GLuint> tmpCorners( count);
+    vector<size_t> offsets( workers * radix);
+
+    for (int shift = 0; shift < keyBits; shift += digitBits) {
+        runWorkers( workers, count, [&]( int worker, size_t begin, size_t end) {
+            size_t *hist = &offsets[worker * radix];
+            std::fill( hist, hist + radix, (size_t)0);
+            for (size_t ii = begin; ii < end; ii++)
+                hist[(keys[ii] >> shift) & (radix - 1)]++;
+        });
+
+        //nothing moves if all keys share this digit
+        int digit = (int)((keys[0] >> shift) & (radix - 1));
+        size_t same = 0;
+        for (int ii = 0; ii < workers; ii++)
+            same += offsets[ii * radix + digit];
+        if (same == count)
+            continue;
+
+        //scatter positions, digit major so the order of the workers is kept
+        size_t sum = 0;
+        for (int dd = 0; dd < radix; dd++) {
+            for (int ii = 0; ii < workers; ii++) {
+                size_t n = offsets[ii * radix + dd];
+                offsets[ii * radix + dd] = sum;
+                sum += n;
+            }
+        }
+
+        runWorkers( workers, count, [&]( int worker, size_t begin, size_t end) {
+            size_t *pos = &offsets[worker * radix];
+            for (size_t ii = begin; ii < end; ii++) {
+                size_t dst = pos[(keys[ii] >> shift) & (radix - 1)]++;
+                tmpKeys[dst] = keys[ii];
+                tmpCorners[dst] = corners[ii];
+            }
+        });
 
-    bool operator< (const Edge &rhs) const {
-        return ( pIndex[0] == rhs.pIndex[0]) ? ( pIndex[1] < rhs.pIndex[1]) : pIndex[0] < rhs.pIndex[0];
+        keys.swap( tmpKeys);
+        corners.swap( tmpCorners);
     }
+}
+
+//
+//  Further groups of the slots in smoothCorners, an open
+//  addressing table from a slot to the first of its groups,
+//  which are chained in the order they were started
+////////////////////////////////////////////////////////////
+class SlotGroups {
+public:
+    struct Group {
+        GLuint corner; // the corner starting the group
+        GLuint next;   // the next group of the slot, ~0 ends the chain
+        vec3f sum;
+    };
+
+    SlotGroups() : _mask(63), _count(0), _keys( 64, ~0u), _heads( 64) {}
+
+    // returns the first group of the slot, ~0 if it has none
+    GLuint first( GLuint slot) const {
+        GLuint ii = (slot * 0x9e3779b1u) & _mask;
+        while (_keys[ii] != ~0u) {
+            if (_keys[ii] == slot)
+                return _heads[ii];
+            ii = (ii + 1) & _mask;
+        }
+        return ~0u;
+    }
+
+    // starts a group of the slot after the group last, or as its first one if last is ~0
+    GLuint add( GLuint slot, GLuint last, GLuint corner, const vec3f &sum) {
+        Group group = { corner, ~0u, sum };
+        groups.push_back( group);
+        GLuint gg = (GLuint)groups.size() - 1;
+
+        if (last != ~0u) {
+            groups[last].next = gg;
+            return gg;
+        }
+
+        //keep the table at most half full
+        if (_count * 2 >= _mask) {
+            vector<GLuint> keys( (_mask + 1) * 2, ~0u);
+            vector<GLuint> heads( (_mask + 1) * 2);
+            _mask = _mask * 2 + 1;
+            for (size_t ii = 0; ii < _keys.size(); ii++) {
+                if (_keys[ii] != ~0u) {
+                    GLuint jj = (_keys[ii] * 0x9e3779b1u) & _mask;
+                    while (keys[jj] != ~0u)
+                        jj = (jj + 1) & _mask;
+                    keys[jj] = _keys[ii];
+                    heads[jj] = _heads[ii];
+                }
+            }
+            _keys.swap( keys);
+            _heads.swap( heads);
+        }
 
-    Edge( GLuint v0, GLuint v1) {
-        pIndex[0] = std::min( v0, v1);
-        pIndex[1] = std::max( v0, v1);
+        GLuint ii = (slot * 0x9e3779b1u) & _mask;
+        while (_keys[ii] != ~0u)
+            ii = (ii + 1) & _mask;
+        _keys[ii] = slot;
+        _heads[ii] = gg;
+        _count++;
+        return gg;
     }
 
+    vector<Group> groups;
+
 private:
-    Edge() {} // disallow the default constructor
+    GLuint _mask;
+    GLuint _count;
+    vector<GLuint> _keys;  // slots, ~0 marks an empty entry
+    vector<GLuint> _heads; // first group of every slot
 };
 
+//
+//  Smooths the face vectors over the corners sharing a slot,
+//  for computeNormals and computeTangents. In face order, each
+//  corner adds its face vector to the slot if the normalized sum
+//  is within 60 degrees of the face direction, else to the first
+//  such further group of the slot, or starts a new group. The new
+//  groups get slots after the existing ones, in the order of the
+//  corners starting them. A slot only depends on its own corners,
+//  so the workers take ranges of slots and scan all the corners
+//  for theirs, with the same result as a single pass. The slot of
+//  every corner is written to index, and the sums are normalized.
+////////////////////////////////////////////////////////////
+static void smoothCorners( const vector<GLuint> &slots, const vector<vec3f> &add, const vector<vec3f> &dir, vector<float> &values, vector<GLuint> &index) {
+    size_t cornerCount = slots.size();
+    GLuint slotCount = (GLuint)(values.size() / 3);
+    index.resize( cornerCount);
+    if (cornerCount == 0)
+        return;
+
+    int workers = cornerWorkers( cornerCount);
+    const float agree = cosf( 3.1415926f * 0.333333f);
+
+    //corners of further groups hold the group number of their worker until the groups are numbered
+    const GLuint none = ~0u;
+    const GLuint grouped = 0x80000000u;
+
+    vector<GLuint> slotBounds( workers + 1);
+    for (int ii = 0; ii <= workers; ii++)
+        slotBounds[ii] = (GLuint)((unsigned long long)slotCount * ii / workers);
+
+    vector<SlotGroups> groups( workers);
+
+    runWorkers( workers, cornerCount, [&]( int worker, size_t, size_t) {
+        GLuint slotBegin = slotBounds[worker];
+        GLuint slotEnd = slotBounds[worker + 1];
+        SlotGroups &table = groups[worker];
+
+        for (size_t ii = 0; ii < cornerCount; ii++) {
+            GLuint slot = slots[ii];
+            if (slot < slotBegin || slot >= slotEnd)
+                continue;
+
+            const vec3f &a = add[ii / 3];
+            const vec3f &d = dir[ii / 3];
+            float *sum = &values[slot*3];
+
+            if (sum[0] == 0.0f && sum[1] == 0.0f && sum[2] == 0.0f) {
+                // first instance of this slot, just store it as is
+                sum[0] = a[0];
+                sum[1] = a[1];
+                sum[2] = a[2];
+                index[ii] = slot;
+            }
+            else if (dot( normalize( vec3f( sum)), d) >= agree) {
+                sum[0] += a[0];
+                sum[1] += a[1];
+                sum[2] += a[2];
+                index[ii] = slot;
+            }
+            else {
+                //loop through the further groups of this slot, until one agrees
+                GLuint last = none;
+                GLuint gg = table.first( slot);
+                while (gg != none && dot( normalize( table.groups[gg].sum), d) < agree) {
+                    last = gg;
+                    gg = table.groups[gg].next;
+                }
+
+                if (gg != none)
+                    table.groups[gg].sum += a;
+                else
+                    gg = table.add( slot, last, (GLuint)ii, a);
+                index[ii] = gg | grouped;
+            }
+        }
+    });
+
+    //number the further groups in the order of the corners starting them
+    vector< std::pair<GLuint, std::pair<int, GLuint> > > starts;
+    for (int ww = 0; ww < workers; ww++)
+        for (GLuint gg = 0; gg < (GLuint)groups[ww].groups.size(); gg++)
+            starts.push_back( std::make_pair( groups[ww].groups[gg].corner, std::make_pair( ww, gg)));
+    std::sort( starts.begin(), starts.end());
+
+    values.resize( (slotCount + starts.size()) * 3);
+    vector< vector<GLuint> > targets( workers);
+    for (int ww = 0; ww < workers; ww++)
+        targets[ww].resize( groups[ww].groups.size());
+
+    for (size_t ii = 0; ii < starts.size(); ii++) {
+        int ww = starts[ii].second.first;
+        GLuint gg = starts[ii].second.second;
+        GLuint target = slotCount + (GLuint)ii;
+        targets[ww][gg] = target;
+        values[target*3] = groups[ww].groups[gg].sum[0];
+        values[target*3 + 1] = groups[ww].groups[gg].sum[1];
+        values[target*3 + 2] = groups[ww].groups[gg].sum[2];
+    }
+
+    runWorkers( workers, cornerCount, [&]( int, size_t begin, size_t end) {
+        for (size_t ii = begin; ii < end; ii++) {
+            if (index[ii] & grouped) {
+                int ww = (int)(std::upper_bound( slotBounds.begin(), slotBounds.end() - 1, slots[ii]) - slotBounds.begin()) - 1;
+                index[ii] = targets[ww][index[ii] & ~grouped];
+            }
+        }
+    });
+
+    //now normalize all of them
+    size_t valueCount = values.size() / 3;
+    runWorkers( workers, valueCount, [&]( int, size_t begin, size_t end) {
+        for (size_t ii = begin; ii < end; ii++) {
+            vec3f v = normalize( vec3f( &values[ii*3]));
+            values[ii*3] = v[0];
+            values[ii*3 + 1] = v[1];
+            values[ii*3 + 2] = v[2];
+        }
+    });
+}
+
 //////////////////////////////////////////////////////////////////////
 //
 //  Static data
@@ -118,8 +410,11 @@ Model* Model::CreateModel() {
 //
 //
 ////////////////////////////////////////////////////////////
-Model::Model() : _posSize(0), _tcSize(0), _cSize(0), _pOffset(-1), _nOffset(-1), _tcOffset(-1), _sTanOffset(-1), _cOffset(-1), _vtxSize(0), _openEdges(0) {
+Model::Model() : _posSize(0), _tcSize(0), _cSize(0), _pOffset(-1), _nOffset(-1), _tcOffset(-1), _sTanOffset(-1), _cOffset(-1), _vtxSize(0), _openEdges(0),
+                 _packedSize(0), _packedScale( 1.0f, 1.0f, 1.0f), _packedBias( 0.0f, 0.0f, 0.0f), _depthSize(0) {
     //nv::vec2<float> val;
+    releaseCompiledCache();
+    memset( _packedAttribs, 0, sizeof(_packedAttribs));
 }
 
 //
@@ -162,10 +457,6 @@ void Model::compileModel( Model::PrimType prim) {
     bool needsTriangles = false;
     bool needsTrianglesWithAdj = false;
     bool needsEdges = false;
-    bool needsPoints = false;
-
-    if ( (prim & Model::eptPoints) == Model::eptPoints)
-        needsPoints = true;
 
     if ( (prim & Model::eptTriangles) == Model::eptTriangles)
         needsTriangles = true;
@@ -180,180 +471,10 @@ void Model::compileModel( Model::PrimType prim) {
         needsEdges = true;
     }
 
+    //the compiled data is rebuilt from the raw data
+    releaseCompiledCache();
+    _clusters.clear();
 
-    //merge the points
-    map<IdxSet, GLuint> pts;
-
-    //find whether a position is unique
-    set<GLuint> ptSet;
-    
-    {
-        vector<GLuint>::iterator pit = _pIndex.begin();
-        vector<GLuint>::iterator nit = _nIndex.begin();
-        vector<GLuint>::iterator tit = _tIndex.begin();
-        vector<GLuint>::iterator tanit = _tanIndex.begin();
-        vector<GLuint>::iterator cit = _cIndex.begin();
-
-        while ( pit < _pIndex.end()) {
-            IdxSet idx;
-            idx.pIndex = *pit;
-
-            if ( _normals.size() > 0)
-                idx.nIndex = *nit;
-            else
-                idx.nIndex = 0;
-
-            if ( _tIndex.size() > 0)
-                idx.tIndex = *tit;
-            else
-                idx.tIndex = 0;
-
-            if ( _tanIndex.size() > 0)
-                idx.tanIndex = *tanit;
-            else
-                idx.tanIndex = 0;
-
-            if ( _cIndex.size() > 0)
-                idx.cIndex = *cit;
-            else
-                idx.cIndex = 0;
-
-            map<IdxSet,GLuint>::iterator mit = pts.find(idx);
-
-            if (mit == pts.end()) {
-
-                if (needsTriangles)
-                    _indices[2].push_back( (GLuint)pts.size());
-
-                //since this one is a new vertex, check to see if this position is already referenced
-                if (needsPoints && ptSet.find(idx.pIndex) != ptSet.end()) {
-                    ptSet.insert( idx.pIndex);
-                }
-
-                pts.insert( map<IdxSet,GLuint>::value_type(idx, (GLuint)pts.size()));
-
-                //position
-                _vertices.push_back( _positions[idx.pIndex*_posSize]);
-                _vertices.push_back( _positions[idx.pIndex*_posSize + 1]);
-                _vertices.push_back( _positions[idx.pIndex*_posSize + 2]);
-                if (_posSize == 4)
-                    _vertices.push_back( _positions[idx.pIndex*_posSize + 3]);
-
-                //normal
-                if (_normals.size() > 0) {
-                    _vertices.push_back( _normals[idx.nIndex*3]);
-                    _vertices.push_back( _normals[idx.nIndex*3 + 1]);
-                    _vertices.push_back( _normals[idx.nIndex*3 + 2]);
-                }
-
-                //texture coordinate
-                if (_texCoords.size() > 0) {
-                    _vertices.push_back( _texCoords[idx.tIndex*_tcSize]);
-                    _vertices.push_back( _texCoords[idx.tIndex*_tcSize + 1]);
-                    if (_tcSize == 3)
-                        _vertices.push_back( _texCoords[idx.tIndex*_tcSize + 2]);
-                }
-
-                //tangents
-                if (_sTangents.size() > 0) {
-                    _vertices.push_back( _sTangents[idx.tanIndex*3]);
-                    _vertices.push_back( _sTangents[idx.tanIndex*3 + 1]);
-                    _vertices.push_back( _sTangents[idx.tanIndex*3 + 2]);
-                }
-
-                //colors
-                if (_colors.size() > 0) {
-                    _vertices.push_back( _colors[idx.cIndex*_cSize]);
-                    _vertices.push_back( _colors[idx.cIndex*_cSize + 1]);
-                    _vertices.push_back( _colors[idx.cIndex*_cSize + 2]);
-                    if (_cSize == 4)
-                        _vertices.push_back( _colors[idx.cIndex*_cSize + 3]);
-                }
-            }
-            else {
-                if (needsTriangles)
-                    _indices[2].push_back( mit->second);
-            }
-
-            //advance the iterators if the components are present
-            pit++;
-
-            if (hasNormals())
-                nit++;
-
-            if (hasTexCoords())
-                tit++;
-
-            if (hasTangents())
-                tanit++;
-
-            if (hasColors())
-                cit++;
-        }
-    }
-
-    //create an edge list, if necessary
-    if (needsEdges || needsTrianglesWithAdj) {
-        std::multimap<Edge, GLuint> edges;
-
-
-        //edges are only based on positions only
-        for (int ii = 0; ii < (int)_pIndex.size(); ii += 3) {
-            for (int jj = 0; jj < 3; jj++) {
-                Edge w( _pIndex[ii + jj], _pIndex[ii + (jj +1) % 3]);
-                std::multimap<Edge, GLuint>::iterator it = edges.find(w);
-
-                //if we are storing edges, make sure we store only one copy
-                if (needsEdges && it == edges.end()) {
-                    _indices[1].push_back( _indices[2][ii+jj]);
-                    _indices[1].push_back( _indices[2][ii + (jj +1) % 3]);
-                }
-                edges.insert( std::multimap<Edge, GLuint>::value_type( w, ii / 3));
-            }
-        }
-
-
-        //now handle triangles with adjacency
-        if (needsTrianglesWithAdj) {
-            for (int ii = 0; ii < (int)_pIndex.size(); ii += 3) {
-                for (int jj = 0; jj < 3; jj++) {
-                    Edge w( _pIndex[ii + jj], _pIndex[ii + (jj + 1) % 3]);
-                    std::multimap<Edge, GLuint>::iterator it = edges.lower_bound(w);
-                    std::multimap<Edge, GLuint>::iterator limit = edges.upper_bound(w);
-                    GLuint adjVertex = 0;
-
-                    while ( it != edges.end() && it->second == ii /3 && it != limit)
-                        it++;
-
-                    if ( it == edges.end() || it == limit || it->first.pIndex[0] != w.pIndex[0] || it->first.pIndex[1] != w.pIndex[1] ) {
-                        //no adjacent triangle found, duplicate the vertex
-                        adjVertex = _indices[2][ii + jj];
-                        _openEdges++;
-                        
-                    }
-                    else {
-                        GLuint triOffset = it->second * 3; //compute the starting index of the triangle
-                        adjVertex = _indices[2][triOffset]; //set the vertex to a default, in case the adjacent triangle it a degenerate
-
-                        //find the unshared vertex
-                        for ( int kk=0; kk<3; kk++) {
-                            if ( _pIndex[triOffset + kk] != w.pIndex[0] && _pIndex[triOffset + kk] != w.pIndex[1] ) {
-                                adjVertex = _indices[2][triOffset + kk];
-                                break;
-                            }
-                        }
-                    }
-
-                    //store the vertices for this edge
-                    _indices[3].push_back( _indices[2][ii + jj]);
-                    _indices[3].push_back( adjVertex);
-                }
-            }
-        }
-
-    }
-
-    //create selected prim
 
     //set the offsets and vertex size
     _pOffset = 0; //always first
@@ -387,9 +508,219 @@ void Model::compileModel( Model::PrimType prim) {
         _cOffset = -1;
     }
 
+    //merge the points, one compiled vertex per unique index set
+    {
+        int cornerCount = (int)_pIndex.size();
+        IdxTable pts( cornerCount);
+
+        bool normals = hasNormals();
+        bool texCoords = hasTexCoords();
+        bool tangents = hasTangents();
+        bool colors = hasColors();
+
+        //worst case every corner is a new vertex, trimmed below
+        size_t vtxBase = _vertices.size();
+        _vertices.resize( vtxBase + (size_t)cornerCount * _vtxSize);
+        float *vtx = cornerCount ? &_vertices[vtxBase] : NULL;
+
+        size_t idxBase = _indices[2].size();
+        if (needsTriangles)
+            _indices[2].resize( idxBase + cornerCount);
+
+        for (int ii = 0; ii < cornerCount; ii++) {
+            IdxSet idx;
+            idx.pIndex = _pIndex[ii];
+            idx.nIndex = normals ? _nIndex[ii] : 0;
+            idx.tIndex = texCoords ? _tIndex[ii] : 0;
+            idx.tanIndex = tangents ? _tanIndex[ii] : 0;
+            idx.cIndex = colors ? _cIndex[ii] : 0;
+
+            bool added;
+            GLuint vertex = pts.insert( idx, added);
+
+            if (needsTriangles)
+                _indices[2][idxBase + ii] = vertex;
+
+            if (!added)
+                continue;
+
+            //position
+            const float *src = &_positions[idx.pIndex*_posSize];
+            for (int jj = 0; jj < _posSize; jj++)
+                *vtx++ = src[jj];
+
+            //normal
+            if (normals) {
+                src = &_normals[idx.nIndex*3];
+                *vtx++ = src[0];
+                *vtx++ = src[1];
+                *vtx++ = src[2];
+            }
+
+            //texture coordinate
+            if (texCoords) {
+                src = &_texCoords[idx.tIndex*_tcSize];
+                for (int jj = 0; jj < _tcSize; jj++)
+                    *vtx++ = src[jj];
+            }
+
+            //tangents
+            if (tangents) {
+                src = &_sTangents[idx.tanIndex*3];
+                *vtx++ = src[0];
+                *vtx++ = src[1];
+                *vtx++ = src[2];
+            }
+
+            //colors
+            if (colors) {
+                src = &_colors[idx.cIndex*_cSize];
+                for (int jj = 0; jj < _cSize; jj++)
+                    *vtx++ = src[jj];
+            }
+        }
+
+        _vertices.resize( vtxBase + (size_t)pts.size() * _vtxSize);
+    }
+
+    //create an edge list, if necessary
+    if (needsEdges || needsTrianglesWithAdj)
+        buildEdges( needsEdges, needsTrianglesWithAdj);
+
     
 }
 
+//
+// buildEdges
+//
+//    Creates the unique edge list and the triangles with
+//  adjacency from the compiled triangles. Every triangle corner
+//  starts an edge, the edges are sorted by their packed position
+//  key, and corners with equal keys are the triangles sharing
+//  the edge. The lists come out in the corner order, identical
+//  to matching the corners one by one against all earlier edges.
+//
+//////////////////////////////////////////////////////////////////////
+void Model::buildEdges( bool needsEdges, bool needsTrianglesWithAdj) {
+    size_t cornerCount = _pIndex.size();
+    if (cornerCount == 0)
+        return;
+
+    int workers = cornerWorkers( cornerCount);
+    const GLuint *pIndex = &_pIndex[0];
+    const GLuint *vIndex = &_indices[2][0];
+
+    //packed key of the edge from every corner to the next one, lower position first
+    int posBits = 1;
+    while ((1ull << posBits) < (unsigned long long)getPositionCount())
+        posBits++;
+
+    vector<unsigned long long> keys( cornerCount);
+    vector<GLuint> corners( cornerCount);
+
+    runWorkers( workers, cornerCount, [&]( int, size_t begin, size_t end) {
+        for (size_t ii = begin; ii < end; ii++) {
+            GLuint a = pIndex[ii];
+            GLuint b = pIndex[ii - ii % 3 + (ii + 1) % 3];
+            keys[ii] = ((unsigned long long)std::min( a, b) << posBits) | std::max( a, b);
+            corners[ii] = (GLuint)ii;
+        }
+    });
+
+    sortEdges( keys, corners, 2 * posBits, workers);
+
+    //split the sorted edges over the workers at boundaries between keys
+    vector<size_t> bounds( workers + 1, cornerCount);
+    bounds[0] = 0;
+    for (int ii = 1; ii < workers; ii++) {
+        size_t start = std::max( bounds[ii - 1], cornerCount * ii / workers);
+        while (start > 0 && start < cornerCount && keys[start] == keys[start - 1])
+            start++;
+        bounds[ii] = start;
+    }
+
+    //for every corner the first corner of its edge, and the first one of another triangle
+    const GLuint none = ~0u;
+    vector<GLuint> first( needsEdges ? cornerCount : 0);
+    vector<GLuint> neighbor( needsTrianglesWithAdj ? cornerCount : 0);
+
+    runWorkers( workers, cornerCount, [&]( int worker, size_t, size_t) {
+        size_t begin = bounds[worker];
+        size_t end = bounds[worker + 1];
+        for (size_t group = begin; group < end; ) {
+            size_t groupEnd = group + 1;
+            while (groupEnd < end && keys[groupEnd] == keys[group])
+                groupEnd++;
+
+            //the sort is stable, so the group is in corner order
+            GLuint head = corners[group];
+            GLuint other = none;
+            for (size_t ii = group + 1; ii < groupEnd && other == none; ii++)
+                if (corners[ii] / 3 != head / 3)
+                    other = corners[ii];
+
+            for (size_t ii = group; ii < groupEnd; ii++) {
+                GLuint corner = corners[ii];
+                if (needsEdges)
+                    first[corner] = head;
+                if (needsTrianglesWithAdj)
+                    neighbor[corner] = (corner / 3 != head / 3) ? head : other;
+            }
+            group = groupEnd;
+        }
+    });
+
+    //store only one copy of every edge
+    if (needsEdges) {
+        for (size_t ii = 0; ii < cornerCount; ii++) {
+            if (first[ii] == ii) {
+                _indices[1].push_back( vIndex[ii]);
+                _indices[1].push_back( vIndex[ii - ii % 3 + (ii + 1) % 3]);
+            }
+        }
+    }
+
+    //now handle triangles with adjacency
+    if (needsTrianglesWithAdj) {
+        size_t adjBase = _indices[3].size();
+        _indices[3].resize( adjBase + 2 * cornerCount);
+        GLuint *adj = &_indices[3][adjBase];
+        vector<int> openEdges( workers, 0);
+
+        runWorkers( workers, cornerCount, [&]( int worker, size_t begin, size_t end) {
+            for (size_t ii = begin; ii < end; ii++) {
+                GLuint adjVertex = vIndex[ii];
+
+                if (neighbor[ii] == none) {
+                    //no adjacent triangle found, duplicate the vertex
+                    openEdges[worker]++;
+                }
+                else {
+                    GLuint a = pIndex[ii];
+                    GLuint b = pIndex[ii - ii % 3 + (ii + 1) % 3];
+                    GLuint triOffset = neighbor[ii] - neighbor[ii] % 3; //compute the starting index of the triangle
+                    adjVertex = vIndex[triOffset]; //set the vertex to a default, in case the adjacent triangle it a degenerate
+
+                    //find the unshared vertex
+                    for (int kk = 0; kk < 3; kk++) {
+                        if (pIndex[triOffset + kk] != a && pIndex[triOffset + kk] != b) {
+                            adjVertex = vIndex[triOffset + kk];
+                            break;
+                        }
+                    }
+                }
+
+                //store the vertices for this edge
+                adj[2 * ii] = vIndex[ii];
+                adj[2 * ii + 1] = adjVertex;
+            }
+        });
+
+        for (int ii = 0; ii < workers; ii++)
+            _openEdges += openEdges[ii];
+    }
+}
+
 //
 // compute tangents in the S direction
 //
@@ -405,107 +736,43 @@ void Model::computeTangents() {
         return;
 
     //alloc memory and initialize to 0
-    _tanIndex.reserve( _pIndex.size());
     _sTangents.resize( (_texCoords.size() / _tcSize) * 3, 0.0f);
 
-    // the collision map records any alternate locations for the tangents
-    std::multimap< GLuint, GLuint> collisionMap;
-
-    //process each face, compute the tangent and try to add it
-    for (int ii = 0; ii < (int)_pIndex.size(); ii += 3) {
-        vec3f p0(&_positions[_pIndex[ii]*_posSize]);
-        vec3f p1(&_positions[_pIndex[ii+1]*_posSize]);
-        vec3f p2(&_positions[_pIndex[ii+2]*_posSize]);
-        vec2f st0(&_texCoords[_tIndex[ii]*_tcSize]);
-        vec2f st1(&_texCoords[_tIndex[ii+1]*_tcSize]);
-        vec2f st2(&_texCoords[_tIndex[ii+2]*_tcSize]);
-
-        //compute the edge and tc differentials
-        vec3f dp0 = p1 - p0;
-        vec3f dp1 = p2 - p0;
-        vec2f dst0 = st1 - st0;
-        vec2f dst1 = st2 - st0;
-
-        float factor = 1.0f / (dst0[0] * dst1[1] - dst1[0] * dst0[1]);
-
-        //compute sTangent
-        vec3f sTan;
-        sTan[0] = dp0[0] * dst1[1] - dp1[0] * dst0[1];
-        sTan[1] = dp0[1] * dst1[1] - dp1[1] * dst0[1];
-        sTan[2] = dp0[2] * dst1[1] - dp1[2] * dst0[1];
-        sTan *= factor;
-
-        //should this really renormalize?
-        sTan =normalize( sTan);
-
-        //loop over the vertices, to update the tangents
-        for (int jj = 0; jj < 3; jj++) {
-            //get the present accumulated tangnet
-            vec3f curTan(&_sTangents[_tIndex[ii + jj]*3]);
-
-            //check to see if it is uninitialized, if so, insert it
-            if (curTan[0] == 0.0f && curTan[1] == 0.0f && curTan[2] == 0.0f) {
-                _sTangents[_tIndex[ii + jj]*3] = sTan[0];
-                _sTangents[_tIndex[ii + jj]*3+1] = sTan[1];
-                _sTangents[_tIndex[ii + jj]*3+2] = sTan[2];
-                _tanIndex.push_back(_tIndex[ii + jj]);
-            }
-            else {
-                //check for agreement
-                curTan = normalize( curTan);
-
-                if ( dot( curTan, sTan) >= cosf( 3.1415926f * 0.333333f)) {
-                    //tangents are in agreement
-                    _sTangents[_tIndex[ii + jj]*3] += sTan[0];
-                    _sTangents[_tIndex[ii + jj]*3+1] += sTan[1];
-                    _sTangents[_tIndex[ii + jj]*3+2] += sTan[2];
-                    _tanIndex.push_back(_tIndex[ii + jj]);
-                }
-                else {
-                    //tangents disagree, this vertex must be split in tangent space 
-                    std::multimap< GLuint, GLuint>::iterator it = collisionMap.find( _tIndex[ii + jj]);
-
-                    //loop through all hits on this index, until one agrees
-                    while ( it != collisionMap.end() && it->first == _tIndex[ii + jj]) {
-                        curTan = vec3f( &_sTangents[it->second*3]);
-
-                        curTan = normalize(curTan);
-                        if ( dot( curTan, sTan) >= cosf( 3.1415926f * 0.333333f))
-                            break;
-
-                        it++;
-                    }
+    //compute the tangent of each face
+    size_t faceCount = _pIndex.size() / 3;
+    vector<vec3f> faceTangents( faceCount);
+
+    runWorkers( cornerWorkers( _pIndex.size()), faceCount, [&]( int, size_t begin, size_t end) {
+        for (size_t ii = begin * 3; ii < end * 3; ii += 3) {
+            vec3f p0(&_positions[_pIndex[ii]*_posSize]);
+            vec3f p1(&_positions[_pIndex[ii+1]*_posSize]);
+            vec3f p2(&_positions[_pIndex[ii+2]*_posSize]);
+            vec2f st0(&_texCoords[_tIndex[ii]*_tcSize]);
+            vec2f st1(&_texCoords[_tIndex[ii+1]*_tcSize]);
+            vec2f st2(&_texCoords[_tIndex[ii+2]*_tcSize]);
+
+            //compute the edge and tc differentials
+            vec3f dp0 = p1 - p0;
+            vec3f dp1 = p2 - p0;
+            vec2f dst0 = st1 - st0;
+            vec2f dst1 = st2 - st0;
+
+            float factor = 1.0f / (dst0[0] * dst1[1] - dst1[0] * dst0[1]);
+
+            //compute sTangent
+            vec3f sTan;
+            sTan[0] = dp0[0] * dst1[1] - dp1[0] * dst0[1];
+            sTan[1] = dp0[1] * dst1[1] - dp1[1] * dst0[1];
+            sTan[2] = dp0[2] * dst1[1] - dp1[2] * dst0[1];
+            sTan *= factor;
+
+            //should this really renormalize?
+            faceTangents[ii / 3] = normalize( sTan);
+        }
+    });
 
-                    //check for agreement with an earlier collision
-                    if ( it != collisionMap.end() && it->first == _tIndex[ii + jj]) {
-                        //found agreement with an earlier collision, use that one
-                        _sTangents[it->second*3] += sTan[0];
-                        _sTangents[it->second*3+1] += sTan[1];
-                        _sTangents[it->second*3+2] += sTan[2];
-                        _tanIndex.push_back(it->second);
-                    }
-                    else {
-                        //we have a new collision, create a new tangent
-                        GLuint target = (GLuint)_sTangents.size() / 3;
-                        _sTangents.push_back( sTan[0]);
-                        _sTangents.push_back( sTan[1]);
-                        _sTangents.push_back( sTan[2]);
-                        _tanIndex.push_back( target);
-                        collisionMap.insert( std::multimap< GLuint, GLuint>::value_type( _tIndex[ii + jj], target));
-                    }
-                } // else ( if tangent agrees)
-            } // else ( if tangent is uninitialized )
-        } // for jj = 0 to 2 ( iteration of triangle verts)
-    } // for ii = 0 to numFaces *3 ( iterations over triangle faces
-
-    //normalize all the tangents
-    for (int ii = 0; ii < (int)_sTangents.size(); ii += 3) {
-        vec3f tan(&_sTangents[ii]);
-        tan = normalize(tan);
-        _sTangents[ii] = tan[0];
-        _sTangents[ii+1] = tan[1];
-        _sTangents[ii+2] = tan[2];
-    }
+    //sum the tangents per texcoord, splitting the vertices where they disagree
+    smoothCorners( _tIndex, faceTangents, faceTangents, _sTangents, _tanIndex);
 }
 //
 //compute vertex normals
@@ -518,93 +785,29 @@ void Model::computeNormals() {
 
     //allocate and initialize the normal values
     _normals.resize( (_positions.size() / _posSize) * 3, 0.0f);
-    _nIndex.reserve( _pIndex.size());
-
-    // the collision map records any alternate locations for the normals
-    std::multimap< GLuint, GLuint> collisionMap;
-
-    //iterate over the faces, computing the face normal and summing it them
-    for ( int ii = 0; ii < (int)_pIndex.size(); ii += 3) {
-        vec3f p0(&_positions[_pIndex[ii]*_posSize]);
-        vec3f p1(&_positions[_pIndex[ii+1]*_posSize]);
-        vec3f p2(&_positions[_pIndex[ii+2]*_posSize]);
-
-        //compute the edge vectors
-        vec3f dp0 = p1 - p0;
-        vec3f dp1 = p2 - p0;
-
-        vec3f fNormal = cross( dp0, dp1); // compute the face normal
-        vec3f nNormal = normalize(fNormal);  // compute a normalized normal
-
-        //iterate over the vertices, adding the face normal influence to each
-        for ( int jj = 0; jj < 3; jj++) {
-            // get the current normal from the default location (index shared with position) 
-            vec3f cNormal( &_normals[_pIndex[ii + jj]*3]);
-
-            // check to see if this normal has not yet been touched 
-            if ( cNormal[0] == 0.0f && cNormal[1] == 0.0f && cNormal[2] == 0.0f) {
-                // first instance of this index, just store it as is
-                _normals[_pIndex[ii + jj]*3] = fNormal[0];
-                _normals[_pIndex[ii + jj]*3 + 1] = fNormal[1];
-                _normals[_pIndex[ii + jj]*3 + 2] = fNormal[2];
-                _nIndex.push_back( _pIndex[ii + jj]); 
-            }
-            else {
-                // check for agreement
-                cNormal = normalize( cNormal);
-
-                if ( dot( cNormal, nNormal) >= cosf( 3.1415926f * 0.333333f)) {
-                    //normal agrees, so add it
-                    _normals[_pIndex[ii + jj]*3] += fNormal[0];
-                    _normals[_pIndex[ii + jj]*3 + 1] += fNormal[1];
-                    _normals[_pIndex[ii + jj]*3 + 2] += fNormal[2];
-                    _nIndex.push_back( _pIndex[ii + jj]);
-                }
-                else {
-                    //normals disagree, this vertex must be along a facet edge 
-                    std::multimap< GLuint, GLuint>::iterator it = collisionMap.find( _pIndex[ii + jj]);
-
-                    //loop through all hits on this index, until one agrees
-                    while ( it != collisionMap.end() && it->first == _pIndex[ii + jj]) {
-                        cNormal = normalize(vec3f( &_normals[it->second*3]));
 
-                        if ( dot( cNormal, nNormal) >= cosf( 3.1415926f * 0.333333f))
-                            break;
+    //compute the face normal of each face, and its normalized direction
+    size_t faceCount = _pIndex.size() / 3;
+    vector<vec3f> fNormals( faceCount);
+    vector<vec3f> nNormals( faceCount);
 
-                        it++;
-                    }
+    runWorkers( cornerWorkers( _pIndex.size()), faceCount, [&]( int, size_t begin, size_t end) {
+        for (size_t ii = begin * 3; ii < end * 3; ii += 3) {
+            vec3f p0(&_positions[_pIndex[ii]*_posSize]);
+            vec3f p1(&_positions[_pIndex[ii+1]*_posSize]);
+            vec3f p2(&_positions[_pIndex[ii+2]*_posSize]);
 
-                    //check for agreement with an earlier collision
-                    if ( it != collisionMap.end() && it->first == _pIndex[ii + jj]) {
-                        //found agreement with an earlier collision, use that one
-                        _normals[it->second*3] += fNormal[0];
-                        _normals[it->second*3+1] += fNormal[1];
-                        _normals[it->second*3+2] += fNormal[2];
-                        _nIndex.push_back(it->second);
-                    }
-                    else {
-                        //we have a new collision, create a new normal
-                        GLuint target = (GLuint)_normals.size() / 3;
-                        _normals.push_back( fNormal[0]);
-                        _normals.push_back( fNormal[1]);
-                        _normals.push_back( fNormal[2]);
-                        _nIndex.push_back( target);
-                        collisionMap.insert( std::multimap< GLuint, GLuint>::value_type( _pIndex[ii + jj], target));
-                    }
-                } // else ( if normal agrees)
-            } // else (if normal is uninitialized)
-        } // for each vertex in triangle
-    } // for each face
+            //compute the edge vectors
+            vec3f dp0 = p1 - p0;
+            vec3f dp1 = p2 - p0;
 
-    //now normalize all the normals
-    for ( int ii = 0; ii < (int)_normals.size(); ii += 3) {
-        vec3f norm(&_normals[ii]);
-        norm =normalize(norm);
-        _normals[ii] = norm[0];
-        _normals[ii+1] = norm[1];
-        _normals[ii+2] = norm[2];
-    }
+            fNormals[ii / 3] = cross( dp0, dp1); // compute the face normal
+            nNormals[ii / 3] = normalize( fNormals[ii / 3]);  // compute a normalized normal
+        }
+    });
 
+    //sum the face normals per position, splitting the vertices along facet edges
+    smoothCorners( _pIndex, fNormals, nNormals, _normals, _nIndex);
 }
 
 //
@@ -612,8 +815,21 @@ void Model::computeNormals() {
 //////////////////////////////////////////////////////////////////////
 void Model::computeBoundingBox( vec3f &minVal, vec3f &maxVal) {
 
-    if ( _positions.empty())
+    if ( _positions.empty()) {
+        //models loaded from a compiled file only have the compiled positions
+        const float *vtx = getCompiledVertices();
+        int count = getCompiledVertexCount();
+        if (!vtx || count == 0)
+            return;
+
+        minVal = vec3f( 1e10f, 1e10f, 1e10f);
+        maxVal = -minVal;
+        for (int ii = 0; ii < count; ii++, vtx += _vtxSize) {
+            minVal = min( minVal, vec3f( vtx + _pOffset));
+            maxVal = max( maxVal, vec3f( vtx + _pOffset));
+        }
         return;
+    }
 
     minVal = vec3f( 1e10f, 1e10f, 1e10f);
     maxVal = -minVal;
@@ -19,6 +19,7 @@
 #define NVSDKENTRY
 
 #include <vector>
+#include <memory>
 #include <assert.h>
 
 #include <GL/glew.h>
@@ -26,6 +27,8 @@
 
 namespace nv {
 
+    class FileView;
+
     class Model {
     public:
 
@@ -44,6 +47,65 @@ namespace nv {
 
         static const int NumPrimTypes = 4;
 
+        //
+        // Compressed vertex layouts, combined as flags
+        //
+        //////////////////////////////////////////////////////////////
+        enum VertexFormat {
+            evfFloat = 0x0,         // everything as 32 bit floats
+            evfPosition16 = 0x1,    // positions as 16 bit integers in the bounding box
+            evfNormalOct = 0x2,     // normals as 2 x 16 bit normalized octahedral coordinates
+            evfTexCoordHalf = 0x4,  // texture coordinates as half floats
+            evfTangentOct = 0x8,    // tangents as 2 x 16 bit normalized octahedral coordinates
+            evfColor8 = 0x10,       // colors as 4 x 8 bit normalized
+            evfCompact = 0x1f
+        };
+
+        //
+        // Enumeration of vertex attributes
+        //
+        //////////////////////////////////////////////////////////////
+        enum Attrib {
+            eaPosition = 0,
+            eaNormal,
+            eaTexCoord,
+            eaTangent,
+            eaColor
+        };
+
+        static const int NumAttribs = 5;
+
+        //
+        // Layout of one attribute of the packed vertices, as passed
+        // to glVertexAttribPointer. The size is 0 if it is absent.
+        //
+        //////////////////////////////////////////////////////////////
+        struct VertexAttrib {
+            GLint size;
+            GLenum type;
+            GLboolean normalized;
+            GLsizei offset; // in bytes
+        };
+
+        //
+        // A cluster of compiled triangles, see buildClusters. The
+        // cluster faces away from a viewer at eye if
+        // dot( normalize( coneApex - eye), coneAxis) >= coneCutoff,
+        // and from a directional view along dir if
+        // dot( dir, coneAxis) >= coneCutoff.
+        //
+        //////////////////////////////////////////////////////////////
+        struct Cluster {
+            GLuint firstIndex;  // in the compiled triangle list
+            GLuint indexCount;
+            GLuint vertexCount; // distinct compiled vertices
+            vec3f center;       // bounding sphere
+            float radius;
+            vec3f coneApex;
+            vec3f coneAxis;
+            float coneCutoff;   // sine of the cone angle, 1 if it never faces away
+        };
+
     NVSDKENTRY static Model* CreateModel();
 
         NVSDKENTRY Model();
@@ -117,6 +179,100 @@ namespace nv {
 
         NVSDKENTRY void removeDegeneratePrims();
 
+        //
+        //  simplify
+        //
+        //    This function decimates the raw data with quadric
+        //  error edge collapses until ratio * triangles remain.
+        //  It is meant for building lower levels of detail, and
+        //  returns the triangle count reached.
+        //
+        //////////////////////////////////////////////////////////////
+        NVSDKENTRY int simplify( float ratio);
+
+        //
+        //  optimizeCompiledModel
+        //
+        //    This function reorders the compiled triangles for the
+        //  post-transform vertex cache, optionally sorts clusters of
+        //  them outside in to reduce overdraw, and renumbers the
+        //  compiled vertices in the order they are fetched. All
+        //  compiled index lists are updated, so it should be done
+        //  after compiling the model.
+        //
+        //////////////////////////////////////////////////////////////
+        NVSDKENTRY void optimizeCompiledModel( int cacheSize = 32, bool sortClusters = false);
+
+        //
+        //  buildClusters
+        //
+        //    This function partitions the compiled triangles into
+        //  clusters of up to maxVertices vertices and maxTriangles
+        //  triangles, grown over shared vertices and nearby pieces
+        //  with similar normals, so that parts of a mesh can be
+        //  culled on their own. The triangles of every cluster are
+        //  made contiguous and ordered for a vertex cache of
+        //  cacheSize entries. It should be done after optimizing
+        //  the compiled model, which drops the clusters.
+        //
+        //////////////////////////////////////////////////////////////
+        NVSDKENTRY void buildClusters( int maxVertices = 64, int maxTriangles = 124, int cacheSize = 32);
+
+        //
+        //  packCompiledModel
+        //
+        //    This function converts the compiled vertices to the
+        //  layout selected by the VertexFormat flags, for uploading
+        //  in place of the compiled vertices. Quantized positions
+        //  are restored by position * scale + bias with the values
+        //  from getPackedPositionTransform, octahedral vectors by
+        //  the usual octahedral decoding. The compiled vertices and
+        //  indices are left unchanged.
+        //
+        //////////////////////////////////////////////////////////////
+        NVSDKENTRY void packCompiledModel( int format = evfCompact);
+
+        //
+        //  packDepthStream
+        //
+        //    This function builds a position only copy of the packed
+        //  triangles for depth only passes. Vertices are merged by
+        //  their packed position alone, so the seams of normals and
+        //  texture coordinates disappear. It uses the position layout
+        //  of packCompiledModel, or floats if the model is not packed.
+        //  The triangles are those of the compiled index list,
+        //  reordered for a vertex cache of cacheSize entries.
+        //
+        //////////////////////////////////////////////////////////////
+        NVSDKENTRY void packDepthStream( int cacheSize = 32);
+
+        //
+        //  saveCompiledModel / loadCompiledModel
+        //
+        //    These functions store the compiled model in a versioned
+        //  binary file tagged with a key, typically a hash of the
+        //  source file and of the compile settings. Loading maps the
+        //  file, and the compiled data access functions return
+        //  pointers into the mapping, so they can be handed to
+        //  glBufferData without a copy. Loading fails if the file is
+        //  missing, of another version, or stored with another key.
+        //  A loaded model has no raw data.
+        //
+        //////////////////////////////////////////////////////////////
+        NVSDKENTRY bool saveCompiledModel( const char *file, unsigned long long key) const;
+        NVSDKENTRY bool loadCompiledModel( const char *file, unsigned long long key);
+
+        //
+        //  hashData / hashFile
+        //
+        //    64 bit FNV-1a hash of a block of memory, or of the
+        //  contents of a file (0 if it can not be read), for building
+        //  the keys of compiled model files.
+        //
+        //////////////////////////////////////////////////////////////
+        NVSDKENTRY static unsigned long long hashData( const void *data, size_t size, unsigned long long seed = 14695981039346656037ull);
+        NVSDKENTRY static unsigned long long hashFile( const char *file);
+
         //
         //general query functions
         //
@@ -183,6 +339,45 @@ namespace nv {
 
         NVSDKENTRY int getOpenEdgeCount() const;
 
+        // vertices transformed per compiled triangle (ACMR) and per compiled
+        // vertex (ATVR) with a FIFO post-transform cache of cacheSize entries
+        NVSDKENTRY float getCompiledACMR( int cacheSize = 32) const;
+        NVSDKENTRY float getCompiledATVR( int cacheSize = 32) const;
+
+        //
+        //cluster access functions, valid after buildClusters
+        //
+        NVSDKENTRY const Cluster* getClusters() const;
+        NVSDKENTRY int getClusterCount() const;
+
+        // tests the normal cone of a cluster against a viewer at the position view,
+        // or with directional set against a view along the direction view
+        NVSDKENTRY bool isClusterBackfacing( int cluster, const vec3f &view, bool directional = false) const;
+
+        //
+        //packed data access functions, valid after packCompiledModel
+        //
+        NVSDKENTRY const void* getPackedVertices() const;
+
+        // returns the size of the packed vertex in bytes
+        NVSDKENTRY int getPackedVertexSize() const;
+
+        NVSDKENTRY const VertexAttrib& getPackedAttrib( Attrib attrib) const;
+        NVSDKENTRY void getPackedPositionTransform( vec3f &scale, vec3f &bias) const;
+
+        //
+        //depth stream access functions, valid after packDepthStream. The
+        //position has the size and type of the packed one, at offset 0
+        //
+        NVSDKENTRY const void* getDepthVertices() const;
+        NVSDKENTRY const GLuint* getDepthIndices() const;
+
+        // returns the size of the depth vertex in bytes
+        NVSDKENTRY int getDepthVertexSize() const;
+
+        NVSDKENTRY int getDepthVertexCount() const;
+        NVSDKENTRY int getDepthIndexCount() const;
+
     protected:
 
         //Would all this be better done as a channel abstraction to handle more arbitrary data?
@@ -215,6 +410,41 @@ namespace nv {
 
         int _openEdges;
 
+        //packed vertices, see packCompiledModel
+        std::vector<unsigned char> _packed;
+        VertexAttrib _packedAttribs[NumAttribs];
+        int _packedSize;
+        vec3f _packedScale;
+        vec3f _packedBias;
+
+        //position only vertices, see packDepthStream
+        std::vector<unsigned char> _depthVertices;
+        std::vector<GLuint> _depthIndices;
+        int _depthSize;
+
+        //triangle clusters, see buildClusters
+        std::vector<Cluster> _clusters;
+
+        //compiled data mapped from a file by loadCompiledModel, used instead of _vertices and _indices
+        std::shared_ptr<FileView> _cacheFile;
+        const float *_cacheVertices;
+        int _cacheVertexCount;
+        const GLuint *_cacheIndices[NumPrimTypes];
+        int _cacheIndexCount[NumPrimTypes];
+        const Cluster *_cacheClusters;
+        int _cacheClusterCount;
+
+        void releaseCompiledCache();
+
+        //triangle order for the post-transform vertex cache, see optimizeCompiledModel
+        static void cacheOrder( const GLuint *indices, int triCount, int vertexCount, int cacheSize, std::vector<GLuint> &order);
+
+        //puts the compiled triangles in the given order and renumbers the vertices in the order they are fetched
+        void reorderTriangles( const std::vector<GLuint> &order);
+
+        //edge and adjacency lists of the compiled triangles, used by compileModel
+        void buildEdges( bool needsEdges, bool needsTrianglesWithAdj);
+
         //
         // Static elements used to dispatch to proper sub-readers
         //
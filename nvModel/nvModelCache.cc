@@ -0,0 +1,241 @@
+//
+// nvModelCache.cc - Model support class
+//
+// The nvModel class implements an interface for a multipurpose model
+// object. This class is useful for loading and formatting meshes
+// for use by OpenGL. It can compute face normals, tangents, and
+// adjacency information. The class supports the obj file format.
+//
+// This file implements the compiled model files. They hold a header
+// with the vertex layout followed by the compiled vertices, the
+// index lists and the clusters, so a loaded file is used in place
+// from its mapping.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+
+#ifdef WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "nvModel.h"
+#include "nvFileView.h"
+
+//must change whenever the header or the compiled data layout change
+#define COMPILED_MODEL_VERSION 2
+
+namespace nv {
+
+//
+// Compiled model file header, the vertices, the index lists
+// of all primitive types and the clusters follow in this order
+//
+////////////////////////////////////////////////////////////
+struct CompiledModelHeader {
+    char magic[4];
+    unsigned int version;
+    unsigned long long key;
+
+    int posSize;
+    int pOffset;
+    int nOffset;
+    int tcOffset;
+    int sTanOffset;
+    int cOffset;
+    int vtxSize;
+    int openEdges;
+
+    unsigned int vertexCount;
+    unsigned int indexCount[Model::NumPrimTypes];
+    unsigned int clusterCount;
+};
+
+static const char COMPILED_MODEL_MAGIC[4] = { 'N', 'V', 'C', 'M' };
+
+//
+//
+////////////////////////////////////////////////////////////
+void Model::releaseCompiledCache() {
+    _cacheFile.reset();
+    _cacheVertices = 0;
+    _cacheVertexCount = 0;
+    for (int ii = 0; ii < NumPrimTypes; ii++) {
+        _cacheIndices[ii] = 0;
+        _cacheIndexCount[ii] = 0;
+    }
+    _cacheClusters = 0;
+    _cacheClusterCount = 0;
+}
+
+//
+// saveCompiledModel
+//
+//    Writes to a temporary file that is renamed when complete,
+//  so concurrent loaders never map a partial file.
+//
+////////////////////////////////////////////////////////////
+bool Model::saveCompiledModel( const char *file, unsigned long long key) const {
+    if (getCompiledVertexCount() == 0)
+        return false;
+
+    CompiledModelHeader header;
+    memset( &header, 0, sizeof(header));
+    memcpy( header.magic, COMPILED_MODEL_MAGIC, sizeof(header.magic));
+    header.version = COMPILED_MODEL_VERSION;
+    header.key = key;
+    header.posSize = _posSize;
+    header.pOffset = _pOffset;
+    header.nOffset = _nOffset;
+    header.tcOffset = _tcOffset;
+    header.sTanOffset = _sTanOffset;
+    header.cOffset = _cOffset;
+    header.vtxSize = _vtxSize;
+    header.openEdges = _openEdges;
+    header.vertexCount = getCompiledVertexCount();
+    header.clusterCount = getClusterCount();
+
+    const PrimType prims[NumPrimTypes] = { eptPoints, eptEdges, eptTriangles, eptTrianglesWithAdjacency };
+    for (int ii = 0; ii < NumPrimTypes; ii++)
+        header.indexCount[ii] = getCompiledIndexCount( prims[ii]);
+
+    //the temp name is unique to the process and the call, so concurrent writers of one entry don't share it
+    static std::atomic<unsigned int> saves( 0);
+    char suffix[64];
+    sprintf( suffix, ".%d.%u.tmp", (int)getpid(), saves++);
+    std::string temp = std::string( file) + suffix;
+    FILE *fp = fopen( temp.c_str(), "wb");
+    if (!fp)
+        return false;
+
+    bool ok = fwrite( &header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite( getCompiledVertices(), sizeof(float) * _vtxSize, header.vertexCount, fp) == header.vertexCount;
+    for (int ii = 0; ii < NumPrimTypes && ok; ii++) {
+        if (header.indexCount[ii])
+            ok = fwrite( getCompiledIndices( prims[ii]), sizeof(GLuint), header.indexCount[ii], fp) == header.indexCount[ii];
+    }
+    if (header.clusterCount && ok)
+        ok = fwrite( getClusters(), sizeof(Cluster), header.clusterCount, fp) == header.clusterCount;
+    ok = (fclose( fp) == 0) && ok;
+
+    //rename replaces the file atomically on POSIX, windows refuses to rename onto an existing file
+    if (ok) {
+#ifdef WIN32
+        remove( file);
+#endif
+        ok = rename( temp.c_str(), file) == 0;
+    }
+    if (!ok)
+        remove( temp.c_str());
+
+    return ok;
+}
+
+//
+// loadCompiledModel
+//
+////////////////////////////////////////////////////////////
+bool Model::loadCompiledModel( const char *file, unsigned long long key) {
+    std::shared_ptr<FileView> view( new FileView);
+    if (!view->open( file) || view->size() < sizeof(CompiledModelHeader))
+        return false;
+
+    CompiledModelHeader header;
+    memcpy( &header, view->begin(), sizeof(header));
+
+    if (memcmp( header.magic, COMPILED_MODEL_MAGIC, sizeof(header.magic)) || header.version != COMPILED_MODEL_VERSION || header.key != key)
+        return false;
+
+    if (header.vtxSize <= 0 || header.posSize < 3 || header.pOffset < 0 || header.pOffset + header.posSize > header.vtxSize)
+        return false;
+
+    //the data must fill the file exactly
+    size_t size = sizeof(header) + (size_t)header.vertexCount * header.vtxSize * sizeof(float);
+    for (int ii = 0; ii < NumPrimTypes; ii++)
+        size += (size_t)header.indexCount[ii] * sizeof(GLuint);
+    size += (size_t)header.clusterCount * sizeof(Cluster);
+    if (size != view->size())
+        return false;
+
+    //the raw data does not match the compiled data anymore
+    _positions.clear();
+    _normals.clear();
+    _texCoords.clear();
+    _sTangents.clear();
+    _colors.clear();
+    _pIndex.clear();
+    _nIndex.clear();
+    _tIndex.clear();
+    _tanIndex.clear();
+    _cIndex.clear();
+    _vertices.clear();
+    for (int ii = 0; ii < NumPrimTypes; ii++)
+        _indices[ii].clear();
+    _clusters.clear();
+
+    _posSize = header.posSize;
+    _pOffset = header.pOffset;
+    _nOffset = header.nOffset;
+    _tcOffset = header.tcOffset;
+    _sTanOffset = header.sTanOffset;
+    _cOffset = header.cOffset;
+    _vtxSize = header.vtxSize;
+    _openEdges = header.openEdges;
+
+    const char *data = view->begin() + sizeof(header);
+    _cacheVertices = (const float*)data;
+    _cacheVertexCount = header.vertexCount;
+    data += (size_t)header.vertexCount * header.vtxSize * sizeof(float);
+
+    for (int ii = 0; ii < NumPrimTypes; ii++) {
+        _cacheIndices[ii] = header.indexCount[ii] ? (const GLuint*)data : 0;
+        _cacheIndexCount[ii] = header.indexCount[ii];
+        data += (size_t)header.indexCount[ii] * sizeof(GLuint);
+    }
+
+    _cacheClusters = header.clusterCount ? (const Cluster*)data : 0;
+    _cacheClusterCount = header.clusterCount;
+
+    _cacheFile = view;
+    return true;
+}
+
+//
+// hashData
+//
+////////////////////////////////////////////////////////////
+unsigned long long Model::hashData( const void *data, size_t size, unsigned long long seed) {
+    const unsigned char *p = (const unsigned char*)data;
+    unsigned long long hash = seed;
+
+    for (size_t ii = 0; ii < size; ii++) {
+        hash ^= p[ii];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+//
+// hashFile
+//
+////////////////////////////////////////////////////////////
+unsigned long long Model::hashFile( const char *file) {
+    FileView view;
+    if (!view.open( file))
+        return 0;
+
+    return hashData( view.begin(), view.size());
+}
+
+};
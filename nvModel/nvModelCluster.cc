@@ -0,0 +1,360 @@
+//
+// nvModelCluster.cc - Model support class
+//
+// The nvModel class implements an interface for a multipurpose model
+// object. This class is useful for loading and formatting meshes
+// for use by OpenGL. It can compute face normals, tangents, and
+// adjacency information. The class supports the obj file format.
+//
+// This file implements the partitioning of the compiled triangles
+// into small clusters with bounding spheres and normal cones, so
+// parts of a large mesh can be culled against a frustum or when
+// they face away from the viewer.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <float.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "nvModel.h"
+
+using std::vector;
+
+//upper limits of the cluster size, the cache ordering of a cluster is quadratic in its size
+#define MAX_CLUSTER_VERTICES 256
+#define MAX_CLUSTER_TRIANGLES 512
+
+//how far along the spatial order a cluster looks for a disconnected triangle to continue with
+#define CLUSTER_SEARCH_WINDOW 64
+
+//weight of the normal deviation against the distance when growing a cluster
+#define CLUSTER_CONE_WEIGHT 0.5f
+
+//normal cones wider than this can not face away from any viewer
+#define CLUSTER_CONE_MIN_DOT 0.1f
+
+namespace nv {
+
+//
+// Spreads the low 10 bits to every third bit, for Morton codes
+//
+////////////////////////////////////////////////////////////
+static unsigned int spreadBits( unsigned int x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+//
+// Bounding sphere of a set of points, Ritter's approximation
+//
+////////////////////////////////////////////////////////////
+static void boundingSphere( const vector<vec3f> &points, vec3f &center, float &radius) {
+    //start with the farthest pair of the extreme points along the axes
+    int minIdx[3] = { 0, 0, 0 };
+    int maxIdx[3] = { 0, 0, 0 };
+    for (int ii = 1; ii < (int)points.size(); ii++) {
+        for (int aa = 0; aa < 3; aa++) {
+            if (points[ii][aa] < points[minIdx[aa]][aa])
+                minIdx[aa] = ii;
+            if (points[ii][aa] > points[maxIdx[aa]][aa])
+                maxIdx[aa] = ii;
+        }
+    }
+
+    int axis = 0;
+    float span = -1.0f;
+    for (int aa = 0; aa < 3; aa++) {
+        vec3f d = points[maxIdx[aa]] - points[minIdx[aa]];
+        if (dot( d, d) > span) {
+            span = dot( d, d);
+            axis = aa;
+        }
+    }
+
+    center = (points[minIdx[axis]] + points[maxIdx[axis]]) * 0.5f;
+    radius = sqrtf( span) * 0.5f;
+
+    //grow the sphere just enough to take in every point outside
+    for (int ii = 0; ii < (int)points.size(); ii++) {
+        vec3f d = points[ii] - center;
+        float dist2 = dot( d, d);
+        if (dist2 > radius * radius) {
+            float dist = sqrtf( dist2);
+            float grown = (radius + dist) * 0.5f;
+            center += d * ((grown - radius) / dist);
+            radius = grown;
+        }
+    }
+}
+
+//
+// buildClusters
+//
+////////////////////////////////////////////////////////////
+void Model::buildClusters( int maxVertices, int maxTriangles, int cacheSize) {
+    int triCount = (int)_indices[2].size() / 3;
+    int vertexCount = getCompiledVertexCount();
+
+    _clusters.clear();
+    if (triCount == 0 || vertexCount == 0)
+        return;
+
+    maxVertices = std::max( 3, std::min( maxVertices, MAX_CLUSTER_VERTICES));
+    maxTriangles = std::max( 1, std::min( maxTriangles, MAX_CLUSTER_TRIANGLES));
+
+    const GLuint *indices = &_indices[2][0];
+
+    //triangles of every vertex
+    vector<int> offset( vertexCount + 1, 0);
+    for (int ii = 0; ii < triCount * 3; ii++)
+        offset[indices[ii] + 1]++;
+    for (int ii = 0; ii < vertexCount; ii++)
+        offset[ii + 1] += offset[ii];
+
+    vector<GLuint> vertTris( triCount * 3);
+    {
+        vector<int> fill( offset.begin(), offset.end() - 1);
+        for (int ii = 0; ii < triCount * 3; ii++)
+            vertTris[fill[indices[ii]]++] = ii / 3;
+    }
+
+    //centroid and unit normal of every triangle
+    vector<vec3f> centroid( triCount);
+    vector<vec3f> normal( triCount);
+    vec3f lo( FLT_MAX, FLT_MAX, FLT_MAX);
+    vec3f hi( -FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    for (int tt = 0; tt < triCount; tt++) {
+        vec3f p0( &_vertices[indices[tt*3]*_vtxSize + _pOffset]);
+        vec3f p1( &_vertices[indices[tt*3 + 1]*_vtxSize + _pOffset]);
+        vec3f p2( &_vertices[indices[tt*3 + 2]*_vtxSize + _pOffset]);
+        vec3f n = cross( p1 - p0, p2 - p0);
+        float len = sqrtf( dot( n, n));
+
+        centroid[tt] = (p0 + p1 + p2) / 3.0f;
+        normal[tt] = (len > 0.0f) ? n / len : vec3f( 0.0f, 0.0f, 0.0f);
+        for (int aa = 0; aa < 3; aa++) {
+            lo[aa] = std::min( lo[aa], centroid[tt][aa]);
+            hi[aa] = std::max( hi[aa], centroid[tt][aa]);
+        }
+    }
+
+    //Morton order of the centroids, to continue a cluster over pieces that share no vertex
+    vector<GLuint> spatial( triCount);
+    vector<int> spatialPos( triCount);
+    {
+        vec3f scale;
+        for (int aa = 0; aa < 3; aa++)
+            scale[aa] = (hi[aa] > lo[aa]) ? 1023.0f / (hi[aa] - lo[aa]) : 0.0f;
+
+        vector< std::pair<unsigned int, GLuint> > keys( triCount);
+        for (int tt = 0; tt < triCount; tt++) {
+            unsigned int code = 0;
+            for (int aa = 0; aa < 3; aa++)
+                code |= spreadBits( (unsigned int)((centroid[tt][aa] - lo[aa]) * scale[aa])) << aa;
+            keys[tt] = std::make_pair( code, (GLuint)tt);
+        }
+        std::sort( keys.begin(), keys.end());
+
+        for (int ii = 0; ii < triCount; ii++) {
+            spatial[ii] = keys[ii].second;
+            spatialPos[keys[ii].second] = ii;
+        }
+    }
+
+    vector<bool> assigned( triCount, false);
+    vector<int> vertexSlot( vertexCount, -1);   //position in the current cluster
+    vector<int> candidateOf( triCount, -1);     //last cluster the triangle was a candidate of
+
+    vector<GLuint> order;
+    order.reserve( triCount);
+
+    vector<GLuint> clusterVerts, clusterTris, candidates, local, localOrder;
+    int seed = 0;
+
+    while ((int)order.size() < triCount) {
+        int cluster = (int)_clusters.size();
+        clusterVerts.clear();
+        clusterTris.clear();
+        candidates.clear();
+
+        vec3f centroidSum( 0.0f, 0.0f, 0.0f);
+        vec3f normalSum( 0.0f, 0.0f, 0.0f);
+
+        //clusters start in the current triangle order, which keeps most of an earlier sort against overdraw
+        while (assigned[seed])
+            seed++;
+        int next = seed;
+
+        while (next >= 0) {
+            assigned[next] = true;
+            clusterTris.push_back( next);
+            centroidSum += centroid[next];
+            normalSum += normal[next];
+
+            for (int jj = 0; jj < 3; jj++) {
+                GLuint v = indices[next*3 + jj];
+                if (vertexSlot[v] >= 0)
+                    continue;
+
+                vertexSlot[v] = (int)clusterVerts.size();
+                clusterVerts.push_back( v);
+                for (int kk = offset[v]; kk < offset[v + 1]; kk++) {
+                    GLuint t = vertTris[kk];
+                    if (!assigned[t] && candidateOf[t] != cluster) {
+                        candidateOf[t] = cluster;
+                        candidates.push_back( t);
+                    }
+                }
+            }
+
+            if ((int)clusterTris.size() == maxTriangles)
+                break;
+
+            vec3f center = centroidSum / (float)clusterTris.size();
+            float axisLen = sqrtf( dot( normalSum, normalSum));
+            vec3f axis = (axisLen > 0.0f) ? normalSum / axisLen : vec3f( 0.0f, 0.0f, 0.0f);
+
+            //fewest new vertices first, then the closest triangle facing the same way
+            next = -1;
+            int bestAdded = 4;
+            float bestScore = FLT_MAX;
+            int kept = 0;
+
+            for (int ii = 0; ii < (int)candidates.size(); ii++) {
+                GLuint t = candidates[ii];
+                if (assigned[t])
+                    continue;
+                candidates[kept++] = t;
+
+                int added = (vertexSlot[indices[t*3]] < 0) + (vertexSlot[indices[t*3 + 1]] < 0) + (vertexSlot[indices[t*3 + 2]] < 0);
+                if ((int)clusterVerts.size() + added > maxVertices || added > bestAdded)
+                    continue;
+
+                vec3f d = centroid[t] - center;
+                float score = dot( d, d) * (1.0f + CLUSTER_CONE_WEIGHT * (1.0f - dot( normal[t], axis)));
+                if (added < bestAdded || score < bestScore) {
+                    bestAdded = added;
+                    bestScore = score;
+                    next = t;
+                }
+            }
+            candidates.resize( kept);
+
+            if (next < 0 && (int)clusterVerts.size() + 3 <= maxVertices) {
+                //nothing connected fits, look for the closest free triangle around the last one in the spatial order
+                int pos = spatialPos[clusterTris.back()];
+                int end = std::min( triCount, pos + CLUSTER_SEARCH_WINDOW + 1);
+                for (int ii = std::max( 0, pos - CLUSTER_SEARCH_WINDOW); ii < end; ii++) {
+                    GLuint t = spatial[ii];
+                    if (assigned[t])
+                        continue;
+
+                    vec3f d = centroid[t] - center;
+                    float score = dot( d, d) * (1.0f + CLUSTER_CONE_WEIGHT * (1.0f - dot( normal[t], axis)));
+                    if (score < bestScore) {
+                        bestScore = score;
+                        next = t;
+                    }
+                }
+            }
+        }
+
+        //order the cluster for the vertex cache on its own vertices
+        local.resize( clusterTris.size() * 3);
+        for (int ii = 0; ii < (int)clusterTris.size(); ii++)
+            for (int jj = 0; jj < 3; jj++)
+                local[ii*3 + jj] = vertexSlot[indices[clusterTris[ii]*3 + jj]];
+        cacheOrder( &local[0], (int)clusterTris.size(), (int)clusterVerts.size(), cacheSize, localOrder);
+
+        Cluster c;
+        c.firstIndex = (GLuint)order.size() * 3;
+        c.indexCount = (GLuint)clusterTris.size() * 3;
+        c.vertexCount = (GLuint)clusterVerts.size();
+        _clusters.push_back( c);
+
+        for (int ii = 0; ii < (int)localOrder.size(); ii++)
+            order.push_back( clusterTris[localOrder[ii]]);
+
+        for (int ii = 0; ii < (int)clusterVerts.size(); ii++)
+            vertexSlot[clusterVerts[ii]] = -1;
+    }
+
+    //reorderTriangles drops the clusters along with the old order
+    vector<Cluster> clusters;
+    clusters.swap( _clusters);
+    reorderTriangles( order);
+    _clusters.swap( clusters);
+
+    //bounds of the clusters in the new numbering
+    indices = &_indices[2][0];
+    vector<int> lastCluster( vertexCount, -1);
+    vector<vec3f> points;
+
+    for (int cc = 0; cc < (int)_clusters.size(); cc++) {
+        Cluster &c = _clusters[cc];
+        int first = c.firstIndex / 3;
+        int count = c.indexCount / 3;
+
+        points.clear();
+        for (int ii = c.firstIndex; ii < (int)(c.firstIndex + c.indexCount); ii++) {
+            GLuint v = indices[ii];
+            if (lastCluster[v] != cc) {
+                lastCluster[v] = cc;
+                points.push_back( vec3f( &_vertices[v*_vtxSize + _pOffset]));
+            }
+        }
+        boundingSphere( points, c.center, c.radius);
+
+        //the cone axis is the mean normal, the cone must contain every normal
+        vec3f axis( 0.0f, 0.0f, 0.0f);
+        vector<vec3f> normals( count);
+        for (int tt = 0; tt < count; tt++) {
+            const GLuint *tri = &indices[(first + tt)*3];
+            vec3f p0( &_vertices[tri[0]*_vtxSize + _pOffset]);
+            vec3f p1( &_vertices[tri[1]*_vtxSize + _pOffset]);
+            vec3f p2( &_vertices[tri[2]*_vtxSize + _pOffset]);
+            vec3f n = cross( p1 - p0, p2 - p0);
+            float len = sqrtf( dot( n, n));
+            normals[tt] = (len > 0.0f) ? n / len : vec3f( 0.0f, 0.0f, 0.0f);
+            axis += normals[tt];
+        }
+
+        float axisLen = sqrtf( dot( axis, axis));
+        c.coneAxis = (axisLen > 0.0f) ? axis / axisLen : vec3f( 0.0f, 0.0f, 1.0f);
+        c.coneApex = c.center;
+        c.coneCutoff = 1.0f;
+
+        float minDot = (axisLen > 0.0f) ? 1.0f : -1.0f;
+        for (int tt = 0; tt < count; tt++)
+            if (dot( normals[tt], normals[tt]) > 0.0f)
+                minDot = std::min( minDot, dot( normals[tt], c.coneAxis));
+
+        if (minDot <= CLUSTER_CONE_MIN_DOT)
+            continue;
+
+        //the apex goes back along the axis until it is behind every triangle
+        float maxT = 0.0f;
+        for (int tt = 0; tt < count; tt++) {
+            if (dot( normals[tt], normals[tt]) == 0.0f)
+                continue;
+            vec3f p0( &_vertices[indices[(first + tt)*3]*_vtxSize + _pOffset]);
+            maxT = std::max( maxT, dot( c.center - p0, normals[tt]) / dot( c.coneAxis, normals[tt]));
+        }
+
+        c.coneApex = c.center - c.coneAxis * maxT;
+        c.coneCutoff = sqrtf( 1.0f - minDot * minDot);
+    }
+}
+
+};
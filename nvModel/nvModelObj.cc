@@ -8,6 +8,13 @@
 //
 // This file implements the obj file parser and translator.
 //
+// The file is mapped (or read in one piece) and scanned in place with
+// hand written number parsers. Large files are split at line boundaries
+// and the chunks are parsed on worker threads, then merged with their
+// indices offset by the elements of the preceding chunks. A first pass
+// over every chunk only counts the lines of every element type, so the
+// raw arrays are allocated once.
+//
 // Author: Evan Hart
 // Email: sdkfeedback@nvidia.com
 //
@@ -17,240 +24,529 @@
 #include "nvModel.h"
 
 #include <stdio.h>
+#include <string.h>
+
+#include <thread>
 
-#define BUF_SIZE 256
+#include "nvFileView.h"
+
+//files are split into chunks of at least this size for parallel parsing
+#define OBJ_MIN_CHUNK_SIZE (4 << 20)
 
 using std::vector;
+using nv::FileView;
+
+namespace {
 
-static void skipLine(char * buf, int size, FILE * fp)
-{
-  do {
-    buf[size-1] = '$';
-    fgets(buf, size, fp);
-  } while (buf[size-1] != '$');
+//
+// Scanning helpers, none of them reads past end or across a line break
+//
+////////////////////////////////////////////////////////////
+inline const char* skipSpace( const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    return p;
 }
 
+inline const char* skipLine( const char *p, const char *end) {
+    const char *nl = (const char*)memchr( p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
 
-namespace nv {
+inline bool isDigit( char c) {
+    return c >= '0' && c <= '9';
+}
 
-bool Model::loadObjFromFile( const char *file, Model &m) {
-    FILE *fp;
+//
+// parseInt
+//
+//    Reads an optionally signed decimal integer. Returns the
+//  position after it, or p itself if there is no number.
+//
+////////////////////////////////////////////////////////////
+inline const char* parseInt( const char *p, const char *end, int &val) {
+    const char *s = p;
+    bool neg = false;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+    if (p == end || !isDigit(*p))
+        return s;
 
-    fp = fopen( file, "r");
-    if (!fp) {
-        return false;
+    int v = 0;
+    while (p < end && isDigit(*p))
+        v = v * 10 + (*p++ - '0');
+
+    val = neg ? -v : v;
+    return p;
+}
+
+//
+// parseFloat
+//
+//    Reads a decimal floating point number with optional
+//  fraction and exponent. The digits are accumulated as an
+//  integer and scaled once, which is exact for the short
+//  mantissas obj exporters write. Returns p itself if there
+//  is no number.
+//
+////////////////////////////////////////////////////////////
+const char* parseFloat( const char *p, const char *end, float &val) {
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *s = p;
+    bool neg = false;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    for ( ; p < end && isDigit(*p); p++, digits++) {
+        if (mantissa < 100000000000000000ULL)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+            exponent++;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        for ( ; p < end && isDigit(*p); p++, digits++) {
+            if (mantissa < 100000000000000000ULL) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+
+    if (digits == 0)
+        return s;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int e = 0;
+        const char *q = parseInt( p + 1, end, e);
+        if (q != p + 1) {
+            exponent += e;
+            p = q;
+        }
+    }
+
+    double v = (double)mantissa;
+    if (exponent < 0) {
+        while (exponent < -22) {
+            v /= 1e22;
+            exponent += 22;
+        }
+        v /= pow10[-exponent];
+    }
+    else {
+        while (exponent > 22) {
+            v *= 1e22;
+            exponent -= 22;
+        }
+        v *= pow10[exponent];
+    }
+
+    val = (float)(neg ? -v : v);
+    return p;
+}
+
+//
+// Reads up to max floats from the rest of the line, returns the count
+//
+////////////////////////////////////////////////////////////
+inline int parseFloats( const char *&p, const char *end, float *val, int max) {
+    int count = 0;
+    for ( ; count < max; count++) {
+        p = skipSpace( p, end);
+        const char *q = parseFloat( p, end, val[count]);
+        if (q == p)
+            break;
+        p = q;
+    }
+    return count;
+}
+
+//
+// One face corner, v, v/t, v//n or v/t/n. Components that are
+// not present are left untouched. Returns p itself if there is
+// no corner.
+//
+////////////////////////////////////////////////////////////
+inline const char* parseCorner( const char *p, const char *end, int idx[3], bool &hasT, bool &hasN) {
+    const char *q = parseInt( p, end, idx[0]);
+    if (q == p)
+        return p;
+
+    hasT = hasN = false;
+    if (q < end && *q == '/') {
+        q++;
+        const char *r = parseInt( q, end, idx[1]);
+        hasT = (r != q);
+        q = r;
+        if (q < end && *q == '/') {
+            q++;
+            r = parseInt( q, end, idx[2]);
+            hasN = (r != q);
+            q = r;
+        }
     }
+    return q;
+}
+
+//
+// Raw data of one chunk of lines. Positions and tex coords are
+// kept with 4 and 3 components until the whole file is merged.
+// Positive indices are final, relative ones are resolved against
+// the elements of the chunk and listed in the fixup arrays, they
+// still need the number of elements in the preceding chunks.
+//
+////////////////////////////////////////////////////////////
+struct ObjChunk {
+    const char *begin, *end;
+
+    vector<float> positions, normals, texCoords;
+    vector<GLuint> pIndex, nIndex, tIndex;
+    vector<size_t> pFixup, nFixup, tFixup;
+
+    bool vtx4Comp, tex3Comp, hasTC, hasNormals;
+
+    ObjChunk() : begin(0), end(0), vtx4Comp(false), tex3Comp(false), hasTC(false), hasNormals(false) {}
+};
+
+//
+// obj indices are 1-based, negative ones count back from the last element
+//
+////////////////////////////////////////////////////////////
+inline GLuint remap( int idx, int count) {
+    return (GLuint)((idx > 0) ? (idx - 1) : (count + idx));
+}
+
+//
+// parseChunk
+//
+//    Parses the complete lines in [c.begin, c.end) into the
+//  chunk. It is independent of all other chunks, so chunks
+//  can be parsed concurrently.
+//
+////////////////////////////////////////////////////////////
+void parseChunk( ObjChunk &c) {
+    const char *end = c.end;
+    const char *p;
+
+    //counting pass, only looks at the first characters of every line
+    size_t vCount = 0, vnCount = 0, vtCount = 0, fCount = 0;
+    for ( p = c.begin; p < end; p = skipLine( p, end)) {
+        p = skipSpace( p, end);
+        if (p + 1 >= end)
+            break;
+        if (p[0] == 'v') {
+            if (p[1] == 'n')
+                vnCount++;
+            else if (p[1] == 't')
+                vtCount++;
+            else if (p[1] == ' ' || p[1] == '\t')
+                vCount++;
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            fCount++;
+        }
+    }
+
+    c.positions.reserve( vCount * 4);
+    c.normals.reserve( vnCount * 3);
+    c.texCoords.reserve( vtCount * 3);
+    // most faces are triangles
+    c.pIndex.reserve( fCount * 3);
+    c.nIndex.reserve( fCount * 3);
+    c.tIndex.reserve( fCount * 3);
 
-    char buf[BUF_SIZE];
     float val[4];
     int idx[3][3];
     int match;
-    bool vtx4Comp = false;
-    bool tex3Comp = false;
-    bool hasTC = false;
-    bool hasNormals = false;
 
-    while ( fscanf( fp, "%s", buf) != EOF ) {
-
-        switch (buf[0]) {
-            case '#':
-                //comment line, eat the remainder
-        skipLine( buf, BUF_SIZE, fp);
-                break;
+    for ( p = c.begin; p < end; p = skipLine( p, end)) {
+        p = skipSpace( p, end);
+        if (p == end)
+            break;
 
+        switch (p[0]) {
             case 'v':
-                switch (buf[1]) {
-                
-                    case '\0':
+                if (p + 1 == end)
+                    break;
+
+                switch (p[1]) {
+
+                    case ' ':
+                    case '\t':
                         //vertex, 3 or 4 components
+                        p += 1;
                         val[3] = 1.0f;  //default w coordinate
-                        match = fscanf( fp, "%f %f %f %f", &val[0], &val[1], &val[2], &val[3]);
-                        m._positions.push_back( val[0]);
-                        m._positions.push_back( val[1]);
-                        m._positions.push_back( val[2]);
-                        m._positions.push_back( val[3]);
-                        vtx4Comp |= ( match == 4);
+                        match = parseFloats( p, end, val, 4);
+                        c.positions.push_back( val[0]);
+                        c.positions.push_back( val[1]);
+                        c.positions.push_back( val[2]);
+                        c.positions.push_back( val[3]);
+                        c.vtx4Comp |= ( match == 4);
                         assert( match > 2 && match < 5);
                         break;
 
                     case 'n':
                         //normal, 3 components
-                        match = fscanf( fp, "%f %f %f", &val[0], &val[1], &val[2]);
-                        m._normals.push_back( val[0]);
-                        m._normals.push_back( val[1]);
-                        m._normals.push_back( val[2]);
+                        p += 2;
+                        match = parseFloats( p, end, val, 3);
+                        c.normals.push_back( val[0]);
+                        c.normals.push_back( val[1]);
+                        c.normals.push_back( val[2]);
                         assert( match == 3);
                         break;
 
                     case 't':
                         //texcoord, 2 or 3 components
+                        p += 2;
                         val[2] = 0.0f;  //default r coordinate
-                        match = fscanf( fp, "%f %f %f %f", &val[0], &val[1], &val[2]);
-                        m._texCoords.push_back( val[0]);
-                        m._texCoords.push_back( val[1]);
-                        m._texCoords.push_back( val[2]);
-                        tex3Comp |= ( match == 3);
+                        match = parseFloats( p, end, val, 3);
+                        c.texCoords.push_back( val[0]);
+                        c.texCoords.push_back( val[1]);
+                        c.texCoords.push_back( val[2]);
+                        c.tex3Comp |= ( match == 3);
                         assert( match > 1 && match < 4);
                         break;
                 }
                 break;
 
-            case 'f':
-                //face
-                fscanf( fp, "%s", buf);
-
-                //determine the type, and read the initial vertex, all entries in a face must have the same format
-                if ( sscanf( buf, "%d//%d", &idx[0][0], &idx[0][1]) == 2) {
-                    //This face has vertex and normal indices
-
-                    //remap them to the right spot
-                    idx[0][0] = (idx[0][0] > 0) ? (idx[0][0] - 1) : ((int)m._positions.size() - idx[0][0]);
-                    idx[0][1] = (idx[0][1] > 0) ? (idx[0][1] - 1) : ((int)m._normals.size() - idx[0][1]);
-
-                    //grab the second vertex to prime
-                    fscanf( fp, "%d//%d", &idx[1][0], &idx[1][1]);
-
-                    //remap them to the right spot
-                    idx[1][0] = (idx[1][0] > 0) ? (idx[1][0] - 1) : ((int)m._positions.size() - idx[1][0]);
-                    idx[1][1] = (idx[1][1] > 0) ? (idx[1][1] - 1) : ((int)m._normals.size() - idx[1][1]);
-
-                    //create the fan
-                    while ( fscanf( fp, "%d//%d", &idx[2][0], &idx[2][1]) == 2) {
-                        //remap them to the right spot
-                        idx[2][0] = (idx[2][0] > 0) ? (idx[2][0] - 1) : ((int)m._positions.size() - idx[2][0]);
-                        idx[2][1] = (idx[2][1] > 0) ? (idx[2][1] - 1) : ((int)m._normals.size() - idx[2][1]);
-
-                        //add the indices
-                        for (int ii = 0; ii < 3; ii++) {
-                            m._pIndex.push_back( idx[ii][0]);
-                            m._nIndex.push_back( idx[ii][1]);
-                            m._tIndex.push_back(0); // dummy index, to ensure that the buffers are of identical size
-                        }
-                        
-                        //prepare for the next iteration
-                        idx[1][0] = idx[2][0];
-                        idx[1][1] = idx[2][1];
-                    }
-                    hasNormals = true;
-                }
-                else if ( sscanf( buf, "%d/%d/%d", &idx[0][0], &idx[0][1], &idx[0][2]) == 3) {
-                    //This face has vertex, texture coordinate, and normal indices
-
-                    //remap them to the right spot
-                    idx[0][0] = (idx[0][0] > 0) ? (idx[0][0] - 1) : ((int)m._positions.size() - idx[0][0]);
-                    idx[0][1] = (idx[0][1] > 0) ? (idx[0][1] - 1) : ((int)m._texCoords.size() - idx[0][1]);
-                    idx[0][2] = (idx[0][2] > 0) ? (idx[0][2] - 1) : ((int)m._normals.size() - idx[0][2]);
-
-                    //grab the second vertex to prime
-                    fscanf( fp, "%d/%d/%d", &idx[1][0], &idx[1][1], &idx[1][2]);
-
-                    //remap them to the right spot
-                    idx[1][0] = (idx[1][0] > 0) ? (idx[1][0] - 1) : ((int)m._positions.size() - idx[1][0]);
-                    idx[1][1] = (idx[1][1] > 0) ? (idx[1][1] - 1) : ((int)m._texCoords.size() - idx[1][1]);
-                    idx[1][2] = (idx[1][2] > 0) ? (idx[1][2] - 1) : ((int)m._normals.size() - idx[1][2]);
-
-                    //create the fan
-                    while ( fscanf( fp, "%d/%d/%d", &idx[2][0], &idx[2][1], &idx[2][2]) == 3) {
-                        //remap them to the right spot
-                        idx[2][0] = (idx[2][0] > 0) ? (idx[2][0] - 1) : ((int)m._positions.size() - idx[2][0]);
-                        idx[2][1] = (idx[2][1] > 0) ? (idx[2][1] - 1) : ((int)m._texCoords.size() - idx[2][1]);
-                        idx[2][2] = (idx[2][2] > 0) ? (idx[2][2] - 1) : ((int)m._normals.size() - idx[2][2]);
-
-                        //add the indices
-                        for (int ii = 0; ii < 3; ii++) {
-                            m._pIndex.push_back( idx[ii][0]);
-                            m._tIndex.push_back( idx[ii][1]);
-                            m._nIndex.push_back( idx[ii][2]);
-                        }
-                        
-                        //prepare for the next iteration
-                        idx[1][0] = idx[2][0];
-                        idx[1][1] = idx[2][1];
-                        idx[1][2] = idx[2][2];
-                    }
+            case 'f': {
+                //face, triangulated as a fan around the first corner
+                int posCount = (int)c.positions.size() / 4;
+                int tcCount = (int)c.texCoords.size() / 3;
+                int nCount = (int)c.normals.size() / 3;
+                bool faceT = false, faceN = false;
+                int corners = 0;
+
+                //which indices of the fan corners are relative (bit 0 position, 1 tex coord, 2 normal)
+                int relative[3] = { 0, 0, 0 };
+
+                p += 1;
+                for (;;) {
+                    p = skipSpace( p, end);
+                    int slot = (corners < 2) ? corners : 2;
+                    int *corner = idx[slot];
+                    bool hasT, hasN;
+                    const char *q = parseCorner( p, end, corner, hasT, hasN);
+                    if (q == p)
+                        break;
+                    p = q;
 
-                    hasTC = true;
-                    hasNormals = true;
-                }
-                else if ( sscanf( buf, "%d/%d", &idx[0][0], &idx[0][1]) == 2) {
-                    //This face has vertex and texture coordinate indices
-
-                    //remap them to the right spot
-                    idx[0][0] = (idx[0][0] > 0) ? (idx[0][0] - 1) : ((int)m._positions.size() - idx[0][0]);
-                    idx[0][1] = (idx[0][1] > 0) ? (idx[0][1] - 1) : ((int)m._texCoords.size() - idx[0][1]);
-
-                    //grab the second vertex to prime
-                    fscanf( fp, "%d/%d", &idx[1][0], &idx[1][1]);
-
-                    //remap them to the right spot
-                    idx[1][0] = (idx[1][0] > 0) ? (idx[1][0] - 1) : ((int)m._positions.size() - idx[1][0]);
-                    idx[1][1] = (idx[1][1] > 0) ? (idx[1][1] - 1) : ((int)m._texCoords.size() - idx[1][1]);
-
-                    //create the fan
-                    while ( fscanf( fp, "%d/%d", &idx[2][0], &idx[2][1]) == 2) {
-                        //remap them to the right spot
-                        idx[2][0] = (idx[2][0] > 0) ? (idx[2][0] - 1) : ((int)m._positions.size() - idx[2][0]);
-                        idx[2][1] = (idx[2][1] > 0) ? (idx[2][1] - 1) : ((int)m._texCoords.size() - idx[2][1]);
-
-                        //add the indices
-                        for (int ii = 0; ii < 3; ii++) {
-                            m._pIndex.push_back( idx[ii][0]);
-                            m._tIndex.push_back( idx[ii][1]);
-                            m._nIndex.push_back( 0); //dummy normal index to keep everything in synch
-                        }
-                        
-                        //prepare for the next iteration
-                        idx[1][0] = idx[2][0];
-                        idx[1][1] = idx[2][1];
+                    //all entries in a face must have the same format as the first one
+                    if (corners == 0) {
+                        faceT = hasT;
+                        faceN = hasN;
                     }
-                    hasTC = true;
-                }
-                else if ( sscanf( buf, "%d", &idx[0][0]) == 1) {
-                    //This face has only vertex indices
-
-                    //remap them to the right spot
-                    idx[0][0] = (idx[0][0] > 0) ? (idx[0][0] - 1) : ((int)m._positions.size() - idx[0][0]);
-
-                    //grab the second vertex to prime
-                    fscanf( fp, "%d", &idx[1][0]);
-
-                    //remap them to the right spot
-                    idx[1][0] = (idx[1][0] > 0) ? (idx[1][0] - 1) : ((int)m._positions.size() - idx[1][0]);
-
-                    //create the fan
-                    while ( fscanf( fp, "%d", &idx[2][0]) == 1) {
-                        //remap them to the right spot
-                        idx[2][0] = (idx[2][0] > 0) ? (idx[2][0] - 1) : ((int)m._positions.size() - idx[2][0]);
-
-                        //add the indices
-                        for (int ii = 0; ii < 3; ii++) {
-                            m._pIndex.push_back( idx[ii][0]);
-                            m._tIndex.push_back( 0); //dummy index to keep things in synch
-                            m._nIndex.push_back( 0); //dummy normal index to keep everything in synch
-                        }
-                        
-                        //prepare for the next iteration
-                        idx[1][0] = idx[2][0];
+
+                    relative[slot] = (corner[0] <= 0 ? 1 : 0) | (faceT && corner[1] <= 0 ? 2 : 0) | (faceN && corner[2] <= 0 ? 4 : 0);
+                    corner[0] = remap( corner[0], posCount);
+                    corner[1] = faceT ? remap( corner[1], tcCount) : 0; // dummy index, to ensure that the buffers are of identical size
+                    corner[2] = faceN ? remap( corner[2], nCount) : 0;
+
+                    if (++corners < 3)
+                        continue;
+
+                    //add the indices
+                    for (int ii = 0; ii < 3; ii++) {
+                        if (relative[ii] & 1)
+                            c.pFixup.push_back( c.pIndex.size());
+                        if (relative[ii] & 2)
+                            c.tFixup.push_back( c.tIndex.size());
+                        if (relative[ii] & 4)
+                            c.nFixup.push_back( c.nIndex.size());
+
+                        c.pIndex.push_back( idx[ii][0]);
+                        c.tIndex.push_back( idx[ii][1]);
+                        c.nIndex.push_back( idx[ii][2]);
                     }
+
+                    //prepare for the next iteration
+                    idx[1][0] = idx[2][0];
+                    idx[1][1] = idx[2][1];
+                    idx[1][2] = idx[2][2];
+                    relative[1] = relative[2];
                 }
-                else {
-                    //bad format
-                    assert(0);
-                    skipLine( buf, BUF_SIZE, fp);
-                }
+
+                //bad format
+                assert( corners > 0);
+
+                c.hasTC |= faceT;
+                c.hasNormals |= faceN;
                 break;
+            }
 
+            case '#':
+                //comment line
             case 's':
             case 'g':
             case 'u':
                 //all presently ignored
             default:
-        skipLine( buf, BUF_SIZE, fp);
-
+                break;
         };
     }
+}
 
-    fclose(fp);
+//
+// appendChunk
+//
+//    Copies the data of a chunk to the given element and index
+//  offsets of the model arrays, and resolves its relative indices
+//  against the elements of all preceding chunks.
+//
+////////////////////////////////////////////////////////////
+void appendChunk( const ObjChunk &c, float *positions, float *normals, float *texCoords,
+                  GLuint *pIndex, GLuint *nIndex, GLuint *tIndex, bool hasNormals, bool hasTC,
+                  GLuint posBase, GLuint nBase, GLuint tcBase) {
+    if (!c.positions.empty())
+        memcpy( positions, &c.positions[0], c.positions.size() * sizeof(float));
+    if (hasNormals && !c.normals.empty())
+        memcpy( normals, &c.normals[0], c.normals.size() * sizeof(float));
+    if (hasTC && !c.texCoords.empty())
+        memcpy( texCoords, &c.texCoords[0], c.texCoords.size() * sizeof(float));
+
+    if (c.pIndex.empty())
+        return;
+
+    memcpy( pIndex, &c.pIndex[0], c.pIndex.size() * sizeof(GLuint));
+    for (size_t ii = 0; ii < c.pFixup.size(); ii++)
+        pIndex[c.pFixup[ii]] += posBase;
+
+    if (hasNormals) {
+        memcpy( nIndex, &c.nIndex[0], c.nIndex.size() * sizeof(GLuint));
+        for (size_t ii = 0; ii < c.nFixup.size(); ii++)
+            nIndex[c.nFixup[ii]] += nBase;
+    }
+
+    if (hasTC) {
+        memcpy( tIndex, &c.tIndex[0], c.tIndex.size() * sizeof(GLuint));
+        for (size_t ii = 0; ii < c.tFixup.size(); ii++)
+            tIndex[c.tFixup[ii]] += tcBase;
+    }
+}
+
+};
+
+
+namespace nv {
+
+bool Model::loadObjFromFile( const char *file, Model &m) {
+    FileView view;
+
+    if (!view.open( file)) {
+        return false;
+    }
+
+    //split the file at line boundaries, one chunk per worker
+    size_t size = view.end() - view.begin();
+    unsigned int threads = std::thread::hardware_concurrency();
+    size_t chunkCount = size / OBJ_MIN_CHUNK_SIZE;
+    if (chunkCount > threads)
+        chunkCount = threads;
+    if (chunkCount < 1)
+        chunkCount = 1;
+
+    vector<ObjChunk> chunks( chunkCount);
+    const char *p = view.begin();
+    for (size_t ii = 0; ii < chunkCount; ii++) {
+        chunks[ii].begin = p;
+        p = (ii + 1 == chunkCount) ? view.end() : skipLine( view.begin() + size * (ii + 1) / chunkCount, view.end());
+        if (p < chunks[ii].begin)
+            p = chunks[ii].begin;
+        chunks[ii].end = p;
+    }
+
+    if (chunkCount == 1) {
+        parseChunk( chunks[0]);
+    }
+    else {
+        vector<std::thread> workers;
+        for (size_t ii = 1; ii < chunkCount; ii++)
+            workers.push_back( std::thread( parseChunk, std::ref( chunks[ii])));
+        parseChunk( chunks[0]);
+        for (size_t ii = 0; ii < workers.size(); ii++)
+            workers[ii].join();
+    }
+
+    view.close();
+
+    bool vtx4Comp = false;
+    bool tex3Comp = false;
+    bool hasTC = false;
+    bool hasNormals = false;
+
+    //element and index offsets of every chunk in the merged arrays
+    vector<size_t> posOffset( chunkCount + 1, m._positions.size());
+    vector<size_t> nOffset( chunkCount + 1, m._normals.size());
+    vector<size_t> tcOffset( chunkCount + 1, m._texCoords.size());
+    vector<size_t> idxOffset( chunkCount + 1, m._pIndex.size());
+
+    for (size_t ii = 0; ii < chunkCount; ii++) {
+        const ObjChunk &c = chunks[ii];
+        vtx4Comp |= c.vtx4Comp;
+        tex3Comp |= c.tex3Comp;
+        hasTC |= c.hasTC;
+        hasNormals |= c.hasNormals;
+
+        posOffset[ii + 1] = posOffset[ii] + c.positions.size();
+        nOffset[ii + 1] = nOffset[ii] + c.normals.size();
+        tcOffset[ii + 1] = tcOffset[ii] + c.texCoords.size();
+        idxOffset[ii + 1] = idxOffset[ii] + c.pIndex.size();
+    }
+
+    if (chunkCount == 1 && m._positions.empty() && m._pIndex.empty()) {
+        //nothing to merge
+        m._positions.swap( chunks[0].positions);
+        m._normals.swap( chunks[0].normals);
+        m._texCoords.swap( chunks[0].texCoords);
+        m._pIndex.swap( chunks[0].pIndex);
+        m._nIndex.swap( chunks[0].nIndex);
+        m._tIndex.swap( chunks[0].tIndex);
+    }
+    else {
+        m._positions.resize( posOffset[chunkCount]);
+        m._normals.resize( hasNormals ? nOffset[chunkCount] : 0);
+        m._texCoords.resize( hasTC ? tcOffset[chunkCount] : 0);
+        m._pIndex.resize( idxOffset[chunkCount]);
+        m._nIndex.resize( hasNormals ? idxOffset[chunkCount] : 0);
+        m._tIndex.resize( hasTC ? idxOffset[chunkCount] : 0);
+
+        float *positions = m._positions.empty() ? 0 : &m._positions[0];
+        float *normals = m._normals.empty() ? 0 : &m._normals[0];
+        float *texCoords = m._texCoords.empty() ? 0 : &m._texCoords[0];
+        GLuint *pIndex = m._pIndex.empty() ? 0 : &m._pIndex[0];
+        GLuint *nIndex = m._nIndex.empty() ? 0 : &m._nIndex[0];
+        GLuint *tIndex = m._tIndex.empty() ? 0 : &m._tIndex[0];
+
+        //the chunks go to disjoint ranges, so they are copied concurrently as well
+        vector<std::thread> workers;
+        for (size_t ii = 0; ii < chunkCount; ii++) {
+            std::thread worker( appendChunk, std::cref( chunks[ii]),
+                                positions + posOffset[ii], normals + nOffset[ii], texCoords + tcOffset[ii],
+                                pIndex + idxOffset[ii], nIndex + idxOffset[ii], tIndex + idxOffset[ii], hasNormals, hasTC,
+                                (GLuint)(posOffset[ii] / 4), (GLuint)(nOffset[ii] / 3), (GLuint)(tcOffset[ii] / 3));
+            if (ii + 1 < chunkCount)
+                workers.push_back( std::move( worker));
+            else
+                worker.join();
+        }
+        for (size_t ii = 0; ii < workers.size(); ii++)
+            workers[ii].join();
+    }
 
     //post-process data
 
@@ -299,7 +595,7 @@ bool Model::loadObjFromFile( const char *file, Model &m) {
 
         m._texCoords.resize( (m._texCoords.size() / 3) * 2);
 
-        m._tcSize = 2; 
+        m._tcSize = 2;
     }
 
     return true;
@@ -307,4 +603,3 @@ bool Model::loadObjFromFile( const char *file, Model &m) {
 
 
 };
-
@@ -0,0 +1,413 @@
+//
+// nvModelOptimize.cc - Model support class
+//
+// The nvModel class implements an interface for a multipurpose model
+// object. This class is useful for loading and formatting meshes
+// for use by OpenGL. It can compute face normals, tangents, and
+// adjacency information. The class supports the obj file format.
+//
+// This file implements the reordering of the compiled model for the
+// GPU: triangles for the post-transform vertex cache (Forsyth's linear
+// speed vertex cache optimisation), optionally clusters against
+// overdraw (Sander et al.), and vertices in the order they are fetched.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "nvModel.h"
+
+using std::vector;
+
+//scores are tabulated for caches up to this size and vertices up to this valence
+#define MAX_SCORE_CACHE_SIZE 64
+#define MAX_SCORE_VALENCE 32
+
+namespace nv {
+
+//
+// Forsyth vertex score tables
+//
+////////////////////////////////////////////////////////////
+struct VertexScore {
+    float cache[MAX_SCORE_CACHE_SIZE];
+    float valence[MAX_SCORE_VALENCE];
+    int cacheSize;
+
+    VertexScore( int size) : cacheSize(size) {
+        const float cacheDecayPower = 1.5f;
+        const float lastTriScore = 0.75f;
+        const float valenceBoostScale = 2.0f;
+        const float valenceBoostPower = 0.5f;
+
+        for (int ii = 0; ii < cacheSize; ii++) {
+            if (ii < 3)
+                //the vertices of the last triangle get a fixed score, so it is not reused right away
+                cache[ii] = lastTriScore;
+            else
+                cache[ii] = powf( 1.0f - (float)(ii - 3) / (float)(cacheSize - 3), cacheDecayPower);
+        }
+
+        //vertices with few remaining triangles are preferred, so they do not linger as lone triangles
+        for (int ii = 0; ii < MAX_SCORE_VALENCE; ii++)
+            valence[ii] = ii ? valenceBoostScale * powf( (float)ii, -valenceBoostPower) : 0.0f;
+    }
+
+    float operator() ( int cachePos, int remaining) const {
+        if (remaining == 0)
+            return -1.0f;
+
+        float score = (cachePos >= 0) ? cache[cachePos] : 0.0f;
+        score += (remaining < MAX_SCORE_VALENCE) ? valence[remaining] : 2.0f * powf( (float)remaining, -0.5f);
+        return score;
+    }
+};
+
+//
+// Number of vertices transformed for the indices by a FIFO
+// cache of the given size
+//
+////////////////////////////////////////////////////////////
+static int cacheMisses( const GLuint *indices, int count, int vertexCount, int cacheSize) {
+    //a vertex is cached while fewer than cacheSize misses followed its own
+    vector<int> missed( vertexCount, -cacheSize - 1);
+    int misses = 0;
+
+    for (int ii = 0; ii < count; ii++) {
+        if (misses - missed[indices[ii]] > cacheSize) {
+            missed[indices[ii]] = misses;
+            misses++;
+        }
+    }
+
+    return misses;
+}
+
+//
+// Reorders the triangles for an LRU cache of cacheSize vertices
+//
+////////////////////////////////////////////////////////////
+static void sortForCache( const GLuint *indices, int triCount, int vertexCount, int cacheSize, vector<GLuint> &order) {
+    VertexScore score( cacheSize);
+
+    //active triangles of every vertex
+    vector<int> remaining( vertexCount, 0);
+    for (int ii = 0; ii < triCount * 3; ii++)
+        remaining[indices[ii]]++;
+
+    vector<int> offset( vertexCount + 1, 0);
+    for (int ii = 0; ii < vertexCount; ii++)
+        offset[ii + 1] = offset[ii] + remaining[ii];
+
+    vector<GLuint> vertTris( triCount * 3);
+    {
+        vector<int> fill( offset.begin(), offset.end() - 1);
+        for (int ii = 0; ii < triCount * 3; ii++)
+            vertTris[fill[indices[ii]]++] = ii / 3;
+    }
+
+    vector<int> cachePos( vertexCount, -1);
+    vector<float> vertScore( vertexCount);
+    for (int ii = 0; ii < vertexCount; ii++)
+        vertScore[ii] = score( -1, remaining[ii]);
+
+    vector<float> triScore( triCount);
+    vector<bool> emitted( triCount, false);
+    for (int ii = 0; ii < triCount; ii++)
+        triScore[ii] = vertScore[indices[ii*3]] + vertScore[indices[ii*3 + 1]] + vertScore[indices[ii*3 + 2]];
+
+    //the cache holds up to 3 extra vertices while a triangle is added
+    vector<GLuint> cache, newCache;
+    cache.reserve( cacheSize + 3);
+    newCache.reserve( cacheSize + 3);
+
+    order.clear();
+    order.reserve( triCount);
+
+    int best = (int)(std::max_element( triScore.begin(), triScore.end()) - triScore.begin());
+    int cursor = 0;
+
+    while ((int)order.size() < triCount) {
+        if (best < 0) {
+            //dead end, nothing in the cache has triangles left, continue in input order
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+
+        order.push_back( best);
+        emitted[best] = true;
+
+        const GLuint *tri = &indices[best*3];
+        newCache.clear();
+        for (int jj = 0; jj < 3; jj++) {
+            GLuint v = tri[jj];
+
+            //drop the triangle from the active list of the vertex
+            GLuint *begin = &vertTris[offset[v]];
+            GLuint *end = begin + remaining[v];
+            GLuint *it = std::find( begin, end, (GLuint)best);
+            if (it != end) {
+                *it = *(end - 1);
+                remaining[v]--;
+            }
+
+            if (std::find( newCache.begin(), newCache.end(), v) == newCache.end())
+                newCache.push_back( v);
+        }
+
+        for (int ii = 0; ii < (int)cache.size(); ii++)
+            if (std::find( newCache.begin(), newCache.end(), cache[ii]) == newCache.end())
+                newCache.push_back( cache[ii]);
+
+        //rescore the vertices that moved in the cache, and their triangles
+        for (int ii = 0; ii < (int)newCache.size(); ii++) {
+            GLuint v = newCache[ii];
+            cachePos[v] = (ii < cacheSize) ? ii : -1;
+            vertScore[v] = score( cachePos[v], remaining[v]);
+        }
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (int ii = 0; ii < (int)newCache.size(); ii++) {
+            GLuint v = newCache[ii];
+            for (int kk = 0; kk < remaining[v]; kk++) {
+                GLuint t = vertTris[offset[v] + kk];
+                const GLuint *ti = &indices[t*3];
+                triScore[t] = vertScore[ti[0]] + vertScore[ti[1]] + vertScore[ti[2]];
+                if (triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        if ((int)newCache.size() > cacheSize)
+            newCache.resize( cacheSize);
+        cache.swap( newCache);
+    }
+}
+
+//
+// Splits the cache ordered triangles into clusters where the
+// cache runs dry, and draws the clusters facing outwards from
+// the center of the model first. Those are the most likely to
+// occlude the others, so fewer hidden fragments get shaded.
+//
+////////////////////////////////////////////////////////////
+static void sortForOverdraw( const GLuint *indices, const float *vertices, int vtxSize, int vertexCount, int cacheSize, vector<GLuint> &order) {
+    int triCount = (int)order.size();
+
+    //a triangle missing the cache with all its vertices starts a new cluster
+    vector<int> clusterStart;
+    {
+        vector<int> missed( vertexCount, -cacheSize - 1);
+        int misses = 0;
+        for (int ii = 0; ii < triCount; ii++) {
+            int triMisses = 0;
+            for (int jj = 0; jj < 3; jj++) {
+                GLuint v = indices[order[ii]*3 + jj];
+                if (misses - missed[v] > cacheSize) {
+                    missed[v] = misses;
+                    misses++;
+                    triMisses++;
+                }
+            }
+            if (ii == 0 || triMisses == 3)
+                clusterStart.push_back( ii);
+        }
+        clusterStart.push_back( triCount);
+    }
+
+    int clusterCount = (int)clusterStart.size() - 1;
+    if (clusterCount < 2)
+        return;
+
+    //area weighted centroid and normal of every cluster, and of the model
+    vector<vec3f> centroid( clusterCount, vec3f( 0.0f, 0.0f, 0.0f));
+    vector<vec3f> normal( clusterCount, vec3f( 0.0f, 0.0f, 0.0f));
+    vec3f center( 0.0f, 0.0f, 0.0f);
+    float totalArea = 0.0f;
+
+    for (int cc = 0; cc < clusterCount; cc++) {
+        float area = 0.0f;
+        for (int ii = clusterStart[cc]; ii < clusterStart[cc + 1]; ii++) {
+            const GLuint *tri = &indices[order[ii]*3];
+            vec3f p0( &vertices[tri[0]*vtxSize]);
+            vec3f p1( &vertices[tri[1]*vtxSize]);
+            vec3f p2( &vertices[tri[2]*vtxSize]);
+            vec3f n = cross( p1 - p0, p2 - p0);
+            float a = sqrtf( dot( n, n));
+
+            centroid[cc] += (p0 + p1 + p2) * (a / 3.0f);
+            normal[cc] += n;
+            area += a;
+        }
+
+        center += centroid[cc];
+        totalArea += area;
+        if (area > 0.0f)
+            centroid[cc] /= area;
+    }
+
+    if (totalArea <= 0.0f)
+        return;
+    center /= totalArea;
+
+    vector< std::pair<float, int> > keys( clusterCount);
+    for (int cc = 0; cc < clusterCount; cc++) {
+        float len = sqrtf( dot( normal[cc], normal[cc]));
+        float facing = (len > 0.0f) ? dot( centroid[cc] - center, normal[cc]) / len : 0.0f;
+        keys[cc] = std::make_pair( -facing, cc);
+    }
+    std::stable_sort( keys.begin(), keys.end());
+
+    vector<GLuint> sorted;
+    sorted.reserve( triCount);
+    for (int cc = 0; cc < clusterCount; cc++) {
+        int cluster = keys[cc].second;
+        sorted.insert( sorted.end(), order.begin() + clusterStart[cluster], order.begin() + clusterStart[cluster + 1]);
+    }
+    order.swap( sorted);
+}
+
+//
+// cacheOrder
+//
+//    Triangle order for the vertex cache. Meshes already in a
+//  good order may lose a little as the scoring models an LRU
+//  cache, those keep their order. The cache size is clamped to
+//  what the scoring supports.
+//
+////////////////////////////////////////////////////////////
+void Model::cacheOrder( const GLuint *indices, int triCount, int vertexCount, int cacheSize, vector<GLuint> &order) {
+    cacheSize = std::max( 4, std::min( cacheSize, MAX_SCORE_CACHE_SIZE));
+
+    //a few triangles of a large mesh, like a cluster, are numbered densely so the per vertex data stays small
+    vector<GLuint> dense;
+    if (triCount * 3 < vertexCount / 4) {
+        vector<GLuint> used( indices, indices + triCount * 3);
+        std::sort( used.begin(), used.end());
+        used.erase( std::unique( used.begin(), used.end()), used.end());
+
+        dense.resize( triCount * 3);
+        for (int ii = 0; ii < triCount * 3; ii++)
+            dense[ii] = (GLuint)(std::lower_bound( used.begin(), used.end(), indices[ii]) - used.begin());
+        indices = &dense[0];
+        vertexCount = (int)used.size();
+    }
+
+    sortForCache( indices, triCount, vertexCount, cacheSize, order);
+
+    vector<GLuint> tris( triCount * 3);
+    for (int ii = 0; ii < triCount * 3; ii++)
+        tris[ii] = indices[order[ii / 3]*3 + ii % 3];
+    if (cacheMisses( &tris[0], triCount * 3, vertexCount, cacheSize) > cacheMisses( indices, triCount * 3, vertexCount, cacheSize))
+        for (int ii = 0; ii < triCount; ii++)
+            order[ii] = ii;
+}
+
+//
+// optimizeCompiledModel
+//
+////////////////////////////////////////////////////////////
+void Model::optimizeCompiledModel( int cacheSize, bool sortClusters) {
+    int triCount = (int)_indices[2].size() / 3;
+    int vertexCount = getCompiledVertexCount();
+
+    if (triCount == 0 || vertexCount == 0)
+        return;
+
+    //new triangle order
+    vector<GLuint> order;
+    const GLuint *indices = &_indices[2][0];
+    cacheOrder( indices, triCount, vertexCount, cacheSize, order);
+
+    if (sortClusters)
+        sortForOverdraw( indices, &_vertices[0] + _pOffset, _vtxSize, vertexCount, cacheSize, order);
+
+    reorderTriangles( order);
+}
+
+//
+// reorderTriangles
+//
+////////////////////////////////////////////////////////////
+void Model::reorderTriangles( const vector<GLuint> &order) {
+    int triCount = (int)_indices[2].size() / 3;
+    int vertexCount = getCompiledVertexCount();
+    const GLuint *indices = &_indices[2][0];
+
+    //clusters are ranges of the old order
+    _clusters.clear();
+
+    //the triangle based lists follow the triangles
+    vector<GLuint> tris( triCount * 3);
+    for (int ii = 0; ii < triCount; ii++)
+        for (int jj = 0; jj < 3; jj++)
+            tris[ii*3 + jj] = indices[order[ii]*3 + jj];
+    _indices[2].swap( tris);
+
+    if ((int)_indices[3].size() == triCount * 6) {
+        vector<GLuint> adj( triCount * 6);
+        for (int ii = 0; ii < triCount; ii++)
+            for (int jj = 0; jj < 6; jj++)
+                adj[ii*6 + jj] = _indices[3][order[ii]*6 + jj];
+        _indices[3].swap( adj);
+    }
+
+    //number the vertices in the order the triangles fetch them, unreferenced ones last
+    const GLuint unused = ~0u;
+    vector<GLuint> remap( vertexCount, unused);
+    GLuint next = 0;
+    for (int ii = 0; ii < triCount * 3; ii++) {
+        GLuint &v = remap[_indices[2][ii]];
+        if (v == unused)
+            v = next++;
+    }
+    for (int ii = 0; ii < vertexCount; ii++)
+        if (remap[ii] == unused)
+            remap[ii] = next++;
+
+    vector<float> vertices( _vertices.size());
+    for (int ii = 0; ii < vertexCount; ii++)
+        std::copy( _vertices.begin() + ii * _vtxSize, _vertices.begin() + (ii + 1) * _vtxSize, vertices.begin() + remap[ii] * _vtxSize);
+    _vertices.swap( vertices);
+
+    for (int pp = 0; pp < NumPrimTypes; pp++)
+        for (int ii = 0; ii < (int)_indices[pp].size(); ii++)
+            _indices[pp][ii] = remap[_indices[pp][ii]];
+}
+
+//
+// getCompiledACMR
+//
+////////////////////////////////////////////////////////////
+float Model::getCompiledACMR( int cacheSize) const {
+    int triCount = getCompiledIndexCount( eptTriangles) / 3;
+    if (triCount == 0)
+        return 0.0f;
+
+    return (float)cacheMisses( getCompiledIndices( eptTriangles), triCount * 3, getCompiledVertexCount(), cacheSize) / (float)triCount;
+}
+
+//
+// getCompiledATVR
+//
+////////////////////////////////////////////////////////////
+float Model::getCompiledATVR( int cacheSize) const {
+    int vertexCount = getCompiledVertexCount();
+    int indexCount = getCompiledIndexCount( eptTriangles);
+    if (indexCount == 0 || vertexCount == 0)
+        return 0.0f;
+
+    return (float)cacheMisses( getCompiledIndices( eptTriangles), indexCount, vertexCount, cacheSize) / (float)vertexCount;
+}
+
+};
@@ -0,0 +1,360 @@
+//
+// nvModelPack.cc - Model support class
+//
+// The nvModel class implements an interface for a multipurpose model
+// object. This class is useful for loading and formatting meshes
+// for use by OpenGL. It can compute face normals, tangents, and
+// adjacency information. The class supports the obj file format.
+//
+// This file implements the compressed vertex layouts. Every attribute
+// starts on a 4 byte boundary, so a fully compressed vertex with a
+// normal and a texture coordinate takes 16 bytes instead of 32. It
+// also builds the position only streams for depth passes.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "nvModel.h"
+#include "nvHalf.h"
+
+using std::vector;
+
+namespace nv {
+
+//
+// Quantizes a value in [-1, 1] to a normalized short
+//
+////////////////////////////////////////////////////////////
+static short toSnorm16( float v) {
+    v = std::max( -1.0f, std::min( 1.0f, v));
+    return (short)floorf( v * 32767.0f + 0.5f);
+}
+
+//
+// Octahedral encoding of a direction, the decoding is
+//
+//    n = (e.x, e.y, 1 - |e.x| - |e.y|)
+//    if (n.z < 0) n.xy = (1 - |n.yx|) * sign(n.xy)
+//    n = normalize(n)
+//
+////////////////////////////////////////////////////////////
+static void octEncode( const float *n, short *e) {
+    float l1 = fabsf( n[0]) + fabsf( n[1]) + fabsf( n[2]);
+    if (l1 <= 0.0f) {
+        e[0] = e[1] = 0;
+        return;
+    }
+
+    float x = n[0] / l1;
+    float y = n[1] / l1;
+    if (n[2] < 0.0f) {
+        float ox = (1.0f - fabsf( y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float oy = (1.0f - fabsf( x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = ox;
+        y = oy;
+    }
+
+    e[0] = toSnorm16( x);
+    e[1] = toSnorm16( y);
+}
+
+//
+// Number of floats of a compiled attribute, the attributes are
+// stored in the order of the Attrib enumeration
+//
+////////////////////////////////////////////////////////////
+static int attribFloats( const int *offsets, int count, int attrib, int vtxSize) {
+    if (offsets[attrib] < 0)
+        return 0;
+
+    for (int ii = attrib + 1; ii < count; ii++)
+        if (offsets[ii] >= 0)
+            return offsets[ii] - offsets[attrib];
+
+    return vtxSize - offsets[attrib];
+}
+
+//
+// packCompiledModel
+//
+////////////////////////////////////////////////////////////
+void Model::packCompiledModel( int format) {
+    const int offsets[NumAttribs] = { _pOffset, _nOffset, _tcOffset, _sTanOffset, _cOffset };
+    int floats[NumAttribs];
+    for (int ii = 0; ii < NumAttribs; ii++)
+        floats[ii] = attribFloats( offsets, NumAttribs, ii, _vtxSize);
+
+    //a 4th position component is dropped by the quantized layout, it is always 1 in practice
+    bool position16 = (format & evfPosition16) && floats[eaPosition] >= 3;
+    bool normalOct = (format & evfNormalOct) && floats[eaNormal] == 3;
+    bool texCoordHalf = (format & evfTexCoordHalf) != 0;
+    bool tangentOct = (format & evfTangentOct) && floats[eaTangent] == 3;
+    bool color8 = (format & evfColor8) != 0;
+
+    //attribute layout
+    _packedSize = 0;
+    for (int ii = 0; ii < NumAttribs; ii++) {
+        VertexAttrib &a = _packedAttribs[ii];
+        a.size = floats[ii];
+        a.type = GL_FLOAT;
+        a.normalized = GL_FALSE;
+        a.offset = _packedSize;
+
+        int bytes = a.size * sizeof(float);
+        if (ii == eaPosition && position16) {
+            a.size = 3;
+            a.type = GL_SHORT;
+            bytes = 8;
+        }
+        else if ((ii == eaNormal && normalOct) || (ii == eaTangent && tangentOct)) {
+            a.size = 2;
+            a.type = GL_SHORT;
+            a.normalized = GL_TRUE;
+            bytes = 4;
+        }
+        else if (ii == eaTexCoord && texCoordHalf && a.size) {
+            a.type = GL_HALF_FLOAT;
+            bytes = (a.size * 2 + 3) & ~3;
+        }
+        else if (ii == eaColor && color8 && a.size) {
+            a.type = GL_UNSIGNED_BYTE;
+            a.normalized = GL_TRUE;
+            bytes = 4;
+        }
+
+        if (a.size == 0)
+            bytes = 0;
+        _packedSize += bytes;
+    }
+
+    //positions are stored relative to the center of the bounding box
+    int vertexCount = getCompiledVertexCount();
+    const float *vtx = getCompiledVertices();
+
+    _packedScale = vec3f( 1.0f, 1.0f, 1.0f);
+    _packedBias = vec3f( 0.0f, 0.0f, 0.0f);
+    if (position16 && vertexCount > 0) {
+        vec3f minVal( &vtx[_pOffset]), maxVal( &vtx[_pOffset]);
+        for (int ii = 1; ii < vertexCount; ii++) {
+            vec3f p( &vtx[ii * _vtxSize + _pOffset]);
+            minVal = min( minVal, p);
+            maxVal = max( maxVal, p);
+        }
+
+        _packedBias = (minVal + maxVal) * 0.5f;
+        for (int jj = 0; jj < 3; jj++) {
+            float extent = (maxVal[jj] - minVal[jj]) * 0.5f;
+            _packedScale[jj] = (extent > 0.0f) ? extent / 32767.0f : 1.0f;
+        }
+    }
+
+    _packed.assign( (size_t)vertexCount * _packedSize, 0);
+
+    for (int ii = 0; ii < vertexCount; ii++, vtx += _vtxSize) {
+        unsigned char *dst = _packed.empty() ? 0 : &_packed[(size_t)ii * _packedSize];
+
+        for (int aa = 0; aa < NumAttribs; aa++) {
+            const VertexAttrib &a = _packedAttribs[aa];
+            if (a.size == 0)
+                continue;
+
+            const float *src = vtx + offsets[aa];
+            unsigned char *out = dst + a.offset;
+
+            if (aa == eaPosition && position16) {
+                short q[3];
+                for (int jj = 0; jj < 3; jj++) {
+                    float v = (src[jj] - _packedBias[jj]) / _packedScale[jj];
+                    q[jj] = (short)std::max( -32767.0f, std::min( 32767.0f, floorf( v + 0.5f)));
+                }
+                memcpy( out, q, sizeof(q));
+            }
+            else if (a.type == GL_SHORT) {
+                short e[2];
+                octEncode( src, e);
+                memcpy( out, e, sizeof(e));
+            }
+            else if (a.type == GL_HALF_FLOAT) {
+                for (int jj = 0; jj < a.size; jj++) {
+                    unsigned short h = floatToHalf( src[jj], false);
+                    memcpy( out + jj * sizeof(h), &h, sizeof(h));
+                }
+            }
+            else if (a.type == GL_UNSIGNED_BYTE) {
+                //missing alpha is opaque
+                for (int jj = 0; jj < 4; jj++) {
+                    float v = (jj < a.size) ? src[jj] : 1.0f;
+                    out[jj] = (unsigned char)floorf( std::max( 0.0f, std::min( 1.0f, v)) * 255.0f + 0.5f);
+                }
+            }
+            else {
+                memcpy( out, src, a.size * sizeof(float));
+            }
+        }
+    }
+
+    //colors always have 4 components once packed
+    if (color8 && _packedAttribs[eaColor].size)
+        _packedAttribs[eaColor].size = 4;
+}
+
+//
+// packDepthStream
+//
+////////////////////////////////////////////////////////////
+void Model::packDepthStream( int cacheSize) {
+    if (_packedSize == 0)
+        packCompiledModel( evfFloat);
+
+    const VertexAttrib &position = _packedAttribs[eaPosition];
+    _depthSize = (position.type == GL_SHORT) ? 8 : position.size * (int)sizeof(float);
+
+    int vertexCount = getCompiledVertexCount();
+    int indexCount = getCompiledIndexCount( eptTriangles);
+    const GLuint *indices = getCompiledIndices( eptTriangles);
+
+    _depthVertices.clear();
+    _depthVertices.reserve( (size_t)vertexCount * _depthSize);
+    _depthIndices.resize( indexCount);
+
+    //open addressing table of the depth vertices by position, filled in the order of first use
+    GLuint mask = 15;
+    while (mask < (GLuint)vertexCount * 2)
+        mask = mask * 2 + 1;
+    vector<GLuint> slots( mask + 1, ~0u);
+
+    //every compiled vertex maps to the same depth vertex, so it is looked up only once
+    vector<GLuint> remap( vertexCount, ~0u);
+
+    for (int ii = 0; ii < indexCount; ii++) {
+        GLuint vertex = indices[ii];
+        if (remap[vertex] == ~0u) {
+            const unsigned char *key = &_packed[(size_t)vertex * _packedSize + position.offset];
+            GLuint slot = (GLuint)hashData( key, _depthSize) & mask;
+
+            while (slots[slot] != ~0u && memcmp( &_depthVertices[(size_t)slots[slot] * _depthSize], key, _depthSize))
+                slot = (slot + 1) & mask;
+
+            if (slots[slot] == ~0u) {
+                slots[slot] = (GLuint)(_depthVertices.size() / _depthSize);
+                _depthVertices.insert( _depthVertices.end(), key, key + _depthSize);
+            }
+            remap[vertex] = slots[slot];
+        }
+        _depthIndices[ii] = remap[vertex];
+    }
+
+    //merged vertices are shared by more triangles, which deserves another cache order
+    int triCount = indexCount / 3;
+    int depthCount = getDepthVertexCount();
+    if (triCount == 0)
+        return;
+
+    vector<GLuint> order;
+    int clusterCount = getClusterCount();
+    if (clusterCount > 0) {
+        //the clusters keep their triangle ranges, each one is ordered on its own
+        const Cluster *clusters = getClusters();
+        vector<GLuint> part;
+        order.reserve( triCount);
+        for (int cc = 0; cc < clusterCount; cc++) {
+            GLuint first = clusters[cc].firstIndex / 3;
+            cacheOrder( &_depthIndices[first*3], clusters[cc].indexCount / 3, depthCount, cacheSize, part);
+            for (int ii = 0; ii < (int)part.size(); ii++)
+                order.push_back( first + part[ii]);
+        }
+    }
+    else {
+        cacheOrder( &_depthIndices[0], triCount, depthCount, cacheSize, order);
+    }
+
+    //renumber the depth vertices in the new order of first use
+    vector<GLuint> tris( triCount * 3);
+    vector<GLuint> renumber( depthCount, ~0u);
+    vector<unsigned char> sorted( _depthVertices.size());
+    GLuint next = 0;
+    for (int ii = 0; ii < triCount * 3; ii++) {
+        GLuint vertex = _depthIndices[order[ii / 3]*3 + ii % 3];
+        if (renumber[vertex] == ~0u) {
+            memcpy( &sorted[(size_t)next * _depthSize], &_depthVertices[(size_t)vertex * _depthSize], _depthSize);
+            renumber[vertex] = next++;
+        }
+        tris[ii] = renumber[vertex];
+    }
+    _depthIndices.swap( tris);
+    _depthVertices.swap( sorted);
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+const void* Model::getPackedVertices() const {
+    return _packed.empty() ? 0 : &_packed[0];
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+int Model::getPackedVertexSize() const {
+    return _packedSize;
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+const Model::VertexAttrib& Model::getPackedAttrib( Model::Attrib attrib) const {
+    return _packedAttribs[attrib];
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+void Model::getPackedPositionTransform( vec3f &scale, vec3f &bias) const {
+    scale = _packedScale;
+    bias = _packedBias;
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+const void* Model::getDepthVertices() const {
+    return _depthVertices.empty() ? 0 : &_depthVertices[0];
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+const GLuint* Model::getDepthIndices() const {
+    return _depthIndices.empty() ? 0 : &_depthIndices[0];
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+int Model::getDepthVertexSize() const {
+    return _depthSize;
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+int Model::getDepthVertexCount() const {
+    return (_depthSize > 0) ? (int)(_depthVertices.size() / _depthSize) : 0;
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+int Model::getDepthIndexCount() const {
+    return (int)_depthIndices.size();
+}
+
+};
@@ -210,6 +210,8 @@ int Model::getIndexCount() const {
 //
 ////////////////////////////////////////////////////////////
 const float* Model::getCompiledVertices() const {
+    if (_cacheFile)
+        return _cacheVertices;
     return (_vertices.size() > 0) ? &_vertices[0] : 0;
 }
 
@@ -217,6 +219,21 @@ const float* Model::getCompiledVertices() const {
 //
 ////////////////////////////////////////////////////////////
 const GLuint* Model::getCompiledIndices( Model::PrimType prim) const {
+    if (_cacheFile) {
+        switch (prim) {
+            case Model::eptPoints:
+                return _cacheIndices[0];
+            case Model::eptEdges:
+                return _cacheIndices[1];
+            case Model::eptTriangles:
+                return _cacheIndices[2];
+            case Model::eptTrianglesWithAdjacency:
+                return _cacheIndices[3];
+            default:
+                return 0;
+        }
+    }
+
     switch (prim) {
         case Model::eptPoints:
             return (_indices[0].size() > 0) ? &_indices[0][0] : 0;
@@ -278,6 +295,8 @@ int Model::getCompiledVertexSize() const {
 //
 ////////////////////////////////////////////////////////////
 int Model::getCompiledVertexCount() const {
+    if (_cacheFile)
+        return _cacheVertexCount;
     return (_vtxSize > 0) ? (int)_vertices.size() / _vtxSize : 0;
 }
 
@@ -285,6 +304,21 @@ int Model::getCompiledVertexCount() const {
 //
 ////////////////////////////////////////////////////////////
 int Model::getCompiledIndexCount( Model::PrimType prim) const {
+    if (_cacheFile) {
+        switch (prim) {
+            case Model::eptPoints:
+                return _cacheIndexCount[0];
+            case Model::eptEdges:
+                return _cacheIndexCount[1];
+            case Model::eptTriangles:
+                return _cacheIndexCount[2];
+            case Model::eptTrianglesWithAdjacency:
+                return _cacheIndexCount[3];
+            default:
+                return 0;
+        }
+    }
+
     switch (prim) {
         case Model::eptPoints:
             return (int)_indices[0].size();
@@ -306,4 +340,38 @@ int Model::getOpenEdgeCount() const {
     return _openEdges;
 }
 
-};
\ No newline at end of file
+//
+//
+////////////////////////////////////////////////////////////
+const Model::Cluster* Model::getClusters() const {
+    if (_cacheFile)
+        return _cacheClusters;
+    return (_clusters.size() > 0) ? &_clusters[0] : 0;
+}
+
+//
+//
+////////////////////////////////////////////////////////////
+int Model::getClusterCount() const {
+    if (_cacheFile)
+        return _cacheClusterCount;
+    return (int)_clusters.size();
+}
+
+//
+// isClusterBackfacing
+//
+////////////////////////////////////////////////////////////
+bool Model::isClusterBackfacing( int cluster, const vec3f &view, bool directional) const {
+    const Cluster &c = getClusters()[cluster];
+
+    //the cone is too wide, some triangle always faces the viewer
+    if (c.coneCutoff >= 1.0f)
+        return false;
+
+    vec3f dir = directional ? view : c.coneApex - view;
+    float len = sqrtf( dot( dir, dir));
+    return len > 0.0f && dot( dir, c.coneAxis) >= c.coneCutoff * len;
+}
+
+};
\ No newline at end of file
@@ -0,0 +1,302 @@
+//
+// nvModelSimplify.cc - Model support class
+//
+// The nvModel class implements an interface for a multipurpose model
+// object. This class is useful for loading and formatting meshes
+// for use by OpenGL. It can compute face normals, tangents, and
+// adjacency information. The class supports the obj file format.
+//
+// This file implements the mesh simplification. It is a quadric error
+// metric edge collapse decimator (Garland/Heckbert) working on the raw
+// data, so it can be run on a loaded model before compileModel.
+//
+// Email: sdkfeedback@nvidia.com
+//
+// Copyright (c) NVIDIA Corporation. All rights reserved.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+
+#include "nvModel.h"
+
+using std::vector;
+
+namespace nv {
+
+//
+// Symmetric 4x4 error quadric, stores the upper triangle
+//
+////////////////////////////////////////////////////////////
+struct Quadric {
+    double a[10];
+
+    Quadric() {
+        for (int ii = 0; ii < 10; ii++)
+            a[ii] = 0.0;
+    }
+
+    // quadric of the plane n.p + d = 0, scaled by a weight
+    void addPlane( double nx, double ny, double nz, double d, double w) {
+        a[0] += w*nx*nx; a[1] += w*nx*ny; a[2] += w*nx*nz; a[3] += w*nx*d;
+                         a[4] += w*ny*ny; a[5] += w*ny*nz; a[6] += w*ny*d;
+                                          a[7] += w*nz*nz; a[8] += w*nz*d;
+                                                           a[9] += w*d*d;
+    }
+
+    void add( const Quadric &q) {
+        for (int ii = 0; ii < 10; ii++)
+            a[ii] += q.a[ii];
+    }
+
+    // squared distance sum of the point to all accumulated planes
+    double error( const float *p) const {
+        double x = p[0], y = p[1], z = p[2];
+        return a[0]*x*x + 2.0*a[1]*x*y + 2.0*a[2]*x*z + 2.0*a[3]*x
+                        +     a[4]*y*y + 2.0*a[5]*y*z + 2.0*a[6]*y
+                                       +     a[7]*z*z + 2.0*a[8]*z
+                                                      +     a[9];
+    }
+};
+
+//
+// Candidate collapse of position 'from' onto position 'to'
+//
+////////////////////////////////////////////////////////////
+struct Collapse {
+    double cost;
+    GLuint from, to;
+    GLuint fromStamp, toStamp;
+
+    bool operator< ( const Collapse &c) const {
+        // std::priority_queue is a max heap
+        return cost > c.cost;
+    }
+};
+
+//
+//
+////////////////////////////////////////////////////////////
+static void faceNormal( const float *p0, const float *p1, const float *p2, vec3f &n) {
+    vec3f e0( p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]);
+    vec3f e1( p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]);
+    n = cross( e0, e1);
+}
+
+//
+// Queues both directions of every edge around a position
+//
+////////////////////////////////////////////////////////////
+static void pushCollapses( GLuint p, const vector<GLuint> &index, const vector<bool> &triAlive, const vector< vector<GLuint> > &posTris,
+                           const vector<Quadric> &quadrics, const vector<GLuint> &stamp, const vector<float> &positions, int posSize,
+                           std::priority_queue<Collapse> &heap) {
+    const vector<GLuint> &tris = posTris[p];
+    for (int ii = 0; ii < (int)tris.size(); ii++) {
+        if (!triAlive[tris[ii]])
+            continue;
+        for (int jj = 0; jj < 3; jj++) {
+            GLuint q = index[tris[ii]*3 + jj];
+            if (q == p)
+                continue;
+
+            Quadric sum = quadrics[p];
+            sum.add( quadrics[q]);
+
+            Collapse c;
+            c.from = p; c.to = q;
+            c.fromStamp = stamp[p]; c.toStamp = stamp[q];
+            c.cost = sum.error( &positions[q * posSize]);
+            heap.push(c);
+
+            c.from = q; c.to = p;
+            c.fromStamp = stamp[q]; c.toStamp = stamp[p];
+            c.cost = sum.error( &positions[p * posSize]);
+            heap.push(c);
+        }
+    }
+}
+
+//
+// simplify
+//
+//    Collapses edges in the order of increasing quadric error
+//  until only ratio * triangles remain. Collapses only move a
+//  position onto one of its neighbours (half edge collapse), so
+//  the remaining positions, normals and texture coordinates stay
+//  valid and are shared with the original mesh. Open edges get
+//  an additional perpendicular plane, which keeps the outline of
+//  leaf cards and other open surfaces.
+//
+////////////////////////////////////////////////////////////
+int Model::simplify( float ratio) {
+    int triCount = (int)_pIndex.size() / 3;
+    int posCount = getPositionCount();
+    int target = std::max( 1, (int)(ratio * (float)triCount));
+
+    if (target >= triCount || _posSize < 3)
+        return triCount;
+
+    vector<GLuint> index( _pIndex);
+    vector<bool> triAlive( triCount, true);
+    vector<bool> posAlive( posCount, true);
+    vector<GLuint> stamp( posCount, 0);
+    vector<Quadric> quadrics( posCount);
+
+    // triangles around every position
+    vector< vector<GLuint> > posTris( posCount);
+    for (int ii = 0; ii < triCount; ii++)
+        for (int jj = 0; jj < 3; jj++)
+            posTris[index[ii*3 + jj]].push_back(ii);
+
+    // accumulate the area weighted face planes
+    for (int ii = 0; ii < triCount; ii++) {
+        const float *p0 = &_positions[index[ii*3 + 0] * _posSize];
+        const float *p1 = &_positions[index[ii*3 + 1] * _posSize];
+        const float *p2 = &_positions[index[ii*3 + 2] * _posSize];
+
+        vec3f n;
+        faceNormal( p0, p1, p2, n);
+        float area = sqrtf( dot( n, n));
+        if (area <= 0.0f)
+            continue;
+        n /= area;
+
+        double d = -(n.x*p0[0] + n.y*p0[1] + n.z*p0[2]);
+        for (int jj = 0; jj < 3; jj++)
+            quadrics[index[ii*3 + jj]].addPlane( n.x, n.y, n.z, d, area);
+    }
+
+    // open edges are the ones used by a single triangle, they get a plane
+    // perpendicular to the face through the edge
+    for (int ii = 0; ii < triCount; ii++) {
+        for (int jj = 0; jj < 3; jj++) {
+            GLuint a = index[ii*3 + jj];
+            GLuint b = index[ii*3 + (jj + 1) % 3];
+
+            int shared = 0;
+            const vector<GLuint> &tris = posTris[a];
+            for (int kk = 0; kk < (int)tris.size(); kk++) {
+                const GLuint *t = &index[tris[kk]*3];
+                if (t[0] == b || t[1] == b || t[2] == b)
+                    shared++;
+            }
+            if (shared != 1)
+                continue;
+
+            const float *pa = &_positions[a * _posSize];
+            const float *pb = &_positions[b * _posSize];
+            vec3f n;
+            faceNormal( &_positions[index[ii*3] * _posSize], &_positions[index[ii*3 + 1] * _posSize], &_positions[index[ii*3 + 2] * _posSize], n);
+            vec3f e( pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]);
+            vec3f m = cross( e, n);
+            float len = sqrtf( dot( m, m));
+            if (len <= 0.0f)
+                continue;
+            m /= len;
+
+            double d = -(m.x*pa[0] + m.y*pa[1] + m.z*pa[2]);
+            double w = 10.0 * dot( e, e);
+            quadrics[a].addPlane( m.x, m.y, m.z, d, w);
+            quadrics[b].addPlane( m.x, m.y, m.z, d, w);
+        }
+    }
+
+    std::priority_queue<Collapse> heap;
+
+    for (int ii = 0; ii < posCount; ii++)
+        pushCollapses( ii, index, triAlive, posTris, quadrics, stamp, _positions, _posSize, heap);
+
+    int alive = triCount;
+    while (alive > target && !heap.empty()) {
+        Collapse c = heap.top();
+        heap.pop();
+
+        // stale entry, one of the endpoints changed since it was queued
+        if (!posAlive[c.from] || !posAlive[c.to] || stamp[c.from] != c.fromStamp || stamp[c.to] != c.toStamp)
+            continue;
+
+        // reject collapses that flip a surviving triangle
+        const float *pTo = &_positions[c.to * _posSize];
+        const vector<GLuint> &tris = posTris[c.from];
+        bool flips = false;
+        for (int ii = 0; ii < (int)tris.size() && !flips; ii++) {
+            if (!triAlive[tris[ii]])
+                continue;
+            const GLuint *t = &index[tris[ii]*3];
+            if (t[0] == c.to || t[1] == c.to || t[2] == c.to)
+                continue;
+
+            const float *p[3], *q[3];
+            for (int jj = 0; jj < 3; jj++) {
+                p[jj] = &_positions[t[jj] * _posSize];
+                q[jj] = (t[jj] == c.from) ? pTo : p[jj];
+            }
+            vec3f n0, n1;
+            faceNormal( p[0], p[1], p[2], n0);
+            faceNormal( q[0], q[1], q[2], n1);
+            flips = dot( n0, n1) <= 0.0f;
+        }
+        if (flips)
+            continue;
+
+        // move all triangles of 'from' onto 'to', the ones sharing the edge collapse
+        for (int ii = 0; ii < (int)tris.size(); ii++) {
+            GLuint tri = tris[ii];
+            if (!triAlive[tri])
+                continue;
+            GLuint *t = &index[tri*3];
+            if (t[0] == c.to || t[1] == c.to || t[2] == c.to) {
+                triAlive[tri] = false;
+                alive--;
+                continue;
+            }
+            for (int jj = 0; jj < 3; jj++)
+                if (t[jj] == c.from)
+                    t[jj] = c.to;
+            posTris[c.to].push_back(tri);
+        }
+
+        posAlive[c.from] = false;
+        posTris[c.from].clear();
+        quadrics[c.to].add( quadrics[c.from]);
+        stamp[c.to]++;
+
+        pushCollapses( c.to, index, triAlive, posTris, quadrics, stamp, _positions, _posSize, heap);
+    }
+
+    // compact the index lists, all attribute indices of a corner stay together
+    int dst = 0;
+    for (int ii = 0; ii < triCount; ii++) {
+        if (!triAlive[ii])
+            continue;
+        for (int jj = 0; jj < 3; jj++) {
+            _pIndex[dst*3 + jj] = index[ii*3 + jj];
+            if (hasNormals())
+                _nIndex[dst*3 + jj] = _nIndex[ii*3 + jj];
+            if (hasTexCoords())
+                _tIndex[dst*3 + jj] = _tIndex[ii*3 + jj];
+            if (hasTangents())
+                _tanIndex[dst*3 + jj] = _tanIndex[ii*3 + jj];
+            if (hasColors())
+                _cIndex[dst*3 + jj] = _cIndex[ii*3 + jj];
+        }
+        dst++;
+    }
+
+    _pIndex.resize( dst*3);
+    if (hasNormals())
+        _nIndex.resize( dst*3);
+    if (hasTexCoords())
+        _tIndex.resize( dst*3);
+    if (hasTangents())
+        _tanIndex.resize( dst*3);
+    if (hasColors())
+        _cIndex.resize( dst*3);
+
+    return dst;
+}
+
+};
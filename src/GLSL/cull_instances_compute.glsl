@@ -0,0 +1,79 @@
+//----------------------------------------------------------------------------------
+// File:   cull_instances_compute.glsl
+// Culls instance bounding spheres against the six clip planes of one view and
+// appends the visible ones to the compacted instance list of their level of
+// detail. The instance counts of the DrawElementsIndirect commands are
+// incremented in the same pass.
+// The CPU version of this kernel is GKR::InstanceCuller::cull_cpu().
+//----------------------------------------------------------------------------------
+#version 430
+
+// must match GKR::InstanceCuller
+#define MAX_LODS 3
+#define MAX_MESHES 2
+
+layout(local_size_x = 64) in;
+
+struct DrawCommand {
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  uint baseVertex;
+  uint baseInstance;
+};
+
+// xyz = center, w = radius
+layout(std430, binding = 0) readonly buffer Spheres {
+  vec4 spheres[];
+};
+
+// xyz = translation, w = scale (the "instance" vertex attribute),
+// one range of instanceCount entries per level of detail
+layout(std430, binding = 1) writeonly buffer Visible {
+  vec4 visible[];
+};
+
+// MAX_MESHES commands per level of detail, their baseInstance selects the range
+layout(std430, binding = 2) buffer Commands {
+  DrawCommand commands[MAX_LODS * MAX_MESHES];
+};
+
+uniform vec4 planes[6];
+uniform uint instanceCount;
+
+// the level of detail of an instance is the number of distances it is beyond,
+// measured from eye and scaled by lodScale
+uniform vec3 eye;
+uniform float lodScale;
+uniform float lodDistances[MAX_LODS - 1];
+uniform uint maxLod;
+
+void main() {
+  uint id = gl_GlobalInvocationID.x;
+  if(id >= instanceCount) {
+    return;
+  }
+
+  vec4 sphere = spheres[id];
+  for(int i = 0 ; i < 6 ; i++) {
+    if(dot(planes[i].xyz, sphere.xyz) + planes[i].w < -sphere.w) {
+      return;
+    }
+  }
+
+  float d = distance(sphere.xyz, eye) * lodScale;
+  uint lod = 0u;
+  for(int i = 0 ; i < MAX_LODS - 1 ; i++) {
+    if(d >= lodDistances[i]) {
+      lod = uint(i + 1);
+    }
+  }
+  lod = min(lod, maxLod);
+
+  uint first = lod * uint(MAX_MESHES);
+  uint slot = atomicAdd(commands[first].instanceCount, 1u);
+  for(uint m = 1u ; m < uint(MAX_MESHES) ; m++) {
+    atomicAdd(commands[first + m].instanceCount, 1u);
+  }
+  visible[lod * instanceCount + slot] = vec4(sphere.xyz, 1.0);
+}
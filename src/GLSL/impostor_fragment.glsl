@@ -0,0 +1,19 @@
+//----------------------------------------------------------------------------------
+// File:   impostor_fragment.glsl
+// Billboard impostors of distant trees, alpha tested against the baked tree image
+//----------------------------------------------------------------------------------
+#version 120
+
+uniform sampler2D impostor;
+
+varying vec4 position;
+
+void main() {
+  const float shadow_ambient = 0.9;
+  vec4 color_tex = texture2D(impostor, gl_TexCoord[0].st);
+  if(color_tex.a < 0.5) {
+    discard;
+  }
+  float fog = clamp(gl_Fog.scale*(gl_Fog.end + position.z), 0.0, 1.0);
+  gl_FragColor = mix(gl_Fog.color, (shadow_ambient * gl_Color * color_tex + (1.0 - shadow_ambient) * color_tex), fog);
+}
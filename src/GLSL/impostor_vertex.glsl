@@ -0,0 +1,31 @@
+//----------------------------------------------------------------------------------
+// File:   impostor_vertex.glsl
+// Billboard impostors of distant trees. The quad (in model units around the base
+// point of the tree) turns around the vertical axis of the tree to face the viewer.
+//----------------------------------------------------------------------------------
+
+varying vec4 position;
+
+uniform vec4 lightdir;
+uniform vec4 lightcolor;
+
+uniform mat4 modelViewMatrix;
+uniform mat4 projectionMatrix;
+
+// per-instance placement (xyz = translation, w = uniform scale)
+attribute vec4 instance;
+
+void main() {
+  vec3 base = (modelViewMatrix * vec4(instance.xyz, 1.0)).xyz;
+  vec3 up = normalize((modelViewMatrix * vec4(0.0, 1.0, 0.0, 0.0)).xyz);
+  vec3 right = normalize(cross(up, -base));
+
+  vec2 offset = gl_Vertex.xy * instance.w;
+  position = vec4(base + right * offset.x + up * offset.y, 1.0);
+  gl_Position = projectionMatrix * position;
+
+  // the canopy is mostly lit from above
+  gl_FrontColor = lightcolor * vec4(max(dot(up, lightdir.xyz), 0.0));
+
+  gl_TexCoord[0] = gl_MultiTexCoord0;
+}
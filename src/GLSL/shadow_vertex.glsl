@@ -14,12 +14,33 @@ uniform mat3 normalMatrix;
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
 
+// per-instance placement (xyz = translation, w = uniform scale). When the
+// array is disabled the current value (0, 0, 0, 1) leaves vertices untouched.
+attribute vec4 instance;
+
+// compressed meshes: positions are quantized in the bounding box of the mesh and
+// the normals come octahedral encoded in normalOct instead of gl_Normal
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+uniform bool octNormals;
+attribute vec2 normalOct;
+
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if(n.z < 0.0) {
+    vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    n.xy = (1.0 - abs(n.yx)) * s;
+  }
+  return n;
+}
+
 void main() {
-  position = modelViewMatrix * gl_Vertex;
+  vec3 vertex = gl_Vertex.xyz * positionScale + positionBias;
+  position = modelViewMatrix * vec4(vertex * instance.w + instance.xyz, 1.0);
   gl_Position = projectionMatrix * position;
-  vec3 normal = normalize(normalMatrix * gl_Normal);
+  vec3 normal = normalize(normalMatrix * (octNormals ? octDecode(normalOct) : gl_Normal));
 
   gl_FrontColor = gl_Color * lightcolor * vec4(max(dot(normal, lightdir.xyz), 0.0));
 
   gl_TexCoord[0] = gl_MultiTexCoord0;
-}
\ No newline at end of file
+}
\ No newline at end of file
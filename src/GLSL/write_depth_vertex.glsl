@@ -9,7 +9,15 @@ uniform mat3 normalMatrix;
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
 
+// per-instance placement (xyz = translation, w = uniform scale)
+attribute vec4 instance;
+
+// quantized positions of compressed meshes, scale 1 and bias 0 otherwise
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+
 void main() {
-  vec4 position = projectionMatrix * modelViewMatrix * gl_Vertex;
+  vec3 vertex = gl_Vertex.xyz * positionScale + positionBias;
+  vec4 position = projectionMatrix * modelViewMatrix * vec4(vertex * instance.w + instance.xyz, 1.0);
   gl_Position = position;
 }
@@ -0,0 +1,91 @@
+#include <asset_loader.hpp>
+
+/** */
+namespace GKR {
+
+/** */
+AssetLoader::AssetLoader(unsigned int t_threads) :
+    m_pending(0),
+    m_stop(false) {
+  if(t_threads == 0) {
+    t_threads = std::thread::hardware_concurrency();
+  }
+  if(t_threads == 0) {
+    t_threads = 1;
+  }
+
+  for(unsigned int i = 0; i < t_threads; i++) {
+    m_workers.push_back(std::thread(&AssetLoader::work, this));
+  }
+}
+
+/** */
+AssetLoader::~AssetLoader() {
+  {
+    std::lock_guard<std::mutex> t_lock(m_mutex);
+    m_stop = true;
+  }
+  m_job_queued.notify_all();
+
+  for(size_t i = 0; i < m_workers.size(); i++) {
+    m_workers[i].join();
+  }
+}
+
+/** the workers take the jobs in the order they were submitted, until the loader stops and the queue is empty */
+void AssetLoader::work() {
+  std::unique_lock<std::mutex> t_lock(m_mutex);
+  for(;;) {
+    m_job_queued.wait(t_lock, [this]() { return m_stop || !m_jobs.empty(); });
+    if(m_jobs.empty()) {
+      return;
+    }
+
+    std::function<void()> t_job = m_jobs.front();
+    m_jobs.pop_front();
+
+    t_lock.unlock();
+    t_job();
+    t_lock.lock();
+
+    // the job's future is ready and its uploads are queued before anyone is woken
+    m_pending--;
+    m_progress.notify_all();
+  }
+}
+
+/** */
+void AssetLoader::upload(const std::function<void()>& t_upload) {
+  {
+    std::lock_guard<std::mutex> t_lock(m_mutex);
+    m_uploads.push_back(t_upload);
+  }
+  m_progress.notify_all();
+}
+
+/** t_done is checked with the lock held, right after the upload queue was emptied */
+void AssetLoader::run_uploads_until(const std::function<bool()>& t_done) {
+  std::unique_lock<std::mutex> t_lock(m_mutex);
+  for(;;) {
+    while(!m_uploads.empty()) {
+      std::function<void()> t_upload = m_uploads.front();
+      m_uploads.pop_front();
+
+      t_lock.unlock();
+      t_upload();
+      t_lock.lock();
+    }
+
+    if(t_done()) {
+      return;
+    }
+    m_progress.wait(t_lock);
+  }
+}
+
+/** */
+void AssetLoader::finish() {
+  run_uploads_until([this]() { return m_pending == 0; });
+}
+
+}
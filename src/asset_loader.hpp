@@ -0,0 +1,95 @@
+#ifndef GKR_ASSET_LOADER_HPP
+#define GKR_ASSET_LOADER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/** */
+namespace GKR {
+
+/**
+ * Job queue for loading the assets at startup.
+ *
+ * Jobs like image decoding, OBJ parsing and model compilation run on a pool of worker
+ * threads and hand back futures. GL calls have to stay on the thread that owns the context,
+ * so jobs queue their uploads with upload() and the context thread runs them in wait()
+ * and finish(), as soon as they arrive.
+ */
+class AssetLoader {
+private:
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()> > m_jobs;
+  std::deque<std::function<void()> > m_uploads;
+
+  /** Jobs queued or running */
+  unsigned int m_pending;
+  bool m_stop;
+
+  std::mutex m_mutex;
+  std::condition_variable m_job_queued;
+  /** Signalled whenever a job finishes or an upload is queued */
+  std::condition_variable m_progress;
+
+  void work();
+  void run_uploads_until(const std::function<bool()>& t_done);
+
+public:
+  /** Starts the workers, one per hardware thread by default */
+  explicit AssetLoader(unsigned int t_threads = 0);
+  /** Lets the workers finish the queued jobs, uploads that were never run are dropped */
+  ~AssetLoader();
+
+  /** Runs a job on a worker, the future returns its result */
+  template<class F>
+  std::future<typename std::result_of<F()>::type> submit(F t_job);
+
+  /** Queues work that needs the GL context, safe to call from the jobs */
+  void upload(const std::function<void()>& t_upload);
+
+  /** Waits for a job on the context thread, running the uploads that arrive meanwhile */
+  template<class T>
+  T wait(std::future<T>& t_future);
+
+  /** Waits for all jobs on the context thread and runs all of their uploads */
+  void finish();
+};
+
+/** */
+template<class F>
+std::future<typename std::result_of<F()>::type> AssetLoader::submit(F t_job) {
+  typedef typename std::result_of<F()>::type result_type;
+
+  // std::function needs a copyable target, the task itself is move only
+  std::shared_ptr<std::packaged_task<result_type()> > t_task(new std::packaged_task<result_type()>(t_job));
+  std::future<result_type> t_future = t_task->get_future();
+
+  {
+    std::lock_guard<std::mutex> t_lock(m_mutex);
+    m_jobs.push_back([t_task]() { (*t_task)(); });
+    m_pending++;
+  }
+  m_job_queued.notify_one();
+
+  return t_future;
+}
+
+/** */
+template<class T>
+T AssetLoader::wait(std::future<T>& t_future) {
+  run_uploads_until([&t_future]() {
+    return t_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  });
+  return t_future.get();
+}
+
+}
+
+#endif
@@ -54,6 +54,7 @@ int shadow_type = 0;
 //const int m_num_matrices = 4;
 
 Terrain *terrain;
+GKR::TextureManager *textures;
 
 bool m_uniform_offsets = false;
 bool m_uniform_poisson = false;
@@ -68,6 +69,7 @@ int height = 720;
 GLuint write_depth_prog;
 GLuint view_prog;
 GLuint shad_single_prog;
+GLuint impostor_prog;
 
 //frustum f[MAX_SPLITS];
 //float shad_cpm[MAX_SPLITS][16];
@@ -77,9 +79,18 @@ obj_BoundingSphere obj_BSphere[NUM_OBJECTS];
 
 //float split_weight = 0.75f;
 
-void makeScene() {
+/** starts loading the scene on the loader's workers */
+void makeScene(GKR::AssetLoader& t_loader) {
+  textures = new GKR::TextureManager;
+  textures->init();
+
   terrain = new Terrain;
-  if(!terrain->Load()) {
+  terrain->Load(t_loader, *textures);
+}
+
+/** waits for the scene, running its GL uploads on this thread */
+void finishScene(GKR::AssetLoader& t_loader) {
+  if(!terrain->FinishLoad(t_loader)) {
     printf("Couldn't find terrain textures.\n");
     exit(0);
   }
@@ -103,6 +114,12 @@ void render_shadow_map() {
 
   vec4 t_lightdir = m_light_dir;
 
+  // Generate crop and projection matrices
+  shadow_map->pre_depth_write(camera, t_lightdir);
+
+  // cull the trees against the camera and every cascade before any of them is drawn
+  terrain->Cull(camera, shadow_map);
+
   glDisable(GL_TEXTURE_2D);
   // since the shadow maps have only a depth channel, we don't need color computation
   // glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
@@ -126,9 +143,6 @@ void render_shadow_map() {
   // draw all faces since our terrain is not closed.
   glDisable(GL_CULL_FACE);
 
-  // Generate crop and projection matrices
-  shadow_map->pre_depth_write(camera, t_lightdir);
-
   mat4 t_modelview = shadow_map->modelview_matrix();
   glUniformMatrix4fv(glGetUniformLocation(write_depth_prog, "modelViewMatrix"), 1, GL_FALSE, glm::value_ptr(t_modelview));
 
@@ -143,7 +157,7 @@ void render_shadow_map() {
     glClear(GL_DEPTH_BUFFER_BIT);
 
     // draw the scene
-    terrain->Draw(write_depth_prog, t_modelview);
+    terrain->Draw(write_depth_prog, t_modelview, i + 1);
   }
 
   // revert to normal back face culling as used for rendering
@@ -238,13 +252,25 @@ void render_scene() {
   glFogfv(GL_FOG_COLOR, glm::value_ptr(t_skycolor));
 
   // finally, draw the scene
-  terrain->Draw(t_current_program, t_view);
+  terrain->Draw(t_current_program, t_view, 0);
+
+  // distant trees are billboards, they are lit like the trees but receive no shadows
+  glUseProgram(impostor_prog);
+  glUniform4fv(glGetUniformLocation(impostor_prog, "lightdir"), 1, glm::value_ptr(t_lightdir));
+  glUniform4fv(glGetUniformLocation(impostor_prog, "lightcolor"), 1, glm::value_ptr(t_skycolor));
+  glUniformMatrix4fv(glGetUniformLocation(impostor_prog, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(t_projection));
+  terrain->DrawImpostors(impostor_prog, t_view);
 
   glUseProgram(0);
 
   GET_GLERROR()
 }
 
+// average cost of the culling queries since the last call
+void print_cull_stats() {
+  terrain->PrintCullStats();
+}
+
 // here we render the terrain from top and show the camera frusta.
 // this display can be enabled from within the sample
 void overviewCam() {
@@ -333,6 +359,9 @@ void showDepthTex() {
 void display() {
   updateKeys();
 
+  // a share of the texture levels still missing goes up every frame
+  textures->update();
+
   GKR::Camera* camera = get_camera();
   camera->update(0.1);
 
@@ -356,7 +385,9 @@ void init() {
   glEnable(GL_CULL_FACE);
   glEnable(GL_DEPTH_TEST);
 
-  makeScene();
+  // the assets load on worker threads while the shaders compile
+  GKR::AssetLoader t_loader;
+  makeScene(t_loader);
 
   string t_vertex_shader("../../src/GLSL/shadow_vertex.glsl");
   //string t_fragment_shader("../../src/GLSL/shadow_single_fragment.glsl");
@@ -374,9 +405,24 @@ void init() {
   string t_debugview_vertex_shader("../../src/GLSL/view_vertex.glsl");
   string t_debugview_fragment_shader("../../src/GLSL/view_fragment.glsl");
 
+  string t_impostor_vertex_shader("../../src/GLSL/impostor_vertex.glsl");
+  string t_impostor_fragment_shader("../../src/GLSL/impostor_fragment.glsl");
+
   shad_single_prog = createShaders(t_vertex_shader.c_str(), t_fragment_shader.c_str());
   view_prog = createShaders(t_debugview_vertex_shader.c_str(), t_debugview_fragment_shader.c_str());
   write_depth_prog = createShaders(t_depth_vertex_shader.c_str(), t_depth_fragment_shader.c_str());
+  impostor_prog = createShaders(t_impostor_vertex_shader.c_str(), t_impostor_fragment_shader.c_str());
+
+  finishScene(t_loader);
+
+  // tree culling runs in a compute shader where available, otherwise on the CPU
+  string t_cull_compute_shader("../../src/GLSL/cull_instances_compute.glsl");
+  GLuint t_cull_prog = 0;
+  if(glewIsSupported("GL_VERSION_4_3")) {
+    t_cull_prog = createComputeShader(t_cull_compute_shader.c_str());
+  }
+  terrain->InitCulling(t_cull_prog);
+  printf("tree culling on the %s\n", t_cull_prog ? "GPU" : "CPU");
 
   /*for(int i = 0 ; i < MAX_SPLITS ; i++) {
     // note that fov is in radians here and in OpenGL it is in degrees.
@@ -401,7 +447,7 @@ int main(int argc, char** argv) {
   glutCreateWindow("Cascaded Shadow Maps");
 
   glewInit();
-  if(!glewIsSupported( "GL_VERSION_2_0 ")) {
+  if(!glewIsSupported( "GL_VERSION_2_0 GL_ARB_draw_instanced GL_ARB_instanced_arrays")) {
     printf( "Required extensions not supported.\n");
     return 1;
   }
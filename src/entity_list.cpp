@@ -0,0 +1,79 @@
+#include <entity_list.hpp>
+
+#include <algorithm>
+
+/** */
+namespace GKR {
+
+/** */
+EntityList::EntityList() :
+    m_max_radius(0.0f) {
+}
+
+/** */
+void EntityList::clear() {
+  m_x.clear();
+  m_y.clear();
+  m_z.clear();
+  m_radius.clear();
+  m_max_radius = 0.0f;
+}
+
+/** */
+void EntityList::reserve(unsigned int t_count) {
+  m_x.reserve(t_count);
+  m_y.reserve(t_count);
+  m_z.reserve(t_count);
+  m_radius.reserve(t_count);
+}
+
+/** */
+void EntityList::add(float t_x, float t_y, float t_z, float t_radius) {
+  m_x.push_back(t_x);
+  m_y.push_back(t_y);
+  m_z.push_back(t_z);
+  m_radius.push_back(t_radius);
+  m_max_radius = std::max(m_max_radius, t_radius);
+}
+
+/** */
+unsigned int EntityList::size() const {
+  return (unsigned int)m_x.size();
+}
+
+/** */
+bool EntityList::empty() const {
+  return m_x.empty();
+}
+
+/** */
+const float* EntityList::x() const {
+  return m_x.empty() ? NULL : &m_x[0];
+}
+
+/** */
+const float* EntityList::y() const {
+  return m_y.empty() ? NULL : &m_y[0];
+}
+
+/** */
+const float* EntityList::z() const {
+  return m_z.empty() ? NULL : &m_z[0];
+}
+
+/** */
+const float* EntityList::radius() const {
+  return m_radius.empty() ? NULL : &m_radius[0];
+}
+
+/** */
+float EntityList::max_radius() const {
+  return m_max_radius;
+}
+
+/** */
+vec3 EntityList::position(unsigned int t_index) const {
+  return vec3(m_x[t_index], m_y[t_index], m_z[t_index]);
+}
+
+}
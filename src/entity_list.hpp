@@ -0,0 +1,48 @@
+#ifndef GKR_ENTITY_LIST_HPP
+#define GKR_ENTITY_LIST_HPP
+
+#include <math.hpp>
+
+#include <vector>
+
+/** */
+namespace GKR {
+
+/**
+ * Contiguous structure-of-arrays storage for scene entities (e.g. trees).
+ * Spatial queries go through a SpatialIndex built over the entity bounds.
+ */
+class EntityList {
+private:
+  std::vector<float> m_x;
+  std::vector<float> m_y;
+  std::vector<float> m_z;
+  std::vector<float> m_radius;
+
+  float m_max_radius;
+
+public:
+  EntityList();
+
+  void clear();
+  void reserve(unsigned int t_count);
+
+  void add(float t_x, float t_y, float t_z, float t_radius);
+
+  unsigned int size() const;
+  bool empty() const;
+
+  /** Raw SoA streams, valid until the next add() */
+  const float* x() const;
+  const float* y() const;
+  const float* z() const;
+  const float* radius() const;
+
+  float max_radius() const;
+
+  vec3 position(unsigned int t_index) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,256 @@
+#include <instance_culler.hpp>
+#include <entity_list.hpp>
+#include <spatial_index.hpp>
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+
+/** */
+namespace GKR {
+
+/** */
+InstanceCuller::InstanceCuller() :
+    m_program(0),
+    m_planes_location(-1),
+    m_count_location(-1),
+    m_eye_location(-1),
+    m_lod_scale_location(-1),
+    m_lod_distances_location(-1),
+    m_max_lod_location(-1),
+    m_source_buffer(0),
+    m_instance_count(0),
+    m_lod_count(1) {
+  for(int i = 0 ; i < MAX_VIEWS ; i++) {
+    m_instance_buffers[i] = 0;
+    m_command_buffers[i] = 0;
+  }
+  for(int i = 0 ; i < MAX_LODS - 1 ; i++) {
+    m_lod_distances[i] = FLT_MAX;
+  }
+  memset(m_commands, 0, sizeof(m_commands));
+}
+
+/** */
+InstanceCuller::~InstanceCuller() {
+  release();
+}
+
+/** */
+void InstanceCuller::release() {
+  if(m_source_buffer) {
+    glDeleteBuffers(1, &m_source_buffer);
+    glDeleteBuffers(MAX_VIEWS, m_instance_buffers);
+    glDeleteBuffers(MAX_VIEWS, m_command_buffers);
+    m_source_buffer = 0;
+  }
+  if(m_program) {
+    glDeleteProgram(m_program);
+    m_program = 0;
+  }
+}
+
+/** */
+void InstanceCuller::init(GLuint t_program) {
+  release();
+
+  m_program = t_program;
+  if(!m_program) {
+    return;
+  }
+
+  m_planes_location = glGetUniformLocation(m_program, "planes");
+  m_count_location = glGetUniformLocation(m_program, "instanceCount");
+  m_eye_location = glGetUniformLocation(m_program, "eye");
+  m_lod_scale_location = glGetUniformLocation(m_program, "lodScale");
+  m_lod_distances_location = glGetUniformLocation(m_program, "lodDistances");
+  m_max_lod_location = glGetUniformLocation(m_program, "maxLod");
+
+  glGenBuffers(1, &m_source_buffer);
+  glGenBuffers(MAX_VIEWS, m_instance_buffers);
+  glGenBuffers(MAX_VIEWS, m_command_buffers);
+}
+
+/** */
+bool InstanceCuller::gpu() const {
+  return m_program != 0;
+}
+
+/** */
+void InstanceCuller::set_instances(const EntityList& t_entities) {
+  m_instance_count = t_entities.size();
+  if(!gpu()) {
+    return;
+  }
+
+  // kernel input is one bounding sphere (center, radius) per instance
+  std::vector<float> t_spheres(4 * m_instance_count);
+  for(unsigned int i = 0 ; i < m_instance_count ; i++) {
+    t_spheres[4*i + 0] = t_entities.x()[i];
+    t_spheres[4*i + 1] = t_entities.y()[i];
+    t_spheres[4*i + 2] = t_entities.z()[i];
+    t_spheres[4*i + 3] = t_entities.radius()[i];
+  }
+
+  GLsizeiptr t_size = 4 * sizeof(float) * (m_instance_count ? m_instance_count : 1);
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_source_buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, t_size, m_instance_count ? &t_spheres[0] : NULL, GL_STATIC_DRAW);
+
+  // every level of every view can see at most all instances
+  for(int i = 0 ; i < MAX_VIEWS ; i++) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instance_buffers[i]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_LODS * t_size, NULL, GL_DYNAMIC_COPY);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/** */
+void InstanceCuller::set_lods(int t_lod_count, const float* t_distances) {
+  m_lod_count = (t_lod_count < MAX_LODS) ? t_lod_count : MAX_LODS;
+  for(int i = 0 ; i < MAX_LODS - 1 ; i++) {
+    m_lod_distances[i] = (i < m_lod_count - 1) ? t_distances[i] : FLT_MAX;
+  }
+}
+
+/** */
+void InstanceCuller::set_meshes(int t_lod, int t_mesh_count, const GLuint* t_index_counts) {
+  for(int i = 0 ; i < MAX_MESHES ; i++) {
+    DrawElementsIndirectCommand& t_command = m_commands[t_lod * MAX_MESHES + i];
+    t_command.count = (i < t_mesh_count) ? t_index_counts[i] : 0;
+    t_command.instance_count = 0;
+    t_command.first_index = 0;
+    t_command.base_vertex = 0;
+    // the instances of a level start at its range in the instance buffer
+    t_command.base_instance = t_lod * m_instance_count;
+  }
+
+  if(!gpu()) {
+    return;
+  }
+
+  for(int i = 0 ; i < MAX_VIEWS ; i++) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_command_buffers[i]);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(m_commands), m_commands, GL_DYNAMIC_COPY);
+  }
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+/** */
+int InstanceCuller::select_lod(float t_distance, int t_max_lod) const {
+  int t_lod = 0;
+  for(int i = 0 ; i < MAX_LODS - 1 ; i++) {
+    if(t_distance >= m_lod_distances[i]) {
+      t_lod = i + 1;
+    }
+  }
+  return (t_lod < t_max_lod) ? t_lod : t_max_lod;
+}
+
+/** */
+void InstanceCuller::cull(int t_view, const mat4& t_clip_from_local, const vec3& t_eye, float t_lod_scale, int t_max_lod) {
+  if(!gpu() || m_instance_count == 0) {
+    return;
+  }
+
+  vec4 t_planes[6];
+  extract_planes(t_clip_from_local, t_planes);
+
+  if(t_max_lod > m_lod_count - 1) {
+    t_max_lod = m_lod_count - 1;
+  }
+
+  // reset the instance counts, the kernel increments them atomically
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_command_buffers[t_view]);
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(m_commands), m_commands);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  glUseProgram(m_program);
+  glUniform4fv(m_planes_location, 6, glm::value_ptr(t_planes[0]));
+  glUniform1ui(m_count_location, m_instance_count);
+  glUniform3fv(m_eye_location, 1, glm::value_ptr(t_eye));
+  glUniform1f(m_lod_scale_location, t_lod_scale);
+  glUniform1fv(m_lod_distances_location, MAX_LODS - 1, m_lod_distances);
+  glUniform1ui(m_max_lod_location, (GLuint)t_max_lod);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_source_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_instance_buffers[t_view]);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_command_buffers[t_view]);
+
+  glDispatchCompute((m_instance_count + 63) / 64, 1, 1);
+
+  glUseProgram(0);
+}
+
+/** */
+void InstanceCuller::barrier() {
+  if(gpu()) {
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  }
+}
+
+/** */
+GLuint InstanceCuller::instance_buffer(int t_view) const {
+  return m_instance_buffers[t_view];
+}
+
+/** */
+GLuint InstanceCuller::command_buffer(int t_view) const {
+  return m_command_buffers[t_view];
+}
+
+/** */
+GLintptr InstanceCuller::command_offset(int t_lod, int t_mesh) {
+  return (t_lod * MAX_MESHES + t_mesh) * sizeof(DrawElementsIndirectCommand);
+}
+
+/** */
+void InstanceCuller::extract_planes(const mat4& t_clip_from_local, vec4 t_planes[6]) {
+  SpatialIndex::extract_planes(t_clip_from_local, t_planes);
+}
+
+/** */
+unsigned int InstanceCuller::cull_cpu(const EntityList& t_entities, const unsigned int* t_candidates, unsigned int t_count,
+                                      const vec4 t_planes[6], const vec3& t_eye, float t_lod_scale, int t_max_lod,
+                                      std::vector<float> t_visible[MAX_LODS]) const {
+  const float* ex = t_entities.x();
+  const float* ey = t_entities.y();
+  const float* ez = t_entities.z();
+  const float* er = t_entities.radius();
+
+  if(!t_candidates) {
+    t_count = t_entities.size();
+  }
+
+  if(t_max_lod > m_lod_count - 1) {
+    t_max_lod = m_lod_count - 1;
+  }
+
+  unsigned int t_visible_count = 0;
+  for(unsigned int i = 0 ; i < t_count ; i++) {
+    unsigned int e = t_candidates ? t_candidates[i] : i;
+
+    // must be the same test as in cull_instances_compute.glsl
+    bool t_inside = true;
+    for(int p = 0 ; p < 6 && t_inside ; p++) {
+      t_inside = t_planes[p].x * ex[e] + t_planes[p].y * ey[e] + t_planes[p].z * ez[e] + t_planes[p].w >= -er[e];
+    }
+
+    if(t_inside) {
+      float dx = ex[e] - t_eye.x;
+      float dy = ey[e] - t_eye.y;
+      float dz = ez[e] - t_eye.z;
+      std::vector<float>& t_list = t_visible[select_lod(sqrtf(dx*dx + dy*dy + dz*dz) * t_lod_scale, t_max_lod)];
+
+      t_list.push_back(ex[e]);
+      t_list.push_back(ey[e]);
+      t_list.push_back(ez[e]);
+      t_list.push_back(1.0f);
+      t_visible_count++;
+    }
+  }
+
+  return t_visible_count;
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef GKR_INSTANCE_CULLER_HPP
+#define GKR_INSTANCE_CULLER_HPP
+
+#include <math.hpp>
+#include <shadow_map.hpp>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+/** */
+namespace GKR {
+
+class EntityList;
+
+/** Layout of one glDrawElementsIndirect command */
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLuint base_vertex;
+  GLuint base_instance;
+};
+
+/**
+ * Culls entity bounding spheres against the clip volume of a view (camera frustum or
+ * shadow cascade) and produces a compacted instance list per view and level of detail.
+ * The level of an instance is selected by its distance to the eye, scaled by a per view
+ * bias, so shadow cascades can switch to coarser meshes earlier than the camera.
+ *
+ * With a compute program the kernel runs on the GPU and also writes the instance counts
+ * into DrawElementsIndirect commands, so the CPU never reads back visibility. cull_cpu()
+ * is the same kernel on the CPU, used when compute shaders are unavailable.
+ */
+class InstanceCuller {
+public:
+  /** View 0 is the camera, views 1..CSM_MAX_SPLITS are the shadow cascades */
+  static const int MAX_VIEWS = CSM_MAX_SPLITS + 1;
+
+  /** One indirect command per mesh drawn for every instance (trunk and leaves) */
+  static const int MAX_MESHES = 2;
+
+  /** Levels of detail, each with up to MAX_MESHES meshes */
+  static const int MAX_LODS = 3;
+
+private:
+  GLuint m_program;
+  GLint m_planes_location;
+  GLint m_count_location;
+  GLint m_eye_location;
+  GLint m_lod_scale_location;
+  GLint m_lod_distances_location;
+  GLint m_max_lod_location;
+
+  GLuint m_source_buffer;
+  GLuint m_instance_buffers[MAX_VIEWS];
+  GLuint m_command_buffers[MAX_VIEWS];
+
+  unsigned int m_instance_count;
+  int m_lod_count;
+  float m_lod_distances[MAX_LODS - 1];
+  DrawElementsIndirectCommand m_commands[MAX_LODS * MAX_MESHES];
+
+public:
+  InstanceCuller();
+  ~InstanceCuller();
+
+  /** Takes ownership of a linked compute program, 0 keeps the culler in CPU mode */
+  void init(GLuint t_program);
+
+  /** True if culling runs on the GPU */
+  bool gpu() const;
+
+  /** Uploads the bounding spheres of all entities */
+  void set_instances(const EntityList& t_entities);
+
+  /** Sets the number of levels and the t_lod_count - 1 distances at which the next level starts */
+  void set_lods(int t_lod_count, const float* t_distances);
+
+  /** Sets the index counts of the meshes drawn per instance of a level, call after set_instances() */
+  void set_meshes(int t_lod, int t_mesh_count, const GLuint* t_index_counts);
+
+  /** Level of detail of an instance at a (biased) distance from the eye */
+  int select_lod(float t_distance, int t_max_lod) const;
+
+  /**
+   * Runs the GPU kernel for one view. Call barrier() once after the last view.
+   * Distances to t_eye are multiplied by t_lod_scale and no level above t_max_lod is used.
+   */
+  void cull(int t_view, const mat4& t_clip_from_local, const vec3& t_eye, float t_lod_scale, int t_max_lod);
+
+  /** Makes the kernel results visible to vertex fetch and indirect draws */
+  void barrier();
+
+  /** Compacted vec4 (translation, scale) instances of a view, MAX_LODS ranges of one per entity */
+  GLuint instance_buffer(int t_view) const;
+
+  /** MAX_MESHES consecutive DrawElementsIndirectCommands per level of a view */
+  GLuint command_buffer(int t_view) const;
+
+  /** Byte offset of the command of a mesh of a level in a command buffer */
+  static GLintptr command_offset(int t_lod, int t_mesh);
+
+  /** Extracts the six clip planes (xyz = normal pointing inside, w = distance) of a matrix */
+  static void extract_planes(const mat4& t_clip_from_local, vec4 t_planes[6]);
+
+  /**
+   * CPU version of the culling kernel. Tests the candidate entities (or all of them if
+   * t_candidates is NULL) and appends vec4 (translation, scale) for every visible one to
+   * the list of its level of detail. Returns the number of visible instances.
+   */
+  unsigned int cull_cpu(const EntityList& t_entities, const unsigned int* t_candidates, unsigned int t_count,
+                        const vec4 t_planes[6], const vec3& t_eye, float t_lod_scale, int t_max_lod,
+                        std::vector<float> t_visible[MAX_LODS]) const;
+
+private:
+  void release();
+};
+
+}
+
+#endif
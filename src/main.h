@@ -53,6 +53,7 @@ void key_up(unsigned char c, int x, int y);
 void reshape(int w, int h);
 void menu(int m);
 void updateKeys();
+void print_cull_stats();
 void camLook();
 glm::mat4 camLook2();
 
@@ -62,6 +63,7 @@ GKR::ShadowMap* get_shadow_map();
 void compare_matrix(float* t_mat_orig, const glm::mat4& t_glm_mat);
 void cameraInverse(float dst[16], float src[16]);
 GLuint createShaders(const char* vert, const char* frag);
+GLuint createComputeShader(const char* comp);
 void CheckFramebufferStatus();
 
 //extern GLuint depth_tex_ar;
@@ -93,4 +95,4 @@ extern float split_weight;
   } \
 }
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
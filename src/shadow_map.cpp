@@ -41,9 +41,9 @@ ShadowMap::~ShadowMap() {
 }
 
 /** */
-/*mat4 ShadowMap::crop_matrix(int t_split_index) {
+mat4 ShadowMap::crop_matrix(int t_split_index) {
   return m_crop_matrices[t_split_index];
-}*/
+}
 
 /** */
 mat4 ShadowMap::projection_matrix(int t_split_index) {
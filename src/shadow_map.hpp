@@ -43,6 +43,9 @@ public:
   /** Getters for the various matrices (shadow map generation) */
   mat4 projection_matrix(int t_split_index);
   mat4 modelview_matrix();
+
+  /** Light clip space from world space (projection * modelview) of a split */
+  mat4 crop_matrix(int t_split_index);
   
   //Frustum* frustum(int t_split_index);
   
@@ -0,0 +1,366 @@
+#include <spatial_index.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GKR_SPATIAL_INDEX_SSE
+#include <xmmintrin.h>
+#endif
+
+/** */
+namespace GKR {
+
+/** */
+static double elapsed_ms(const std::chrono::high_resolution_clock::time_point& t_start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t_start).count();
+}
+
+/** */
+SpatialIndex::SpatialIndex() :
+    m_count(0),
+    m_cell_size(0.0f),
+    m_inv_cell_size(0.0f),
+    m_origin_x(0.0f),
+    m_origin_z(0.0f),
+    m_cells_x(0),
+    m_cells_z(0) {
+  reset_stats();
+}
+
+/** */
+void SpatialIndex::clear() {
+  m_cx.clear();
+  m_cy.clear();
+  m_cz.clear();
+  m_ex.clear();
+  m_ey.clear();
+  m_ez.clear();
+  m_ids.clear();
+  m_count = 0;
+  m_cell_start.clear();
+  m_cell_center.clear();
+  m_cell_extent.clear();
+  m_cells_x = 0;
+  m_cells_z = 0;
+}
+
+/** */
+void SpatialIndex::add(unsigned int t_id, const vec3& t_min, const vec3& t_max) {
+  // the new box takes the first padding slot, the arrays keep 3 padding boxes after it
+  // so the SIMD loop may load four boxes from any index before build() as well
+  unsigned int t_padded = m_count + 4;
+  m_cx.resize(t_padded, 0.0f);
+  m_cy.resize(t_padded, 0.0f);
+  m_cz.resize(t_padded, 0.0f);
+  m_ex.resize(t_padded, 0.0f);
+  m_ey.resize(t_padded, 0.0f);
+  m_ez.resize(t_padded, 0.0f);
+  m_ids.resize(t_padded, 0);
+
+  vec3 t_center = 0.5f * (t_min + t_max);
+  vec3 t_extent = 0.5f * (t_max - t_min);
+  m_cx[m_count] = t_center.x;
+  m_cy[m_count] = t_center.y;
+  m_cz[m_count] = t_center.z;
+  m_ex[m_count] = t_extent.x;
+  m_ey[m_count] = t_extent.y;
+  m_ez[m_count] = t_extent.z;
+  m_ids[m_count] = t_id;
+  m_count++;
+
+  m_cell_start.clear();
+  m_cells_x = 0;
+  m_cells_z = 0;
+}
+
+/** */
+void SpatialIndex::build(float t_cell_size) {
+  m_cell_start.clear();
+  m_cell_center.clear();
+  m_cell_extent.clear();
+  m_cells_x = 0;
+  m_cells_z = 0;
+
+  if(m_count == 0 || t_cell_size <= 0.0f) {
+    return;
+  }
+
+  float t_xmin = m_cx[0], t_xmax = m_cx[0];
+  float t_zmin = m_cz[0], t_zmax = m_cz[0];
+  for(unsigned int i = 1 ; i < m_count ; i++) {
+    t_xmin = std::min(t_xmin, m_cx[i]);
+    t_xmax = std::max(t_xmax, m_cx[i]);
+    t_zmin = std::min(t_zmin, m_cz[i]);
+    t_zmax = std::max(t_zmax, m_cz[i]);
+  }
+
+  m_cell_size = t_cell_size;
+  m_inv_cell_size = 1.0f / t_cell_size;
+  m_origin_x = t_xmin;
+  m_origin_z = t_zmin;
+  m_cells_x = (int)((t_xmax - t_xmin) * m_inv_cell_size) + 1;
+  m_cells_z = (int)((t_zmax - t_zmin) * m_inv_cell_size) + 1;
+
+  // counting sort by the cell of the box center
+  int t_cells = m_cells_x * m_cells_z;
+  std::vector<unsigned int> t_cell_of(m_count);
+  m_cell_start.assign(t_cells + 1, 0);
+
+  for(unsigned int i = 0 ; i < m_count ; i++) {
+    int cx = std::min((int)((m_cx[i] - m_origin_x) * m_inv_cell_size), m_cells_x - 1);
+    int cz = std::min((int)((m_cz[i] - m_origin_z) * m_inv_cell_size), m_cells_z - 1);
+    t_cell_of[i] = cz * m_cells_x + cx;
+    m_cell_start[t_cell_of[i] + 1]++;
+  }
+
+  for(int c = 1 ; c <= t_cells ; c++) {
+    m_cell_start[c] += m_cell_start[c - 1];
+  }
+
+  // 3 padding boxes after the last one, so the SIMD loop may load four boxes from any cell start
+  unsigned int t_padded = m_count + 3;
+  std::vector<unsigned int> t_cursor(m_cell_start.begin(), m_cell_start.end() - 1);
+  std::vector<float> t_cx(t_padded, 0.0f), t_cy(t_padded, 0.0f), t_cz(t_padded, 0.0f);
+  std::vector<float> t_ex(t_padded, 0.0f), t_ey(t_padded, 0.0f), t_ez(t_padded, 0.0f);
+  std::vector<unsigned int> t_ids(t_padded, 0);
+
+  for(unsigned int i = 0 ; i < m_count ; i++) {
+    unsigned int dst = t_cursor[t_cell_of[i]]++;
+    t_cx[dst] = m_cx[i];
+    t_cy[dst] = m_cy[i];
+    t_cz[dst] = m_cz[i];
+    t_ex[dst] = m_ex[i];
+    t_ey[dst] = m_ey[i];
+    t_ez[dst] = m_ez[i];
+    t_ids[dst] = m_ids[i];
+  }
+
+  m_cx.swap(t_cx);
+  m_cy.swap(t_cy);
+  m_cz.swap(t_cz);
+  m_ex.swap(t_ex);
+  m_ey.swap(t_ey);
+  m_ez.swap(t_ez);
+  m_ids.swap(t_ids);
+
+  // the bounds of a cell enclose all of its boxes, which may reach into neighbouring cells
+  m_cell_center.resize(t_cells);
+  m_cell_extent.resize(t_cells);
+  for(int c = 0 ; c < t_cells ; c++) {
+    unsigned int begin = m_cell_start[c];
+    unsigned int end = m_cell_start[c + 1];
+    if(begin == end) {
+      continue;
+    }
+
+    vec3 t_min(m_cx[begin] - m_ex[begin], m_cy[begin] - m_ey[begin], m_cz[begin] - m_ez[begin]);
+    vec3 t_max(m_cx[begin] + m_ex[begin], m_cy[begin] + m_ey[begin], m_cz[begin] + m_ez[begin]);
+    for(unsigned int i = begin + 1 ; i < end ; i++) {
+      t_min = glm::min(t_min, vec3(m_cx[i] - m_ex[i], m_cy[i] - m_ey[i], m_cz[i] - m_ez[i]));
+      t_max = glm::max(t_max, vec3(m_cx[i] + m_ex[i], m_cy[i] + m_ey[i], m_cz[i] + m_ez[i]));
+    }
+    m_cell_center[c] = 0.5f * (t_min + t_max);
+    m_cell_extent[c] = 0.5f * (t_max - t_min);
+  }
+}
+
+/** */
+unsigned int SpatialIndex::size() const {
+  return m_count;
+}
+
+/** */
+void SpatialIndex::test_boxes(unsigned int t_begin, unsigned int t_end, const vec4* t_planes, int t_plane_count, std::vector<unsigned int>& t_result) const {
+  m_stats.boxes_tested += t_end - t_begin;
+
+#ifdef GKR_SPATIAL_INDEX_SSE
+  const __m128 t_sign_mask = _mm_set1_ps(-0.0f);
+
+  for(unsigned int i = t_begin ; i < t_end ; i += 4) {
+    __m128 cx = _mm_loadu_ps(&m_cx[i]);
+    __m128 cy = _mm_loadu_ps(&m_cy[i]);
+    __m128 cz = _mm_loadu_ps(&m_cz[i]);
+    __m128 ex = _mm_loadu_ps(&m_ex[i]);
+    __m128 ey = _mm_loadu_ps(&m_ey[i]);
+    __m128 ez = _mm_loadu_ps(&m_ez[i]);
+
+    // a box is outside if n.c + d + |n|.e < 0 for any plane
+    __m128 t_outside = _mm_setzero_ps();
+    for(int p = 0 ; p < t_plane_count ; p++) {
+      __m128 nx = _mm_set1_ps(t_planes[p].x);
+      __m128 ny = _mm_set1_ps(t_planes[p].y);
+      __m128 nz = _mm_set1_ps(t_planes[p].z);
+
+      __m128 t_dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                 _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(t_planes[p].w)));
+      __m128 t_radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(t_sign_mask, nx), ex),
+                                              _mm_mul_ps(_mm_andnot_ps(t_sign_mask, ny), ey)),
+                                   _mm_mul_ps(_mm_andnot_ps(t_sign_mask, nz), ez));
+      t_outside = _mm_or_ps(t_outside, _mm_cmplt_ps(_mm_add_ps(t_dist, t_radius), _mm_setzero_ps()));
+    }
+
+    int t_mask = _mm_movemask_ps(t_outside);
+    unsigned int t_lanes = std::min(t_end - i, 4u);
+    for(unsigned int l = 0 ; l < t_lanes ; l++) {
+      if(!(t_mask & (1 << l))) {
+        t_result.push_back(m_ids[i + l]);
+        m_stats.boxes_found++;
+      }
+    }
+  }
+#else
+  for(unsigned int i = t_begin ; i < t_end ; i++) {
+    bool t_inside = true;
+    for(int p = 0 ; p < t_plane_count && t_inside ; p++) {
+      const vec4& n = t_planes[p];
+      float t_dist = n.x * m_cx[i] + n.y * m_cy[i] + n.z * m_cz[i] + n.w;
+      float t_radius = fabsf(n.x) * m_ex[i] + fabsf(n.y) * m_ey[i] + fabsf(n.z) * m_ez[i];
+      t_inside = t_dist + t_radius >= 0.0f;
+    }
+    if(t_inside) {
+      t_result.push_back(m_ids[i]);
+      m_stats.boxes_found++;
+    }
+  }
+#endif
+}
+
+/** */
+void SpatialIndex::query_planes(const vec4* t_planes, int t_plane_count, std::vector<unsigned int>& t_result) const {
+  std::chrono::high_resolution_clock::time_point t_start = std::chrono::high_resolution_clock::now();
+  m_stats.queries++;
+
+  if(m_cell_start.empty()) {
+    // not built, test everything
+    test_boxes(0, m_count, t_planes, t_plane_count, t_result);
+    m_stats.milliseconds += elapsed_ms(t_start);
+    return;
+  }
+
+  int t_cells = m_cells_x * m_cells_z;
+  for(int c = 0 ; c < t_cells ; c++) {
+    unsigned int begin = m_cell_start[c];
+    unsigned int end = m_cell_start[c + 1];
+    if(begin == end) {
+      continue;
+    }
+    m_stats.cells_tested++;
+
+    // classify the cell bounds: outside, fully inside or intersecting
+    const vec3& cc = m_cell_center[c];
+    const vec3& ce = m_cell_extent[c];
+    bool t_outside = false;
+    bool t_inside = true;
+    for(int p = 0 ; p < t_plane_count && !t_outside ; p++) {
+      const vec4& n = t_planes[p];
+      float t_dist = n.x * cc.x + n.y * cc.y + n.z * cc.z + n.w;
+      float t_radius = fabsf(n.x) * ce.x + fabsf(n.y) * ce.y + fabsf(n.z) * ce.z;
+      t_outside = t_dist + t_radius < 0.0f;
+      t_inside = t_inside && t_dist - t_radius >= 0.0f;
+    }
+
+    if(t_outside) {
+      continue;
+    }
+    if(t_inside) {
+      t_result.insert(t_result.end(), m_ids.begin() + begin, m_ids.begin() + end);
+      m_stats.boxes_found += end - begin;
+      continue;
+    }
+    test_boxes(begin, end, t_planes, t_plane_count, t_result);
+  }
+
+  m_stats.milliseconds += elapsed_ms(t_start);
+}
+
+/** */
+void SpatialIndex::query_frustum(const mat4& t_clip_from_world, std::vector<unsigned int>& t_result) const {
+  vec4 t_planes[6];
+  extract_planes(t_clip_from_world, t_planes);
+  query_planes(t_planes, 6, t_result);
+}
+
+/** */
+void SpatialIndex::query_box(const vec3& t_center, const mat3& t_axes, const vec3& t_half_extents, std::vector<unsigned int>& t_result) const {
+  // two planes facing each other per axis
+  vec4 t_planes[6];
+  for(int i = 0 ; i < 3 ; i++) {
+    vec3 n = t_axes[i];
+    float t_dist = glm::dot(n, t_center);
+    t_planes[2*i + 0] = vec4(n, t_half_extents[i] - t_dist);
+    t_planes[2*i + 1] = vec4(-n, t_half_extents[i] + t_dist);
+  }
+  query_planes(t_planes, 6, t_result);
+}
+
+/** */
+void SpatialIndex::query_sphere(const vec3& t_center, float t_radius, std::vector<unsigned int>& t_result) const {
+  std::chrono::high_resolution_clock::time_point t_start = std::chrono::high_resolution_clock::now();
+  m_stats.queries++;
+
+  int t_cells = m_cell_start.empty() ? 1 : m_cells_x * m_cells_z;
+  for(int c = 0 ; c < t_cells ; c++) {
+    unsigned int begin = m_cell_start.empty() ? 0 : m_cell_start[c];
+    unsigned int end = m_cell_start.empty() ? m_count : m_cell_start[c + 1];
+    if(begin == end) {
+      continue;
+    }
+
+    if(!m_cell_start.empty()) {
+      m_stats.cells_tested++;
+      vec3 d = glm::max(glm::abs(t_center - m_cell_center[c]) - m_cell_extent[c], vec3(0.0f));
+      if(glm::dot(d, d) > t_radius * t_radius) {
+        continue;
+      }
+    }
+
+    m_stats.boxes_tested += end - begin;
+    for(unsigned int i = begin ; i < end ; i++) {
+      // squared distance from the center to the box
+      float dx = std::max(fabsf(t_center.x - m_cx[i]) - m_ex[i], 0.0f);
+      float dy = std::max(fabsf(t_center.y - m_cy[i]) - m_ey[i], 0.0f);
+      float dz = std::max(fabsf(t_center.z - m_cz[i]) - m_ez[i], 0.0f);
+      if(dx*dx + dy*dy + dz*dz <= t_radius * t_radius) {
+        t_result.push_back(m_ids[i]);
+        m_stats.boxes_found++;
+      }
+    }
+  }
+
+  m_stats.milliseconds += elapsed_ms(t_start);
+}
+
+/** */
+const SpatialIndex::Stats& SpatialIndex::stats() const {
+  return m_stats;
+}
+
+/** */
+void SpatialIndex::reset_stats() {
+  m_stats.queries = 0;
+  m_stats.cells_tested = 0;
+  m_stats.boxes_tested = 0;
+  m_stats.boxes_found = 0;
+  m_stats.milliseconds = 0.0;
+}
+
+/** Gribb-Hartmann plane extraction, the planes of M are (row3 +- row0/1/2) */
+void SpatialIndex::extract_planes(const mat4& t_clip_from_world, vec4 t_planes[6]) {
+  const mat4& m = t_clip_from_world;
+
+  for(int i = 0 ; i < 3 ; i++) {
+    for(int j = 0 ; j < 4 ; j++) {
+      t_planes[2*i + 0][j] = m[j][3] + m[j][i];
+      t_planes[2*i + 1][j] = m[j][3] - m[j][i];
+    }
+  }
+
+  for(int i = 0 ; i < 6 ; i++) {
+    float t_length = sqrtf(t_planes[i].x * t_planes[i].x + t_planes[i].y * t_planes[i].y + t_planes[i].z * t_planes[i].z);
+    t_planes[i] = t_planes[i] / t_length;
+  }
+}
+
+}
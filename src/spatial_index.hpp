@@ -0,0 +1,102 @@
+#ifndef GKR_SPATIAL_INDEX_HPP
+#define GKR_SPATIAL_INDEX_HPP
+
+#include <math.hpp>
+
+#include <vector>
+
+/** */
+namespace GKR {
+
+/**
+ * Static spatial index over axis-aligned bounding boxes (terrain patches, entities).
+ *
+ * The boxes are sorted into a uniform xz-grid. Every cell keeps the bounds of its boxes,
+ * so a query first classifies whole cells: cells outside the volume are skipped, cells
+ * fully inside return all of their boxes untested, and only boxes of intersecting cells
+ * are tested, four at a time with SSE where available.
+ *
+ * Queries return the ids the boxes were added with and accumulate timing statistics.
+ */
+class SpatialIndex {
+public:
+  /** Accumulated cost of the queries since the last reset_stats() */
+  struct Stats {
+    unsigned int queries;
+    unsigned int cells_tested;
+    unsigned int boxes_tested;
+    unsigned int boxes_found;
+    double milliseconds;
+  };
+
+private:
+  /** Box centers and half extents (SoA, 3 padding boxes at the end), sorted by cell */
+  std::vector<float> m_cx;
+  std::vector<float> m_cy;
+  std::vector<float> m_cz;
+  std::vector<float> m_ex;
+  std::vector<float> m_ey;
+  std::vector<float> m_ez;
+  std::vector<unsigned int> m_ids;
+  unsigned int m_count;
+
+  /** Uniform grid over the xz-plane */
+  float m_cell_size;
+  float m_inv_cell_size;
+  float m_origin_x;
+  float m_origin_z;
+  int m_cells_x;
+  int m_cells_z;
+
+  /** Index of the first box in every cell, m_cells_x * m_cells_z + 1 entries */
+  std::vector<unsigned int> m_cell_start;
+
+  /** Bounds of the boxes in every cell (center, half extents), empty cells have none */
+  std::vector<vec3> m_cell_center;
+  std::vector<vec3> m_cell_extent;
+
+  mutable Stats m_stats;
+
+public:
+  SpatialIndex();
+
+  void clear();
+
+  /** Appends a box, it becomes visible to queries after the next build() */
+  void add(unsigned int t_id, const vec3& t_min, const vec3& t_max);
+
+  /** Sorts the boxes into grid cells of the given size */
+  void build(float t_cell_size);
+
+  /** Number of boxes */
+  unsigned int size() const;
+
+  /**
+   * Appends the ids of all boxes on the inner side of every plane (xyz = normal pointing
+   * inside, w = distance). Conservative, boxes crossing a corner of the volume may be returned.
+   */
+  void query_planes(const vec4* t_planes, int t_plane_count, std::vector<unsigned int>& t_result) const;
+
+  /** Appends the ids of all boxes intersecting the clip volume of a projection (camera frustum) */
+  void query_frustum(const mat4& t_clip_from_world, std::vector<unsigned int>& t_result) const;
+
+  /** Appends the ids of all boxes intersecting an oriented box (light cascade), t_axes are unit length */
+  void query_box(const vec3& t_center, const mat3& t_axes, const vec3& t_half_extents, std::vector<unsigned int>& t_result) const;
+
+  /** Appends the ids of all boxes intersecting a sphere */
+  void query_sphere(const vec3& t_center, float t_radius, std::vector<unsigned int>& t_result) const;
+
+  const Stats& stats() const;
+  void reset_stats();
+
+  /** Extracts the six clip planes (xyz = normal pointing inside, w = distance) of a matrix */
+  static void extract_planes(const mat4& t_clip_from_world, vec4 t_planes[6]);
+
+private:
+  /** Tests the boxes [t_begin, t_end) against the planes */
+  void test_boxes(unsigned int t_begin, unsigned int t_end, const vec4* t_planes, int t_plane_count, std::vector<unsigned int>& t_result) const;
+};
+
+}
+
+#endif
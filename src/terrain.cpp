@@ -13,78 +13,219 @@
 #define min(a,b)            (((a) < (b)) ? (a) : (b))
 #endif
 
+static const float TRUNK_COLOR[3] = { 0.917647f, 0.776471f, 0.576471f };
+static const float LEAVES_COLOR[3] = { 0.301961f, 0.588235f, 0.309804f };
+
+// converts the heightmap to heights a row at a time, so the decoded image is never held whole.
+// the rows are stored bottom up, grayscale or colour maps with 8 or 16 bits use their first channel.
+class HeightmapReader : public nv::Image::RowReader
+{
+public:
+	float *heights;
+	int width;
+	int height;
+
+	HeightmapReader() : heights(NULL), width(0), height(0), channels(0), wide(false) {}
+	~HeightmapReader() { delete [] heights; }
+
+	bool begin(const nv::Image &layout)
+	{
+		if(layout.getType() != GL_UNSIGNED_BYTE && layout.getType() != GL_UNSIGNED_SHORT)
+			return false;
+		width = layout.getWidth();
+		height = layout.getHeight();
+		wide = (layout.getType() == GL_UNSIGNED_SHORT);
+		channels = layout.getImageSize() / (width * height * (wide ? 2 : 1));
+		delete [] heights;
+		heights = new float [width * height];
+		return true;
+	}
+
+	void row(int y, const void *data)
+	{
+		float *dst = heights + (height - 1 - y) * width;
+		if(wide) {
+			// 16 bit maps cover the same range with finer steps
+			const GLushort *src = (const GLushort *)data;
+			for(int x=0; x<width; x++)
+				dst[x] = (float)src[channels*x] * (1.0f / 257.0f) * SCALE;
+		}
+		else {
+			const GLubyte *src = (const GLubyte *)data;
+			for(int x=0; x<width; x++)
+				dst[x] = (float)src[channels*x] * SCALE;
+		}
+	}
+
+private:
+	int channels;
+	bool wide;
+};
+
 Terrain::Terrain()
 {
+	textures = NULL;
 	tex = 0;
 	heights = NULL;
 	normals = NULL;
+	instanceVbo = 0;
+	numViews = 0;
+	numPatches = 0;
+	impostorTex = 0;
+	impostorVbo = 0;
+	impostorEbo = 0;
+	entityMapWidth = 0;
+	entityMapHeight = 0;
+	for(int i=0; i<TREE_MESH_LODS; i++) {
+		modelT[i] = NULL;
+		modelL[i] = NULL;
+	}
 }
 
 Terrain::~Terrain()
 {
-	if(tex)
-		glDeleteTextures(1, &tex);
+	if(instanceVbo)
+		glDeleteBuffers(1, &instanceVbo);
+	if(impostorTex)
+		glDeleteTextures(1, &impostorTex);
+	if(impostorVbo) {
+		glDeleteBuffers(1, &impostorVbo);
+		glDeleteBuffers(1, &impostorEbo);
+	}
 	if(heights)
 		delete [] heights;
 	if(normals)
 		delete [] normals;
-	if(modelT)
-		delete modelT;
-	if(modelL)
-		delete modelL;
+	for(int i=0; i<TREE_MESH_LODS; i++) {
+		if(modelT[i])
+			delete modelT[i];
+		if(modelL[i])
+			delete modelL[i];
+	}
 	height = 0;
 	width = 0;
+}
+
+// starts the jobs that read the terrain and the trees, FinishLoad waits for them.
+// everything but the GL calls runs on the loader's workers, the jobs queue their uploads.
+void Terrain::Load(GKR::AssetLoader &loader, GKR::TextureManager &textureManager)
+{
+	printf("loading terrain...\n");
 
-	for(unsigned int i=0; i<entities.size(); i++)
-		delete entities[i];
+	textures = &textureManager;
+
+	for(int i=0; i<TREE_MESH_LODS; i++) {
+		modelT[i] = new nv::Model;
+		modelL[i] = new nv::Model;
+	}
+
+	textureJob = loader.submit([this, &loader]() { return LoadTexture(loader); });
+	heightmapJob = loader.submit([this]() { return LoadHeightmap(); });
+	entityMapJob = loader.submit([this]() { return LoadEntityMap(); });
+	treeJobT = loader.submit([this, &loader]() { return LoadTree(loader, false); });
+	treeJobL = loader.submit([this, &loader]() { return LoadTree(loader, true); });
 }
 
-bool Terrain::Load()
+bool Terrain::FinishLoad(GKR::AssetLoader &loader)
 {
-	nv::Image iTex;
-	nv::Image dTex;
-	nv::Image eTex;
+	// every job is waited for, they all write into the terrain
+	bool loaded = loader.wait(textureJob);
+	loaded = loader.wait(heightmapJob) && loaded;
+	loaded = loader.wait(entityMapJob) && loaded;
+	bool trees = loader.wait(treeJobT);
+	trees = loader.wait(treeJobL) && trees;
+	loader.finish();
+
+	if(!loaded)
+		return false;
+	if(!trees)
+	{
+		printf("Couldn't find model .obj.\n");
+		exit(0);
+	}
 
-	printf("loading terrain...\n");
+	MakeImpostor();
 
-	if(!iTex.loadImageFromFile(&TERRAIN_TEX_FILENAME[0])) {
-		if(!iTex.loadImageFromFile(&TERRAIN_TEX_FILENAME[3])) {
-			return false;
-    }
-  }
-	if(!dTex.loadImageFromFile(&DEPTH_TEX_FILENAME[0]))
-		if(!dTex.loadImageFromFile(&DEPTH_TEX_FILENAME[3]))
-			return false;
-	if(!eTex.loadImageFromFile(&ENTITIES_TEX_FILENAME[0]))
-		if(!eTex.loadImageFromFile(&ENTITIES_TEX_FILENAME[3]))
+	// per-instance data is streamed every pass
+	glGenBuffers(1, &instanceVbo);
+
+	float e_ratio_x = (float)entityMapWidth / (float)width;
+	float e_ratio_z = (float)entityMapHeight / (float)height;
+	float radius = TreeRadius();
+
+	entities.clear();
+	for(size_t i=0; i<entityPixels.size(); i++) {
+		int x = entityPixels[i] % entityMapWidth;
+		int z = entityPixels[i] / entityMapWidth;
+		entities.add(e_ratio_x * (float)x, heights[x + z*width], e_ratio_z * (float)z, radius);
+	}
+	entityPixels.clear();
+	printf("%u trees\n", entities.size());
+
+	treeIndex.clear();
+	for(unsigned int i=0; i<entities.size(); i++) {
+		glm::vec3 p = entities.position(i);
+		float r = entities.radius()[i];
+		treeIndex.add(i, p - glm::vec3(r), p + glm::vec3(r));
+	}
+	treeIndex.build(ENTITY_GRID_CELL);
+
+
+	MakeTerrain();
+
+	return true;
+}
+
+// decodes the colour texture and queues its upload
+bool Terrain::LoadTexture(GKR::AssetLoader &loader)
+{
+	std::shared_ptr<nv::Image> iTex(new nv::Image);
+
+	// the colour texture is uploaded straight from the mapped file, so its rows stay
+	// top down and the terrain texture coordinates flip t instead
+	iTex->setFlipOnLoad(false);
+	if(!iTex->loadImageFromFile(&TERRAIN_TEX_FILENAME[0])) {
+		if(!iTex->loadImageFromFile(&TERRAIN_TEX_FILENAME[3])) {
 			return false;
+		}
+	}
 
-    GET_GLERROR()
+	// a chain that stops short of 1x1 is completed here rather than by the driver on the GL thread
+	int levels = iTex->getMipLevels();
+	if((max(iTex->getWidth(), iTex->getHeight()) >> (levels - 1)) > 1)
+		iTex->generateMipmaps(nv::Image::emfKaiser, true);
 
-	glGenTextures(1, &tex);
+	loader.upload([this, iTex]() { UploadTexture(iTex); });
+	return true;
+}
+
+// the texture starts with its smallest level, the manager streams the others in over the next frames
+void Terrain::UploadTexture(const std::shared_ptr<nv::Image> &iTex)
+{
+	tex = textures->add(iTex);
 	glBindTexture(GL_TEXTURE_2D, tex);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
-  //glTexImage2D( GL_TEXTURE_2D, 0, iTex.getInternalFormat(), iTex.getWidth(), iTex.getHeight(), 0, iTex.getImageSize(), iTex.getLevel(0));
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, iTex.getWidth(), iTex.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, iTex.getLevel(0));
-	//glCompressedTexImage2DARB( GL_TEXTURE_2D, 0, iTex.getInternalFormat(), iTex.getWidth(), iTex.getHeight(), 0, iTex.getImageSize(), iTex.getLevel(0));
 
   GET_GLERROR()
+}
 
-	height = dTex.getHeight();
-	width = dTex.getWidth();
-
-	int size = height * width;
-
-	heights = new float [size * sizeof(float)];
+// reads the heights and computes the normals of the terrain
+bool Terrain::LoadHeightmap()
+{
+	HeightmapReader heightmap;
+	if(!nv::Image::readPngRows(&DEPTH_TEX_FILENAME[0], heightmap))
+		if(!nv::Image::readPngRows(&DEPTH_TEX_FILENAME[3], heightmap))
+			return false;
 
-	GLubyte *src = (GLubyte*)dTex.getLevel(0);
-	for(int i=0; i<size; i++)
-		heights[i] = (float)src[3*i] * SCALE;
+	height = heightmap.height;
+	width = heightmap.width;
+	heights = heightmap.heights;
+	heightmap.heights = NULL;
 
+	int size = height * width;
 
-	normals = new float [3 * size * sizeof(float)];
+	normals = new float [3 * size];
 
 	for(int z=1; z<height-1; z++) {
 		for(int x=1; x<width-1; x++) {
@@ -101,84 +242,234 @@ bool Terrain::Load()
 			normals[3*(x + z*width) + 2] = v.z;
 		}
 	}
+	return true;
+}
+
+// finds the tree positions in the entity map, they are placed on the terrain once the heights are loaded
+bool Terrain::LoadEntityMap()
+{
+	nv::Image eTex;
+	if(!eTex.loadImageFromFile(&ENTITIES_TEX_FILENAME[0]))
+		if(!eTex.loadImageFromFile(&ENTITIES_TEX_FILENAME[3]))
+			return false;
 
-	int e_width = eTex.getWidth();
-	int e_height = eTex.getHeight();
-	float e_ratio_x = (float)e_width / (float)width;
-	float e_ratio_z = (float)e_height / (float)height;
+	entityMapWidth = eTex.getWidth();
+	entityMapHeight = eTex.getHeight();
 
 	GLubyte *ent = (GLubyte*)eTex.getLevel(0);
 
-	for(int z=0; z<e_height; z++) {
-		for(int x=0; x<e_width; x++) {
-			if(ent[3*(x + z*e_width)] == 255) {
-				nv::vec3f *v = new nv::vec3f;
-				v->x = e_ratio_x * (float)x;
-				v->y = heights[x + z*width];
-				v->z = e_ratio_z * (float)z;
-				entities.push_back(v);
+	entityPixels.clear();
+	for(int z=0; z<entityMapHeight; z++) {
+		for(int x=0; x<entityMapWidth; x++) {
+			if(ent[3*(x + z*entityMapWidth)] == 255) {
+				entityPixels.push_back(x + z*entityMapWidth);
 			}
 		}
 	}
+	return true;
+}
 
-	modelT = new nv::Model;
-	modelL = new nv::Model;
-	if(!LoadTree())
-	{
-		printf("Couldn't find model .obj.\n");
-		exit(0);
+void Terrain::InitCulling(GLuint cull_program)
+{
+	culler.init(cull_program);
+	culler.set_instances(entities);
+
+	float distances[TREE_LODS - 1] = { TREE_LOD_DISTANCE0, TREE_LOD_DISTANCE1 };
+	culler.set_lods(TREE_LODS, distances);
+
+	for(int lod=0; lod<TREE_MESH_LODS; lod++) {
+		GLuint indexCounts[2] = {
+			(GLuint)modelT[lod]->getCompiledIndexCount(),
+			(GLuint)modelL[lod]->getCompiledIndexCount()
+		};
+		culler.set_meshes(lod, 2, indexCounts);
 	}
 
-
-	MakeTerrain();
-
-	return true;
+	// the impostor quad is two triangles
+	GLuint impostorCount = 6;
+	culler.set_meshes(TREE_MESH_LODS, 1, &impostorCount);
 }
 
-void Terrain::Draw(GLuint t_current_program, const glm::mat4& t_view) {
-  float minCamZ = -10000.0f;
-
+// culls the terrain patches and the trees against the camera frustum and the volume of every shadow cascade
+void Terrain::Cull(GKR::Camera* camera, GKR::ShadowMap* shadow_map) {
   float half_width = 0.5f*(float)width;
   float half_height = 0.5f*(float)height;
 
-  glm::mat4 t_modelview1 = glm::translate(t_view, glm::vec3(-half_width, 0, -half_height));
-  glm::mat3 t_normalmatrix1 = glm::inverseTranspose(glm::mat3(t_modelview1));
+  // the tree positions are stored relative to the terrain corner
+  glm::mat4 t_world_from_local = glm::translate(glm::mat4(1.0f), glm::vec3(-half_width, 0, -half_height));
+
+  glm::mat4 t_clip_from_local[GKR::InstanceCuller::MAX_VIEWS];
+  t_clip_from_local[0] = camera->projection_matrix() * camera->view_matrix() * t_world_from_local;
+  for(int i = 0 ; i < shadow_map->num_splits() ; i++) {
+    t_clip_from_local[i + 1] = shadow_map->crop_matrix(i) * t_world_from_local;
+  }
+  numViews = shadow_map->num_splits() + 1;
+
+  // terrain patches are culled on the CPU in every view
+  for(int v = 0 ; v < numViews ; v++) {
+    visiblePatches[v].clear();
+    QueryView(patchIndex, t_clip_from_local[v], v > 0, visiblePatches[v]);
+  }
+
+  // levels of detail are selected by the distance to the camera in every view
+  glm::vec3 t_eye = camera->position() + glm::vec3(half_width, 0, half_height);
+  float t_lod_scale[GKR::InstanceCuller::MAX_VIEWS];
+  int t_max_lod[GKR::InstanceCuller::MAX_VIEWS];
+  for(int v = 0 ; v < numViews ; v++) {
+    t_lod_scale[v] = (v == 0) ? 1.0f : TREE_SHADOW_LOD_BIAS;
+    t_max_lod[v] = (v == 0) ? TREE_LODS - 1 : TREE_MESH_LODS - 1;
+  }
+
+  if(culler.gpu()) {
+    for(int v = 0 ; v < numViews ; v++) {
+      culler.cull(v, t_clip_from_local[v], t_eye, t_lod_scale[v], t_max_lod[v]);
+    }
+    culler.barrier();
+    return;
+  }
 
-  int far_dist = (int)FAR_DIST - 1;
+  for(int v = 0 ; v < numViews ; v++) {
+    glm::vec4 t_planes[6];
+    GKR::InstanceCuller::extract_planes(t_clip_from_local[v], t_planes);
 
-  int camx = (int)(cam_pos[0] + half_width);
-  int camz = (int)(cam_pos[2] + half_height);
+    // the index narrows the candidates down to the trees in the view volume
+    visible.clear();
+    QueryView(treeIndex, t_clip_from_local[v], v > 0, visible);
 
-  int zmin = max(camz-far_dist, 1);
-  int zmax = min(camz+far_dist, height - 1);
+    for(int lod = 0 ; lod < TREE_LODS ; lod++) {
+      instances[v][lod].clear();
+    }
+    if(!visible.empty()) {
+      culler.cull_cpu(entities, &visible[0], (unsigned int)visible.size(), t_planes, t_eye, t_lod_scale[v], t_max_lod[v], instances[v]);
+    }
+  }
+}
 
-  int xmin = max(camx-far_dist, 1);
-  int xmax = min(camx+far_dist, width - 1);
+// the camera view is a frustum query, a cascade is an oriented box, its crop matrix
+// maps the box to the [-1;1] cube
+void Terrain::QueryView(const GKR::SpatialIndex &index, const glm::mat4 &clip_from_local, bool cascade, std::vector<unsigned int> &result) {
+  if(!cascade) {
+    index.query_frustum(clip_from_local, result);
+    return;
+  }
 
-  for(unsigned int i=0; i<entities.size(); i++) {
-    nv::vec3f *v = entities[i];
-    float d = m_light_dir.x*(v->x-half_width) + m_light_dir.y*v->y + m_light_dir.z*(v->z-half_height);
-    if(minCamZ < d) { //MODEL_HEIGHT
-      glm::mat4 t_modelview2 = glm::translate(t_modelview1, glm::vec3(v->x, v->y, v->z));
-      glm::mat3 t_normalmatrix2 = glm::inverseTranspose(glm::mat3(t_modelview2));
+  glm::mat4 t_local_from_clip = glm::inverse(clip_from_local);
+  glm::vec3 t_center(t_local_from_clip[3]);
+  glm::mat3 t_axes;
+  glm::vec3 t_half_extents;
+  for(int i = 0 ; i < 3 ; i++) {
+    glm::vec3 t_axis(t_local_from_clip[i]);
+    t_half_extents[i] = sqrtf(glm::dot(t_axis, t_axis));
+    t_axes[i] = t_axis / t_half_extents[i];
+  }
+  index.query_box(t_center, t_axes, t_half_extents, result);
+}
 
-      glUniformMatrix4fv(glGetUniformLocation(t_current_program, "modelViewMatrix"), 1, GL_FALSE, glm::value_ptr(t_modelview2));
-      glUniformMatrix3fv(glGetUniformLocation(t_current_program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(t_normalmatrix2));
+// prints and resets the time spent in spatial queries since the last call
+void Terrain::PrintCullStats() {
+  const GKR::SpatialIndex* t_indices[2] = { &patchIndex, &treeIndex };
+  const char* t_names[2] = { "patches", "trees" };
 
-      DrawTree();
+  for(int i = 0 ; i < 2 ; i++) {
+    const GKR::SpatialIndex::Stats& t_stats = t_indices[i]->stats();
+    if(t_stats.queries == 0) {
+      continue;
     }
+    printf("%s: %u queries, %.4f ms/query, %.1f cells, %.1f boxes tested, %.1f found per query\n", t_names[i],
+           t_stats.queries, t_stats.milliseconds / t_stats.queries, (float)t_stats.cells_tested / t_stats.queries,
+           (float)t_stats.boxes_tested / t_stats.queries, (float)t_stats.boxes_found / t_stats.queries);
   }
+  patchIndex.reset_stats();
+  treeIndex.reset_stats();
+}
+
+void Terrain::Draw(GLuint t_current_program, const glm::mat4& t_view, int t_view_index) {
+  float half_width = 0.5f*(float)width;
+  float half_height = 0.5f*(float)height;
+
+  glm::mat4 t_modelview1 = glm::translate(t_view, glm::vec3(-half_width, 0, -half_height));
+  glm::mat3 t_normalmatrix1 = glm::inverseTranspose(glm::mat3(t_modelview1));
 
+  // trees and terrain share the terrain modelview, the tree offsets come from the instance attribute
   glUniformMatrix4fv(glGetUniformLocation(t_current_program, "modelViewMatrix"), 1, GL_FALSE, glm::value_ptr(t_modelview1));
   glUniformMatrix3fv(glGetUniformLocation(t_current_program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(t_normalmatrix1));
 
+  if(t_view_index < numViews) {
+    DrawTree(t_current_program, t_view_index);
+  }
+
+  // the terrain has plain float positions and normals
+  glUniform3f(glGetUniformLocation(t_current_program, "positionScale"), 1.0f, 1.0f, 1.0f);
+  glUniform3f(glGetUniformLocation(t_current_program, "positionBias"), 0.0f, 0.0f, 0.0f);
+  glUniform1i(glGetUniformLocation(t_current_program, "octNormals"), 0);
+
+  textures->touch(tex);
   glActiveTexture(GL_TEXTURE1);
-  glCallList(terrain_list);
+  if(t_view_index < numViews) {
+    for(unsigned int i = 0 ; i < visiblePatches[t_view_index].size() ; i++) {
+      glCallList(terrain_list + visiblePatches[t_view_index][i]);
+    }
+  }
+  else {
+    for(int i = 0 ; i < numPatches ; i++) {
+      glCallList(terrain_list + i);
+    }
+  }
 
   glMatrixMode(GL_MODELVIEW);
   glActiveTexture(GL_TEXTURE0);
 }
 
+// draws the trees beyond the last mesh level in the camera view as billboards. The
+// caller sets up the impostor program (projection, light and fog).
+void Terrain::DrawImpostors(GLuint impostor_program, const glm::mat4& t_view) {
+  const int lod = TREE_LODS - 1;
+  bool gpu = culler.gpu();
+  int instance_count = (int)instances[0][lod].size() / 4;
+
+  if(numViews == 0 || (!gpu && instance_count == 0)) {
+    return;
+  }
+
+  float half_width = 0.5f*(float)width;
+  float half_height = 0.5f*(float)height;
+  glm::mat4 t_modelview1 = glm::translate(t_view, glm::vec3(-half_width, 0, -half_height));
+
+  glUniformMatrix4fv(glGetUniformLocation(impostor_program, "modelViewMatrix"), 1, GL_FALSE, glm::value_ptr(t_modelview1));
+  glUniform1i(glGetUniformLocation(impostor_program, "impostor"), 2);
+
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, impostorTex);
+
+  GLint instanceLoc = glGetAttribLocation(impostor_program, "instance");
+  BindInstances(instanceLoc, 0, lod);
+
+  glBindBuffer(GL_ARRAY_BUFFER, impostorVbo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, impostorEbo);
+  glVertexPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), NULL);
+  glClientActiveTexture(GL_TEXTURE0);
+  glTexCoordPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), (GLubyte *)NULL + 2 * sizeof(GLfloat));
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+  if(gpu) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culler.command_buffer(0));
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLubyte *)NULL + GKR::InstanceCuller::command_offset(lod, 0));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+  else {
+    glDrawElementsInstancedARB(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL, instance_count);
+  }
+
+  UnbindInstances(instanceLoc);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+}
+
 void Terrain::DrawCoarse()
 {
 	float half_width = 0.5f*(float)width;
@@ -200,10 +491,10 @@ void Terrain::DrawCoarse()
 		{
 			float fx = (float)x;
 			float fz = (float)z;
-			glTexCoord2f( fx*inv_width, fz*inv_height );
+			glTexCoord2f( fx*inv_width, 1.0f - fz*inv_height );
 			glNormal3fv(&normals[3*(x + z*width)]);
 			glVertex3f( fx, heights[x + z*width], fz );
-			glTexCoord2f( fx*inv_width, (fz+8.0f)*inv_height );
+			glTexCoord2f( fx*inv_width, 1.0f - (fz+8.0f)*inv_height );
 			glNormal3fv(&normals[3*(x + (z+8)*width)]);
 			glVertex3f( fx, heights[x + (z+8)*width], fz+8.0f );
 		}
@@ -220,110 +511,421 @@ void Terrain::MakeTerrain()
 	const float inv_height = 1.0f / (float)height;
 	const float inv_width = 1.0f / (float)width;
 
-	terrain_list = glGenLists(1);
-	glNewList(terrain_list, GL_COMPILE);
-
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-	glTranslatef(-half_width, 0, -half_height);
-
-	glBindTexture(GL_TEXTURE_2D, tex);
+	// the same strips as one list for the whole terrain, cut into square patches
+	int patches_x = (width - 3 + TERRAIN_PATCH_SIZE - 1) / TERRAIN_PATCH_SIZE;
+	int patches_z = (height - 3 + TERRAIN_PATCH_SIZE - 1) / TERRAIN_PATCH_SIZE;
+	numPatches = patches_x * patches_z;
+	terrain_list = glGenLists(numPatches);
+	patchIndex.clear();
 
-	for(int z=1; z<height-2; z++)
+	for(int pz=0; pz<patches_z; pz++)
 	{
-		glBegin(GL_TRIANGLE_STRIP);
-		for(int x=1; x<width-1; x++)
+		for(int px=0; px<patches_x; px++)
 		{
-			float fx = (float)x;
-			float fz = (float)z;
-			glTexCoord2f( fx*inv_width, fz*inv_height );
-			glNormal3fv(&normals[3*(x + z*width)]);
-			glVertex3f( fx, heights[x + z*width], fz );
-			glTexCoord2f( fx*inv_width, (fz+1.0f)*inv_height );
-			glNormal3fv(&normals[3*(x + (z+1)*width)]);
-			glVertex3f( fx, heights[x + (z+1)*width], fz+1.0f );
+			int patch = pz * patches_x + px;
+			int x0 = 1 + px * TERRAIN_PATCH_SIZE;
+			int z0 = 1 + pz * TERRAIN_PATCH_SIZE;
+			int x1 = min(x0 + TERRAIN_PATCH_SIZE, width - 2);
+			int z1 = min(z0 + TERRAIN_PATCH_SIZE, height - 2);
+
+			float ymin = heights[x0 + z0*width];
+			float ymax = ymin;
+
+			glNewList(terrain_list + patch, GL_COMPILE);
+
+			glMatrixMode(GL_MODELVIEW);
+			glPushMatrix();
+			glTranslatef(-half_width, 0, -half_height);
+
+			glBindTexture(GL_TEXTURE_2D, tex);
+
+			for(int z=z0; z<z1; z++)
+			{
+				glBegin(GL_TRIANGLE_STRIP);
+				for(int x=x0; x<=x1; x++)
+				{
+					float fx = (float)x;
+					float fz = (float)z;
+					glTexCoord2f( fx*inv_width, 1.0f - fz*inv_height );
+					glNormal3fv(&normals[3*(x + z*width)]);
+					glVertex3f( fx, heights[x + z*width], fz );
+					glTexCoord2f( fx*inv_width, 1.0f - (fz+1.0f)*inv_height );
+					glNormal3fv(&normals[3*(x + (z+1)*width)]);
+					glVertex3f( fx, heights[x + (z+1)*width], fz+1.0f );
+
+					ymin = min(ymin, min(heights[x + z*width], heights[x + (z+1)*width]));
+					ymax = max(ymax, max(heights[x + z*width], heights[x + (z+1)*width]));
+				}
+				glEnd();
+			}
+			glPopMatrix();
+
+			glEndList();
 
+			patchIndex.add(patch, glm::vec3((float)x0, ymin, (float)z0), glm::vec3((float)x1, ymax, (float)z1));
 		}
-		glEnd();
 	}
-	glPopMatrix();
+	patchIndex.build(TERRAIN_INDEX_CELL);
+	printf("%d terrain patches\n", numPatches);
+}
 
-	glEndList();
+// key of a compiled tree mesh file, everything the compiled mesh depends on goes in here
+static unsigned long long TreeCacheKey(unsigned long long sourceHash, int lod)
+{
+	const float params[] = { (float)lod, TREE_LOD_RATIO, (float)TREE_VERTEX_CACHE_SIZE, (float)TREE_CLUSTER_VERTICES, (float)TREE_CLUSTER_TRIANGLES };
+	return nv::Model::hashData(params, sizeof(params), sourceHash);
+}
+
+// the models are found relative to either the build or the source directory
+static const char* FindModel(const char *filename, unsigned long long &hash)
+{
+	hash = nv::Model::hashFile(&filename[0]);
+	if (hash)
+		return &filename[0];
+	hash = nv::Model::hashFile(&filename[3]);
+	return hash ? &filename[3] : NULL;
 }
 
-bool Terrain::LoadTree()
+// loads the levels of the trunk or the leaves and queues their upload
+bool Terrain::LoadTree(GKR::AssetLoader &loader, bool leaves)
 {
-	printf("loading OBJ trunk...\n");
-	if (!modelT->loadModelFromFile(&MODEL_FILENAMET[0])) {
-		if (!modelT->loadModelFromFile(&MODEL_FILENAMET[3]))
+	nv::Model **models = leaves ? modelL : modelT;
+
+	unsigned long long hash;
+	const char *file = FindModel(leaves ? MODEL_FILENAMEL : MODEL_FILENAMET, hash);
+	if (!file)
+		return false;
+
+	// meshes compiled by an earlier run from the same sources are mapped from their cache files
+	char cache[TREE_MESH_LODS][1024];
+	bool cached = true;
+	for(int lod=0; lod<TREE_MESH_LODS; lod++) {
+		snprintf(cache[lod], sizeof(cache[lod]), "%s.lod%d.cache", file, lod);
+		cached = cached && models[lod]->loadCompiledModel(cache[lod], TreeCacheKey(hash, lod));
+	}
+
+	if (cached) {
+		printf("loaded compiled tree %s\n", leaves ? "leaves" : "trunk");
+	}
+	else {
+		if (!CompileTree(file, leaves))
 			return false;
+		for(int lod=0; lod<TREE_MESH_LODS; lod++) {
+			if (!models[lod]->saveCompiledModel(cache[lod], TreeCacheKey(hash, lod)))
+				printf("could not write the compiled tree %s\n", leaves ? "leaves" : "trunk");
+		}
+	}
+
+	for(int lod=0; lod<TREE_MESH_LODS; lod++) {
+		models[lod]->packCompiledModel(TREE_VERTEX_FORMAT);
+		models[lod]->packDepthStream(TREE_VERTEX_CACHE_SIZE);
+	}
+
+	loader.upload([this, leaves]() {
+		for(int lod=0; lod<TREE_MESH_LODS; lod++) {
+			if (leaves) {
+				UploadMesh(modelL[lod], false, vboIdL[lod], eboIdL[lod]);
+				UploadMesh(modelL[lod], true, depthVboL[lod], depthEboL[lod]);
+			}
+			else {
+				UploadMesh(modelT[lod], false, vboIdT[lod], eboIdT[lod]);
+				UploadMesh(modelT[lod], true, depthVboT[lod], depthEboT[lod]);
+			}
+		}
+	});
+	return true;
+}
+
+// builds the levels of the trunk or the leaves from the OBJ file
+bool Terrain::CompileTree(const char *file, bool leaves)
+{
+	nv::Model **models = leaves ? modelL : modelT;
+	const char *name = leaves ? "leaves" : "trunk";
+
+	printf("loading OBJ %s...\n", name);
+	if (!models[0]->loadModelFromFile(file))
+		return false;
+
+	// every further level keeps TREE_LOD_RATIO of the triangles of the previous one
+	for(int lod=1; lod<TREE_MESH_LODS; lod++) {
+		*models[lod] = *models[lod-1];
+		int tris = models[lod]->simplify(TREE_LOD_RATIO);
+		printf("tree LOD %d: %d %s triangles\n", lod, tris, name);
+	}
+
+	for(int lod=0; lod<TREE_MESH_LODS; lod++) {
+		models[lod]->compileModel();
+		float acmr = models[lod]->getCompiledACMR(TREE_VERTEX_CACHE_SIZE);
+		// leaf cards overlap heavily, so they are also sorted against overdraw
+		models[lod]->optimizeCompiledModel(TREE_VERTEX_CACHE_SIZE, leaves);
+		models[lod]->buildClusters(TREE_CLUSTER_VERTICES, TREE_CLUSTER_TRIANGLES, TREE_VERTEX_CACHE_SIZE);
+		printf("tree LOD %d %s: ACMR %.3f -> %.3f, %d clusters\n", lod, name,
+			acmr, models[lod]->getCompiledACMR(TREE_VERTEX_CACHE_SIZE), models[lod]->getClusterCount());
 	}
-	modelT->compileModel();
+	return true;
+}
 
-	int totalVertexSize = modelT->getCompiledVertexCount() * modelT->getCompiledVertexSize() * sizeof(GLfloat);
-	int totalIndexSize = modelT->getCompiledIndexCount() * sizeof(GLuint);
+// uploads the packed vertices of a mesh, or its position only stream for the depth passes
+void Terrain::UploadMesh(nv::Model *model, bool depth, GLuint &vbo, GLuint &ebo)
+{
+	int totalVertexSize = depth ? model->getDepthVertexCount() * model->getDepthVertexSize() : model->getCompiledVertexCount() * model->getPackedVertexSize();
+	int totalIndexSize = model->getCompiledIndexCount() * sizeof(GLuint);
 
-	glGenBuffers(1, &vboIdT);
-	glBindBuffer(GL_ARRAY_BUFFER, vboIdT);
-    glBufferData(GL_ARRAY_BUFFER, totalVertexSize, modelT->getCompiledVertices(), GL_STATIC_DRAW);
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, totalVertexSize, depth ? model->getDepthVertices() : model->getPackedVertices(), GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glGenBuffers(1, &eboIdT);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboIdT);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndexSize, modelT->getCompiledIndices(), GL_STATIC_DRAW);
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndexSize, depth ? model->getDepthIndices() : model->getCompiledIndices(), GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
 
-	printf("loading OBJ leaves...\n");
-	if (!modelL->loadModelFromFile(&MODEL_FILENAMEL[0])) {
-		if (!modelL->loadModelFromFile(&MODEL_FILENAMEL[3]))
-			return false;
+// renders the full tree from the side into a texture and builds the quad it is drawn on
+void Terrain::MakeImpostor()
+{
+	nv::vec3f minT, maxT, minL, maxL;
+	modelT[0]->computeBoundingBox(minT, maxT);
+	modelL[0]->computeBoundingBox(minL, maxL);
+
+	float bottom = min(minT.y, minL.y);
+	float top = max(maxT.y, maxL.y);
+	float half = 0.0f;
+	for(int i=0; i<3; i+=2) {
+		half = max(half, max(max(-minT[i], maxT[i]), max(-minL[i], maxL[i])));
 	}
-	modelL->compileModel();
+	float depth = half + 1.0f;
 
-	totalVertexSize = modelL->getCompiledVertexCount() * modelL->getCompiledVertexSize() * sizeof(GLfloat);
-	totalIndexSize = modelL->getCompiledIndexCount() * sizeof(GLuint);
+	glGenTextures(1, &impostorTex);
+	glBindTexture(GL_TEXTURE_2D, impostorTex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, IMPOSTOR_TEX_SIZE, IMPOSTOR_TEX_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLuint fbo, depthRb;
+	glGenRenderbuffers(1, &depthRb);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthRb);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, IMPOSTOR_TEX_SIZE, IMPOSTOR_TEX_SIZE);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, impostorTex, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRb);
+
+	glPushAttrib(GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT | GL_ENABLE_BIT);
+	glViewport(0, 0, IMPOSTOR_TEX_SIZE, IMPOSTOR_TEX_SIZE);
+
+	// transparent texels take the leaf color, so filtering does not darken the outline
+	glClearColor(LEAVES_COLOR[0], LEAVES_COLOR[1], LEAVES_COLOR[2], 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(-half, half, bottom, top, -depth, depth);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	for(int mesh=0; mesh<2; mesh++) {
+		nv::Model *model = mesh ? modelL[0] : modelT[0];
+		const float *color = mesh ? LEAVES_COLOR : TRUNK_COLOR;
+		glColor4f(color[0], color[1], color[2], 1.0f);
+		BindMesh(0, model, true, mesh ? depthVboL[0] : depthVboT[0], mesh ? depthEboL[0] : depthEboT[0]);
+
+		// without a program the quantized positions are restored by the modelview matrix
+		nv::vec3f scale, bias;
+		model->getPackedPositionTransform(scale, bias);
+		glPushMatrix();
+		glTranslatef(bias[0], bias[1], bias[2]);
+		glScalef(scale[0], scale[1], scale[2]);
+		glDrawElements(GL_TRIANGLES, model->getCompiledIndexCount(), GL_UNSIGNED_INT, NULL);
+		glPopMatrix();
+	}
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
 
-	glGenBuffers(1, &vboIdL);
-	glBindBuffer(GL_ARRAY_BUFFER, vboIdL);
-    glBufferData(GL_ARRAY_BUFFER, totalVertexSize, modelL->getCompiledVertices(), GL_STATIC_DRAW);
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glPopAttrib();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteRenderbuffers(1, &depthRb);
+
+	glBindTexture(GL_TEXTURE_2D, impostorTex);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// x, y in model units around the base point of the tree, s, t
+	const float quad[16] = {
+		-half, bottom, 0.0f, 0.0f,
+		 half, bottom, 1.0f, 0.0f,
+		 half, top,    1.0f, 1.0f,
+		-half, top,    0.0f, 1.0f
+	};
+	const GLuint quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+
+	glGenBuffers(1, &impostorVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, impostorVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glGenBuffers(1, &eboIdL);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboIdL);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndexSize, modelL->getCompiledIndices(), GL_STATIC_DRAW);
+	glGenBuffers(1, &impostorEbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, impostorEbo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), quadIndices, GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	return true;
 }
 
 
-void Terrain::DrawTree()
+// bounding radius of a tree (trunk and leaves) around its base point
+float Terrain::TreeRadius()
 {
-	glBindBuffer(GL_ARRAY_BUFFER, vboIdT);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboIdT);
-	int stride = modelT->getCompiledVertexSize() * sizeof(GLfloat);
-	int normalOffset = modelT->getCompiledNormalOffset() * sizeof(GLfloat);
-	glVertexPointer(modelT->getPositionSize(), GL_FLOAT, stride, NULL);
-	glNormalPointer(GL_FLOAT, stride, (GLubyte *)NULL + normalOffset);
-	glEnableClientState(GL_VERTEX_ARRAY);
-	glEnableClientState(GL_NORMAL_ARRAY);
+	nv::vec3f minT, maxT, minL, maxL;
+	modelT[0]->computeBoundingBox(minT, maxT);
+	modelL[0]->computeBoundingBox(minL, maxL);
+
+	nv::vec3f ext;
+	for(int i=0; i<3; i++)
+		ext[i] = max(max(-minT[i], maxT[i]), max(-minL[i], maxL[i]));
+	return sqrtf(dot(ext, ext));
+}
+
+// points the instance attribute at the trees of a level in a view. With GPU culling
+// the range of the level is selected by the baseInstance of its indirect commands.
+void Terrain::BindInstances(GLint instanceLoc, int view, int lod)
+{
+	if(culler.gpu()) {
+		glBindBuffer(GL_ARRAY_BUFFER, culler.instance_buffer(view));
+	}
+	else {
+		// orphan the previous contents, the driver may still be reading them for the last draw
+		std::vector<float> &list = instances[view][lod];
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+		glBufferData(GL_ARRAY_BUFFER, list.size() * sizeof(float), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, list.size() * sizeof(float), &list[0]);
+	}
+	if(instanceLoc >= 0) {
+		glVertexAttribPointer(instanceLoc, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+		glVertexAttribDivisorARB(instanceLoc, 1);
+		glEnableVertexAttribArray(instanceLoc);
+	}
+}
+
+void Terrain::UnbindInstances(GLint instanceLoc)
+{
+	if(instanceLoc >= 0) {
+		// restore the identity placement used by the non-instanced terrain
+		glDisableVertexAttribArray(instanceLoc);
+		glVertexAttribDivisorARB(instanceLoc, 0);
+		glVertexAttrib4f(instanceLoc, 0.0f, 0.0f, 0.0f, 1.0f);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-	glColor3f(0.917647f, 0.776471f, 0.576471f);
-	glDrawElements(GL_TRIANGLES, modelT->getCompiledIndexCount(), GL_UNSIGNED_INT, NULL);
+// points the vertex arrays at the packed vertices of a mesh, or at its position only stream.
+// Programs restore quantized positions with the positionScale and positionBias uniforms, and
+// read octahedral normals from the normalOct attribute.
+void Terrain::BindMesh(GLuint program, nv::Model *model, bool depth, GLuint vbo, GLuint ebo)
+{
+	nv::Model::VertexAttrib position = model->getPackedAttrib(nv::Model::eaPosition);
+	nv::Model::VertexAttrib normal = model->getPackedAttrib(nv::Model::eaNormal);
+	int stride = model->getPackedVertexSize();
+	if(depth) {
+		position.offset = 0;
+		normal.size = 0;
+		stride = model->getDepthVertexSize();
+	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, vboIdL);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboIdL);
-	stride = modelL->getCompiledVertexSize() * sizeof(GLfloat);
-	normalOffset = modelL->getCompiledNormalOffset() * sizeof(GLfloat);
-	glVertexPointer(modelL->getPositionSize(), GL_FLOAT, stride, NULL);
-	glNormalPointer(GL_FLOAT, stride, (GLubyte *)NULL + normalOffset);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glVertexPointer(position.size, position.type, stride, (GLubyte *)NULL + position.offset);
 	glEnableClientState(GL_VERTEX_ARRAY);
-	glEnableClientState(GL_NORMAL_ARRAY);
 
-	glColor3f(0.301961f, 0.588235f, 0.309804f);
-	glDrawElements(GL_TRIANGLES, modelL->getCompiledIndexCount(), GL_UNSIGNED_INT, NULL);
+	if(normal.size == 3) {
+		glNormalPointer(normal.type, stride, (GLubyte *)NULL + normal.offset);
+		glEnableClientState(GL_NORMAL_ARRAY);
+	}
+
+	if(!program)
+		return;
+
+	nv::vec3f scale, bias;
+	model->getPackedPositionTransform(scale, bias);
+	glUniform3f(glGetUniformLocation(program, "positionScale"), scale[0], scale[1], scale[2]);
+	glUniform3f(glGetUniformLocation(program, "positionBias"), bias[0], bias[1], bias[2]);
+	glUniform1i(glGetUniformLocation(program, "octNormals"), normal.size == 2);
+
+	GLint normalLoc = glGetAttribLocation(program, "normalOct");
+	if(normal.size == 2 && normalLoc >= 0) {
+		glVertexAttribPointer(normalLoc, 2, normal.type, normal.normalized, stride, (GLubyte *)NULL + normal.offset);
+		glEnableVertexAttribArray(normalLoc);
+	}
+}
+
+// one instanced draw of a mesh, the instance count comes from the culler's command on the GPU
+void Terrain::DrawMesh(GLuint program, nv::Model *model, bool depth, GLuint vbo, GLuint ebo, int lod, int mesh, int instance_count)
+{
+	BindMesh(program, model, depth, vbo, ebo);
+
+	if(culler.gpu())
+		glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLubyte *)NULL + GKR::InstanceCuller::command_offset(lod, mesh));
+	else
+		glDrawElementsInstancedARB(GL_TRIANGLES, model->getCompiledIndexCount(), GL_UNSIGNED_INT, NULL, instance_count);
+}
+
+// draws the mesh levels of the trees visible in a view with one instanced call per level for
+// the trunks and one for the leaves. With GPU culling the instance lists and the instance
+// counts never leave the GPU.
+void Terrain::DrawTree(GLuint t_current_program, int view)
+{
+	bool gpu = culler.gpu();
+	GLint instanceLoc = glGetAttribLocation(t_current_program, "instance");
+
+	// the cascades only write depth, they draw the position only streams
+	bool depth = view > 0;
+
+	if(gpu)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culler.command_buffer(view));
+
+	for(int lod=0; lod<TREE_MESH_LODS; lod++) {
+		int instance_count = (int)instances[view][lod].size() / 4;
+		if(!gpu && instance_count == 0)
+			continue;
 
+		BindInstances(instanceLoc, view, lod);
+
+		glColor3fv(TRUNK_COLOR);
+		DrawMesh(t_current_program, modelT[lod], depth, depth ? depthVboT[lod] : vboIdT[lod], depth ? depthEboT[lod] : eboIdT[lod], lod, 0, instance_count);
+
+		glColor3fv(LEAVES_COLOR);
+		DrawMesh(t_current_program, modelL[lod], depth, depth ? depthVboL[lod] : vboIdL[lod], depth ? depthEboL[lod] : eboIdL[lod], lod, 1, instance_count);
+	}
+
+	UnbindInstances(instanceLoc);
+
+	GLint normalLoc = glGetAttribLocation(t_current_program, "normalOct");
+	if(normalLoc >= 0)
+		glDisableVertexAttribArray(normalLoc);
+
+	if(gpu)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glDisableClientState(GL_VERTEX_ARRAY);
 	glDisableClientState(GL_NORMAL_ARRAY);
 	glColor3f(1.0f, 1.0f, 1.0f);
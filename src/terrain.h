@@ -6,48 +6,134 @@
 
 #include "main.h"
 #include <vector>
+#include <future>
 #include <nvModel.h>
+#include <asset_loader.hpp>
+#include <texture_manager.hpp>
+#include <entity_list.hpp>
+#include <instance_culler.hpp>
+#include <spatial_index.hpp>
 
 #define SCALE 0.2f;
 #define MODEL_Y_TRANSLATE -0.1f
 #define MODEL_HEIGHT 3.0f
+#define ENTITY_GRID_CELL 16.0f
+// the terrain is drawn in square patches of this many quads, culled per view
+#define TERRAIN_PATCH_SIZE 32
+#define TERRAIN_INDEX_CELL 64.0f
 
+// tree levels of detail: full mesh, simplified mesh, billboard impostor
+#define TREE_LODS 3
+#define TREE_MESH_LODS 2
+#define TREE_LOD_RATIO 0.25f
+#define TREE_LOD_DISTANCE0 40.0f
+#define TREE_LOD_DISTANCE1 100.0f
+// shadow casters switch levels at shorter distances and never use impostors
+#define TREE_SHADOW_LOD_BIAS 2.0f
+#define IMPOSTOR_TEX_SIZE 256
+// post-transform cache size the tree meshes are ordered for
+#define TREE_VERTEX_CACHE_SIZE 32
+// tree vertices: 16 bit positions and octahedral normals, 12 instead of 24 bytes
+#define TREE_VERTEX_FORMAT nv::Model::evfCompact
+// the tree meshes are split in clusters of this size for culling parts of them
+#define TREE_CLUSTER_VERTICES 64
+#define TREE_CLUSTER_TRIANGLES 124
 
-const char TERRAIN_TEX_FILENAME[] = "../../media/textures/gcanyon.png";
+
+const char TERRAIN_TEX_FILENAME[] = "../../media/textures/gcanyon.dds";
 const char DEPTH_TEX_FILENAME[] = "../../media/textures/gcanyond.png";
 const char ENTITIES_TEX_FILENAME[] = "../../media/textures/entities.png";
 const char MODEL_FILENAMET[] = "../../media/models/trunk.obj";
 const char MODEL_FILENAMEL[] = "../../media/models/leaves.obj";
 
+namespace nv { class Image; }
+
 class Terrain
 {
 public:
 	Terrain();
 	~Terrain();
-	bool	Load();
-  void Draw(GLuint t_current_program, const glm::mat4& t_view);
+	void	Load(GKR::AssetLoader &loader, GKR::TextureManager &textureManager);
+	bool	FinishLoad(GKR::AssetLoader &loader);
+	void	InitCulling(GLuint cull_program);
+	void	Cull(GKR::Camera* camera, GKR::ShadowMap* shadow_map);
+  void Draw(GLuint t_current_program, const glm::mat4& t_view, int t_view_index);
+	void	DrawImpostors(GLuint impostor_program, const glm::mat4& t_view);
 	void	DrawCoarse();
+	void	PrintCullStats();
 	int		getDim(){ return (width>height)?width:height;	}
 private:
 	void	MakeTerrain();
-	bool	LoadTree();
-	void	DrawTree();
+	void	QueryView(const GKR::SpatialIndex &index, const glm::mat4 &clip_from_local, bool cascade, std::vector<unsigned int> &result);
+	bool	LoadTexture(GKR::AssetLoader &loader);
+	void	UploadTexture(const std::shared_ptr<nv::Image> &iTex);
+	bool	LoadHeightmap();
+	bool	LoadEntityMap();
+	bool	LoadTree(GKR::AssetLoader &loader, bool leaves);
+	bool	CompileTree(const char *file, bool leaves);
+	void	UploadMesh(nv::Model *model, bool depth, GLuint &vbo, GLuint &ebo);
+	void	MakeImpostor();
+	void	BindInstances(GLint instanceLoc, int view, int lod);
+	void	UnbindInstances(GLint instanceLoc);
+	void	BindMesh(GLuint program, nv::Model *model, bool depth, GLuint vbo, GLuint ebo);
+	void	DrawMesh(GLuint program, nv::Model *model, bool depth, GLuint vbo, GLuint ebo, int lod, int mesh, int instance_count);
+	void	DrawTree(GLuint t_current_program, int view);
+	float	TreeRadius();
 
+	// streamed and owned by the texture manager
+	GKR::TextureManager *textures;
 	GLuint	tex;
 	float	*heights;
 	float	*normals;
-	std::vector<nv::vec3f *> entities;
+	GKR::EntityList entities;
+	std::vector<unsigned int> visible;
+
+	// bounds of the terrain patches and trees in terrain space, queried for every view
+	GKR::SpatialIndex patchIndex;
+	GKR::SpatialIndex treeIndex;
+	std::vector<unsigned int> visiblePatches[GKR::InstanceCuller::MAX_VIEWS];
+	int		numPatches;
+
+	// view 0 is the camera, views 1.. are the shadow cascades
+	GKR::InstanceCuller culler;
+	int		numViews;
+
+	// CPU culling results, per-instance vec4 (translation, scale) of the trees of every view and level
+	std::vector<float> instances[GKR::InstanceCuller::MAX_VIEWS][TREE_LODS];
+	GLuint	instanceVbo;
 
 	int		height;
 	int		width;
 
-	nv::Model	*modelT;
-	nv::Model	*modelL;
+	// level 0 is loaded, the others are simplified from it
+	nv::Model	*modelT[TREE_MESH_LODS];
+	nv::Model	*modelL[TREE_MESH_LODS];
+
+	GLuint	vboIdT[TREE_MESH_LODS];
+	GLuint	eboIdT[TREE_MESH_LODS];
+	GLuint	vboIdL[TREE_MESH_LODS];
+	GLuint	eboIdL[TREE_MESH_LODS];
+	// position only streams of the meshes for the depth passes
+	GLuint	depthVboT[TREE_MESH_LODS];
+	GLuint	depthEboT[TREE_MESH_LODS];
+	GLuint	depthVboL[TREE_MESH_LODS];
+	GLuint	depthEboL[TREE_MESH_LODS];
 
-	GLuint	vboIdT;
-	GLuint	eboIdT;
-	GLuint	vboIdL;
-	GLuint	eboIdL;
+	// side view of the full tree, drawn on camera facing quads
+	GLuint	impostorTex;
+	GLuint	impostorVbo;
+	GLuint	impostorEbo;
 
+	// display lists of the patches, terrain_list + i is patch i
 	GLuint	terrain_list;
+
+	// loading jobs started by Load, the trees are placed once all of them are done
+	std::future<bool> textureJob;
+	std::future<bool> heightmapJob;
+	std::future<bool> entityMapJob;
+	std::future<bool> treeJobT;
+	std::future<bool> treeJobL;
+	std::vector<int> entityPixels;
+	int		entityMapWidth;
+	int		entityMapHeight;
 };
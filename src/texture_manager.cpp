@@ -0,0 +1,302 @@
+#include <texture_manager.hpp>
+
+#include <nvImage.h>
+
+#include <algorithm>
+#include <string.h>
+
+/** */
+namespace GKR {
+
+/** */
+TextureManager::TextureManager(size_t t_budget, size_t t_frame_bytes) :
+    m_budget(t_budget),
+    m_frame_bytes(t_frame_bytes),
+    m_resident(0),
+    m_frame(0),
+    m_buffer(0),
+    m_mapped(NULL) {
+  for(int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+    m_fences[i] = 0;
+  }
+}
+
+/** */
+TextureManager::~TextureManager() {
+  for(size_t i = 0; i < m_textures.size(); i++) {
+    glDeleteTextures(1, &m_textures[i].name);
+  }
+  for(int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+    if(m_fences[i]) {
+      glDeleteSync(m_fences[i]);
+    }
+  }
+  if(m_buffer) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &m_buffer);
+  }
+}
+
+/** without persistent mapping the rows are uploaded from the images, the chunks stay the same */
+void TextureManager::init() {
+  if(!glewIsSupported("GL_ARB_buffer_storage")) {
+    return;
+  }
+
+  const GLbitfield t_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  GLsizeiptr t_size = (GLsizeiptr)(m_frame_bytes * FRAMES_IN_FLIGHT);
+
+  glGenBuffers(1, &m_buffer);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+  glBufferStorage(GL_PIXEL_UNPACK_BUFFER, t_size, NULL, t_flags);
+  m_mapped = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, t_size, t_flags);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if(!m_mapped) {
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+  }
+}
+
+/** */
+GLuint TextureManager::add(const std::shared_ptr<const nv::Image>& t_image) {
+  if(t_image->getMipLevels() < 1 || t_image->isCubeMap() || t_image->isVolume()) {
+    return 0;
+  }
+
+  Texture t_texture;
+  t_texture.image = t_image;
+  t_texture.base = t_image->getMipLevels() - 1;
+  t_texture.loading = -1;
+  t_texture.loaded_rows = 0;
+  t_texture.bytes = t_image->getImageSize(t_texture.base);
+  t_texture.last_used = m_frame;
+
+  GLint t_bound;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &t_bound);
+  glGenTextures(1, &t_texture.name);
+  glBindTexture(GL_TEXTURE_2D, t_texture.name);
+
+  // the smallest level makes the texture complete right away, the others are streamed
+  int t_level = t_texture.base;
+  int t_width = std::max(t_image->getWidth() >> t_level, 1);
+  int t_height = std::max(t_image->getHeight() >> t_level, 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, t_level);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, t_level);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if(t_image->isCompressed()) {
+    glCompressedTexImage2D(GL_TEXTURE_2D, t_level, t_image->getInternalFormat(), t_width, t_height, 0,
+                           t_image->getImageSize(t_level), t_image->getLevel(t_level));
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, t_level, t_image->getInternalFormat(), t_width, t_height, 0,
+                 t_image->getFormat(), t_image->getType(), t_image->getLevel(t_level));
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D, t_bound);
+
+  m_resident += t_texture.bytes;
+  m_names[t_texture.name] = m_textures.size();
+  m_textures.push_back(t_texture);
+
+  return t_texture.name;
+}
+
+/** */
+void TextureManager::touch(GLuint t_texture) {
+  std::map<GLuint, size_t>::iterator t_it = m_names.find(t_texture);
+  if(t_it != m_names.end()) {
+    m_textures[t_it->second].last_used = m_frame;
+  }
+}
+
+/** the fence of a part of the ring is waited for FRAMES_IN_FLIGHT frames after it was set, by then it has passed */
+void TextureManager::update() {
+  int t_part = m_frame % FRAMES_IN_FLIGHT;
+  if(m_fences[t_part]) {
+    glClientWaitSync(m_fences[t_part], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(m_fences[t_part]);
+    m_fences[t_part] = 0;
+  }
+
+  // textures used in the last frame stream first, the most recently used first
+  std::vector<size_t> t_order;
+  for(size_t i = 0; i < m_textures.size(); i++) {
+    const Texture& t_texture = m_textures[i];
+    if(t_texture.last_used + 1 >= m_frame && (t_texture.base > 0 || t_texture.loading >= 0)) {
+      t_order.push_back(i);
+    }
+  }
+  std::stable_sort(t_order.begin(), t_order.end(), [this](size_t a, size_t b) {
+    return m_textures[a].last_used > m_textures[b].last_used;
+  });
+
+  GLint t_bound;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &t_bound);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  size_t t_frame_used = 0;
+  for(size_t i = 0; i < t_order.size() && t_frame_used < m_frame_bytes; i++) {
+    glBindTexture(GL_TEXTURE_2D, m_textures[t_order[i]].name);
+    if(!stream(m_textures[t_order[i]], t_frame_used)) {
+      break;
+    }
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D, t_bound);
+
+  if(m_mapped && t_frame_used > 0) {
+    m_fences[t_part] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  m_frame++;
+}
+
+/** */
+size_t TextureManager::resident() const {
+  return m_resident;
+}
+
+/**
+ * Uploads rows of the next larger levels of a bound texture until the frame's bytes are used,
+ * returns false once the frame is full. Rows of compressed levels are rows of 4x4 blocks.
+ */
+bool TextureManager::stream(Texture& t_texture, size_t& t_frame_used) {
+  const nv::Image& t_image = *t_texture.image;
+
+  while(t_frame_used < m_frame_bytes) {
+    if(t_texture.loading < 0) {
+      if(t_texture.base == 0) {
+        return true;
+      }
+
+      int t_level = t_texture.base - 1;
+      size_t t_size = t_image.getImageSize(t_level);
+      if(!make_room(t_size, t_texture)) {
+        return true;
+      }
+
+      define_level(t_texture, t_level, false);
+      t_texture.loading = t_level;
+      t_texture.loaded_rows = 0;
+      t_texture.bytes += t_size;
+      m_resident += t_size;
+    }
+
+    int t_level = t_texture.loading;
+    int t_width = std::max(t_image.getWidth() >> t_level, 1);
+    int t_height = std::max(t_image.getHeight() >> t_level, 1);
+    int t_row_height = t_image.isCompressed() ? 4 : 1;
+    int t_rows = (t_height + t_row_height - 1) / t_row_height;
+    size_t t_row_bytes = t_image.getImageSize(t_level) / t_rows;
+
+    // a frame takes whole rows, a row larger than a frame goes up alone from the image
+    int t_count = (int)std::min((m_frame_bytes - t_frame_used) / t_row_bytes, (size_t)(t_rows - t_texture.loaded_rows));
+    bool t_direct = !m_mapped;
+    if(t_count == 0) {
+      if(t_frame_used > 0) {
+        return false;
+      }
+      t_count = 1;
+      t_direct = true;
+    }
+
+    const GLubyte* t_source = (const GLubyte*)t_image.getLevel(t_level) + t_texture.loaded_rows * t_row_bytes;
+    size_t t_bytes = t_count * t_row_bytes;
+    const GLvoid* t_pixels = t_source;
+
+    if(!t_direct) {
+      size_t t_offset = (m_frame % FRAMES_IN_FLIGHT) * m_frame_bytes + t_frame_used;
+      memcpy(m_mapped + t_offset, t_source, t_bytes);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+      t_pixels = (const GLvoid*)t_offset;
+    }
+
+    int t_y = t_texture.loaded_rows * t_row_height;
+    int t_chunk_height = std::min(t_count * t_row_height, t_height - t_y);
+    if(t_image.isCompressed()) {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, t_level, 0, t_y, t_width, t_chunk_height,
+                                t_image.getInternalFormat(), (GLsizei)t_bytes, t_pixels);
+    } else {
+      glTexSubImage2D(GL_TEXTURE_2D, t_level, 0, t_y, t_width, t_chunk_height,
+                      t_image.getFormat(), t_image.getType(), t_pixels);
+    }
+
+    if(!t_direct) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    t_frame_used += t_bytes;
+    t_texture.loaded_rows += t_count;
+
+    // the level is sampled once all of its rows are in
+    if(t_texture.loaded_rows == t_rows) {
+      t_texture.base = t_level;
+      t_texture.loading = -1;
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, t_level);
+    }
+  }
+  return false;
+}
+
+/** drops the largest levels of textures used less recently than t_for until t_bytes more fit the budget */
+bool TextureManager::make_room(size_t t_bytes, const Texture& t_for) {
+  while(m_resident + t_bytes > m_budget) {
+    Texture* t_victim = NULL;
+    for(size_t i = 0; i < m_textures.size(); i++) {
+      Texture& t_texture = m_textures[i];
+      bool t_droppable = t_texture.loading >= 0 || t_texture.base < t_texture.image->getMipLevels() - 1;
+      if(&t_texture != &t_for && t_droppable && t_texture.last_used < t_for.last_used &&
+         (!t_victim || t_texture.last_used < t_victim->last_used)) {
+        t_victim = &t_texture;
+      }
+    }
+    if(!t_victim) {
+      return false;
+    }
+
+    GLint t_bound;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &t_bound);
+    glBindTexture(GL_TEXTURE_2D, t_victim->name);
+    drop_level(*t_victim);
+    glBindTexture(GL_TEXTURE_2D, t_bound);
+  }
+  return true;
+}
+
+/** drops the level being streamed, otherwise the largest resident one. The smallest level is never dropped */
+void TextureManager::drop_level(Texture& t_texture) {
+  int t_level;
+  if(t_texture.loading >= 0) {
+    t_level = t_texture.loading;
+    t_texture.loading = -1;
+  } else {
+    t_level = t_texture.base;
+    t_texture.base++;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, t_texture.base);
+  }
+
+  define_level(t_texture, t_level, true);
+
+  size_t t_size = t_texture.image->getImageSize(t_level);
+  t_texture.bytes -= t_size;
+  m_resident -= t_size;
+}
+
+/** allocates a level of the bound texture without filling it, or frees it by making it empty */
+void TextureManager::define_level(const Texture& t_texture, int t_level, bool t_empty) {
+  const nv::Image& t_image = *t_texture.image;
+  int t_width = t_empty ? 0 : std::max(t_image.getWidth() >> t_level, 1);
+  int t_height = t_empty ? 0 : std::max(t_image.getHeight() >> t_level, 1);
+
+  if(t_image.isCompressed()) {
+    glCompressedTexImage2D(GL_TEXTURE_2D, t_level, t_image.getInternalFormat(), t_width, t_height, 0,
+                           t_empty ? 0 : t_image.getImageSize(t_level), NULL);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, t_level, t_image.getInternalFormat(), t_width, t_height, 0,
+                 t_image.getFormat(), t_image.getType(), NULL);
+  }
+}
+
+}
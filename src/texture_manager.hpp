@@ -0,0 +1,92 @@
+#ifndef GKR_TEXTURE_MANAGER_HPP
+#define GKR_TEXTURE_MANAGER_HPP
+
+#include <GL/glew.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace nv { class Image; }
+
+/** */
+namespace GKR {
+
+/**
+ * Owns the textures of the scene and streams their mipmaps in over several frames.
+ *
+ * A texture starts out with only its smallest level, the larger levels follow from small
+ * to large, at most a fixed number of bytes per frame. Large levels go up in chunks of rows.
+ * Where persistently mapped buffers are available the rows are copied into a ring of pixel
+ * buffers that the GL reads asynchronously, one part of the ring per frame in flight.
+ *
+ * The levels of all textures are kept within a memory budget. When a level does not fit, the
+ * largest levels of the textures that were used least recently are dropped. A texture that is
+ * used again streams them back in, so the images stay with the manager.
+ */
+class TextureManager {
+public:
+  /** Frames the GL may lag behind, each has its own part of the buffer ring */
+  static const int FRAMES_IN_FLIGHT = 3;
+
+  static const size_t DEFAULT_BUDGET = 256 << 20;
+  static const size_t DEFAULT_FRAME_BYTES = 4 << 20;
+
+private:
+  struct Texture {
+    GLuint name;
+    std::shared_ptr<const nv::Image> image;
+    /** Largest level of the complete chain, the texture's GL_TEXTURE_BASE_LEVEL */
+    int base;
+    /** Level being streamed or -1, it is allocated and filled up to loaded_rows */
+    int loading;
+    int loaded_rows;
+    /** Bytes of the resident levels, the one being streamed included */
+    size_t bytes;
+    unsigned int last_used;
+  };
+
+  std::vector<Texture> m_textures;
+  std::map<GLuint, size_t> m_names;
+
+  size_t m_budget;
+  size_t m_frame_bytes;
+  size_t m_resident;
+  unsigned int m_frame;
+
+  GLuint m_buffer;
+  GLubyte* m_mapped;
+  GLsync m_fences[FRAMES_IN_FLIGHT];
+
+  bool stream(Texture& t_texture, size_t& t_frame_used);
+  bool make_room(size_t t_bytes, const Texture& t_for);
+  void drop_level(Texture& t_texture);
+  void define_level(const Texture& t_texture, int t_level, bool t_empty);
+
+public:
+  /** t_budget bounds the bytes of all levels, t_frame_bytes the bytes uploaded per frame */
+  explicit TextureManager(size_t t_budget = DEFAULT_BUDGET, size_t t_frame_bytes = DEFAULT_FRAME_BYTES);
+  ~TextureManager();
+
+  /** Creates the buffer ring, needs the GL context */
+  void init();
+
+  /**
+   * Creates a 2D texture of an image with its smallest level uploaded and queues the others.
+   * The filters are left to the caller. Returns 0 for images without levels, cube maps and volumes.
+   */
+  GLuint add(const std::shared_ptr<const nv::Image>& t_image);
+
+  /** Marks a texture as used in this frame, it keeps its levels and streams the missing ones */
+  void touch(GLuint t_texture);
+
+  /** Streams this frame's share of levels, call once per frame on the context thread */
+  void update();
+
+  /** Bytes of all resident levels */
+  size_t resident() const;
+};
+
+}
+
+#endif
@@ -203,6 +203,9 @@ void key_down(unsigned char c, int x, int y) {
     case 'r': {
       rotate_light_dir = true; break;
     }
+    case 'c': {
+      print_cull_stats(); break;
+    }
     case 'w': {
       m_camera.mover()->forward(true); break;
     }
@@ -442,6 +445,32 @@ GLuint createShaders(const char* vert, const char* frag) {
   return nv::LinkGLSLProgram(v, f);
 }
 
+GLuint createComputeShader(const char* comp) {
+  GLuint c;
+
+  if(!(c = nv::CompileGLSLShaderFromFile(GL_COMPUTE_SHADER, comp))) {
+    c = nv::CompileGLSLShaderFromFile(GL_COMPUTE_SHADER, &comp[3]); //skip the first three chars to deal with path differences
+  }
+
+  if(!c) {
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, c);
+  glLinkProgram(program);
+  glDeleteShader(c);
+
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if(linked == GL_FALSE) {
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  return program;
+}
+
 void CheckFramebufferStatus() {
   int status;
   status = (GLenum) glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
@@ -0,0 +1,443 @@
+// obj_bench: times the OBJ scanner against the fscanf reader it replaced and checks that
+// both produce the same arrays. Nothing here needs a GL context.
+//
+//   obj_bench [-size megabytes] [-runs count] [model.obj ...]
+//
+// Without models the shipped tree models are used. A synthetic mesh of v/vt/vn quads of
+// about -size megabytes (100 by default) is written next to the working directory, timed
+// and removed. Every loader runs -runs times (3 by default), the fastest run is reported.
+
+#include <nvModel.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define BUF_SIZE 256
+
+using std::vector;
+
+static const char* DEFAULT_MODELS[] = { "../../media/models/trunk.obj", "../../media/models/leaves.obj" };
+static const char SYNTHETIC_FILENAME[] = "obj_bench_synthetic.obj";
+
+static void skipLine(char * buf, int size, FILE * fp)
+{
+  do {
+    buf[size-1] = '$';
+    fgets(buf, size, fp);
+  } while (buf[size-1] != '$');
+}
+
+/** The fscanf based reader of Model::loadObjFromFile before the scanner, kept as the baseline */
+class ScanfObjModel : public nv::Model {
+public:
+  bool load(const char* file);
+};
+
+/** the body is the old reader, only the texcoord format no longer asks for a fourth float it has no argument for */
+bool ScanfObjModel::load( const char *file) {
+    ScanfObjModel &m = *this;
+
+    FILE *fp;
+
+    fp = fopen( file, "r");
+    if (!fp) {
+        return false;
+    }
+
+    char buf[BUF_SIZE];
+    float val[4];
+    int idx[3][3];
+    int match;
+    bool vtx4Comp = false;
+    bool tex3Comp = false;
+    bool hasTC = false;
+    bool hasNormals = false;
+
+    while ( fscanf( fp, "%s", buf) != EOF ) {
+
+        switch (buf[0]) {
+            case '#':
+                //comment line, eat the remainder
+        skipLine( buf, BUF_SIZE, fp);
+                break;
+
+            case 'v':
+                switch (buf[1]) {
+                
+                    case '\0':
+                        //vertex, 3 or 4 components
+                        val[3] = 1.0f;  //default w coordinate
+                        match = fscanf( fp, "%f %f %f %f", &val[0], &val[1], &val[2], &val[3]);
+                        m._positions.push_back( val[0]);
+                        m._positions.push_back( val[1]);
+                        m._positions.push_back( val[2]);
+                        m._positions.push_back( val[3]);
+                        vtx4Comp |= ( match == 4);
+                        assert( match > 2 && match < 5);
+                        break;
+
+                    case 'n':
+                        //normal, 3 components
+                        match = fscanf( fp, "%f %f %f", &val[0], &val[1], &val[2]);
+                        m._normals.push_back( val[0]);
+                        m._normals.push_back( val[1]);
+                        m._normals.push_back( val[2]);
+                        assert( match == 3);
+                        break;
+
+                    case 't':
+                        //texcoord, 2 or 3 components
+                        val[2] = 0.0f;  //default r coordinate
+                        match = fscanf( fp, "%f %f %f", &val[0], &val[1], &val[2]);
+                        m._texCoords.push_back( val[0]);
+                        m._texCoords.push_back( val[1]);
+                        m._texCoords.push_back( val[2]);
+                        tex3Comp |= ( match == 3);
+                        assert( match > 1 && match < 4);
+                        break;
+                }
+                break;
+
+            case 'f':
+                //face
+                fscanf( fp, "%s", buf);
+
+                //determine the type, and read the initial vertex, all entries in a face must have the same format
+                if ( sscanf( buf, "%d//%d", &idx[0][0], &idx[0][1]) == 2) {
+                    //This face has vertex and normal indices
+
+                    //remap them to the right spot
+                    idx[0][0] = (idx[0][0] > 0) ? (idx[0][0] - 1) : ((int)m._positions.size() - idx[0][0]);
+                    idx[0][1] = (idx[0][1] > 0) ? (idx[0][1] - 1) : ((int)m._normals.size() - idx[0][1]);
+
+                    //grab the second vertex to prime
+                    fscanf( fp, "%d//%d", &idx[1][0], &idx[1][1]);
+
+                    //remap them to the right spot
+                    idx[1][0] = (idx[1][0] > 0) ? (idx[1][0] - 1) : ((int)m._positions.size() - idx[1][0]);
+                    idx[1][1] = (idx[1][1] > 0) ? (idx[1][1] - 1) : ((int)m._normals.size() - idx[1][1]);
+
+                    //create the fan
+                    while ( fscanf( fp, "%d//%d", &idx[2][0], &idx[2][1]) == 2) {
+                        //remap them to the right spot
+                        idx[2][0] = (idx[2][0] > 0) ? (idx[2][0] - 1) : ((int)m._positions.size() - idx[2][0]);
+                        idx[2][1] = (idx[2][1] > 0) ? (idx[2][1] - 1) : ((int)m._normals.size() - idx[2][1]);
+
+                        //add the indices
+                        for (int ii = 0; ii < 3; ii++) {
+                            m._pIndex.push_back( idx[ii][0]);
+                            m._nIndex.push_back( idx[ii][1]);
+                            m._tIndex.push_back(0); // dummy index, to ensure that the buffers are of identical size
+                        }
+                        
+                        //prepare for the next iteration
+                        idx[1][0] = idx[2][0];
+                        idx[1][1] = idx[2][1];
+                    }
+                    hasNormals = true;
+                }
+                else if ( sscanf( buf, "%d/%d/%d", &idx[0][0], &idx[0][1], &idx[0][2]) == 3) {
+                    //This face has vertex, texture coordinate, and normal indices
+
+                    //remap them to the right spot
+                    idx[0][0] = (idx[0][0] > 0) ? (idx[0][0] - 1) : ((int)m._positions.size() - idx[0][0]);
+                    idx[0][1] = (idx[0][1] > 0) ? (idx[0][1] - 1) : ((int)m._texCoords.size() - idx[0][1]);
+                    idx[0][2] = (idx[0][2] > 0) ? (idx[0][2] - 1) : ((int)m._normals.size() - idx[0][2]);
+
+                    //grab the second vertex to prime
+                    fscanf( fp, "%d/%d/%d", &idx[1][0], &idx[1][1], &idx[1][2]);
+
+                    //remap them to the right spot
+                    idx[1][0] = (idx[1][0] > 0) ? (idx[1][0] - 1) : ((int)m._positions.size() - idx[1][0]);
+                    idx[1][1] = (idx[1][1] > 0) ? (idx[1][1] - 1) : ((int)m._texCoords.size() - idx[1][1]);
+                    idx[1][2] = (idx[1][2] > 0) ? (idx[1][2] - 1) : ((int)m._normals.size() - idx[1][2]);
+
+                    //create the fan
+                    while ( fscanf( fp, "%d/%d/%d", &idx[2][0], &idx[2][1], &idx[2][2]) == 3) {
+                        //remap them to the right spot
+                        idx[2][0] = (idx[2][0] > 0) ? (idx[2][0] - 1) : ((int)m._positions.size() - idx[2][0]);
+                        idx[2][1] = (idx[2][1] > 0) ? (idx[2][1] - 1) : ((int)m._texCoords.size() - idx[2][1]);
+                        idx[2][2] = (idx[2][2] > 0) ? (idx[2][2] - 1) : ((int)m._normals.size() - idx[2][2]);
+
+                        //add the indices
+                        for (int ii = 0; ii < 3; ii++) {
+                            m._pIndex.push_back( idx[ii][0]);
+                            m._tIndex.push_back( idx[ii][1]);
+                            m._nIndex.push_back( idx[ii][2]);
+                        }
+                        
+                        //prepare for the next iteration
+                        idx[1][0] = idx[2][0];
+                        idx[1][1] = idx[2][1];
+                        idx[1][2] = idx[2][2];
+                    }
+
+                    hasTC = true;
+                    hasNormals = true;
+                }
+                else if ( sscanf( buf, "%d/%d", &idx[0][0], &idx[0][1]) == 2) {
+                    //This face has vertex and texture coordinate indices
+
+                    //remap them to the right spot
+                    idx[0][0] = (idx[0][0] > 0) ? (idx[0][0] - 1) : ((int)m._positions.size() - idx[0][0]);
+                    idx[0][1] = (idx[0][1] > 0) ? (idx[0][1] - 1) : ((int)m._texCoords.size() - idx[0][1]);
+
+                    //grab the second vertex to prime
+                    fscanf( fp, "%d/%d", &idx[1][0], &idx[1][1]);
+
+                    //remap them to the right spot
+                    idx[1][0] = (idx[1][0] > 0) ? (idx[1][0] - 1) : ((int)m._positions.size() - idx[1][0]);
+                    idx[1][1] = (idx[1][1] > 0) ? (idx[1][1] - 1) : ((int)m._texCoords.size() - idx[1][1]);
+
+                    //create the fan
+                    while ( fscanf( fp, "%d/%d", &idx[2][0], &idx[2][1]) == 2) {
+                        //remap them to the right spot
+                        idx[2][0] = (idx[2][0] > 0) ? (idx[2][0] - 1) : ((int)m._positions.size() - idx[2][0]);
+                        idx[2][1] = (idx[2][1] > 0) ? (idx[2][1] - 1) : ((int)m._texCoords.size() - idx[2][1]);
+
+                        //add the indices
+                        for (int ii = 0; ii < 3; ii++) {
+                            m._pIndex.push_back( idx[ii][0]);
+                            m._tIndex.push_back( idx[ii][1]);
+                            m._nIndex.push_back( 0); //dummy normal index to keep everything in synch
+                        }
+                        
+                        //prepare for the next iteration
+                        idx[1][0] = idx[2][0];
+                        idx[1][1] = idx[2][1];
+                    }
+                    hasTC = true;
+                }
+                else if ( sscanf( buf, "%d", &idx[0][0]) == 1) {
+                    //This face has only vertex indices
+
+                    //remap them to the right spot
+                    idx[0][0] = (idx[0][0] > 0) ? (idx[0][0] - 1) : ((int)m._positions.size() - idx[0][0]);
+
+                    //grab the second vertex to prime
+                    fscanf( fp, "%d", &idx[1][0]);
+
+                    //remap them to the right spot
+                    idx[1][0] = (idx[1][0] > 0) ? (idx[1][0] - 1) : ((int)m._positions.size() - idx[1][0]);
+
+                    //create the fan
+                    while ( fscanf( fp, "%d", &idx[2][0]) == 1) {
+                        //remap them to the right spot
+                        idx[2][0] = (idx[2][0] > 0) ? (idx[2][0] - 1) : ((int)m._positions.size() - idx[2][0]);
+
+                        //add the indices
+                        for (int ii = 0; ii < 3; ii++) {
+                            m._pIndex.push_back( idx[ii][0]);
+                            m._tIndex.push_back( 0); //dummy index to keep things in synch
+                            m._nIndex.push_back( 0); //dummy normal index to keep everything in synch
+                        }
+                        
+                        //prepare for the next iteration
+                        idx[1][0] = idx[2][0];
+                    }
+                }
+                else {
+                    //bad format
+                    assert(0);
+                    skipLine( buf, BUF_SIZE, fp);
+                }
+                break;
+
+            case 's':
+            case 'g':
+            case 'u':
+                //all presently ignored
+            default:
+        skipLine( buf, BUF_SIZE, fp);
+
+        };
+    }
+
+    fclose(fp);
+
+    //post-process data
+
+    //free anything that ended up being unused
+    if (!hasNormals) {
+        m._normals.clear();
+        m._nIndex.clear();
+    }
+
+    if (!hasTC) {
+        m._texCoords.clear();
+        m._tIndex.clear();
+    }
+
+    //set the defaults as the worst-case for an obj file
+    m._posSize = 4;
+    m._tcSize = 3;
+
+    //compact to 3 component vertices if possible
+    if (!vtx4Comp) {
+        vector<float>::iterator src = m._positions.begin();
+        vector<float>::iterator dst = m._positions.begin();
+
+        for ( ; src < m._positions.end(); ) {
+            *(dst++) = *(src++);
+            *(dst++) = *(src++);
+            *(dst++) = *(src++);
+            src++;
+        }
+
+        m._positions.resize( (m._positions.size() / 4) * 3);
+
+        m._posSize = 3;
+    }
+
+    //compact to 2 component tex coords if possible
+    if (!tex3Comp) {
+        vector<float>::iterator src = m._texCoords.begin();
+        vector<float>::iterator dst = m._texCoords.begin();
+
+        for ( ; src < m._texCoords.end(); ) {
+            *(dst++) = *(src++);
+            *(dst++) = *(src++);
+            src++;
+        }
+
+        m._texCoords.resize( (m._texCoords.size() / 3) * 2);
+
+        m._tcSize = 2; 
+    }
+
+    return true;
+}
+
+/** */
+template <typename T>
+static bool same_array(const T* a, const T* b, size_t count) {
+  return count == 0 || (a && b && memcmp(a, b, count * sizeof(T)) == 0);
+}
+
+/** compares the raw arrays of two loaded models */
+static bool same_model(const nv::Model& a, const nv::Model& b) {
+  if(a.getPositionCount() != b.getPositionCount() || a.getNormalCount() != b.getNormalCount() ||
+     a.getTexCoordCount() != b.getTexCoordCount() || a.getIndexCount() != b.getIndexCount() ||
+     a.getPositionSize() != b.getPositionSize() || a.getTexCoordSize() != b.getTexCoordSize()) {
+    return false;
+  }
+  return same_array(a.getPositions(), b.getPositions(), (size_t)a.getPositionCount() * a.getPositionSize()) &&
+         same_array(a.getNormals(), b.getNormals(), (size_t)a.getNormalCount() * a.getNormalSize()) &&
+         same_array(a.getTexCoords(), b.getTexCoords(), (size_t)a.getTexCoordCount() * a.getTexCoordSize()) &&
+         same_array(a.getPositionIndices(), b.getPositionIndices(), (size_t)a.getIndexCount()) &&
+         same_array(a.getNormalIndices(), b.getNormalIndices(), a.hasNormals() ? (size_t)a.getIndexCount() : 0) &&
+         same_array(a.getTexCoordIndices(), b.getTexCoordIndices(), a.hasTexCoords() ? (size_t)a.getIndexCount() : 0);
+}
+
+/** writes a grid of v/vt/vn quads of about t_megabytes, returns the bytes written or 0 */
+static long write_synthetic(const char* t_file, int t_megabytes) {
+  FILE* t_fp = fopen(t_file, "w");
+  if(!t_fp) {
+    return 0;
+  }
+
+  // a vertex with its texcoord, normal and quad takes about 165 bytes
+  int t_side = std::max((int)sqrt(t_megabytes * 1e6 / 165.0), 2);
+  for(int z = 0; z < t_side; z++) {
+    for(int x = 0; x < t_side; x++) {
+      float u = (float)x / (t_side - 1), v = (float)z / (t_side - 1);
+      float h = 0.25f * sinf(u * 17.0f) * cosf(v * 13.0f);
+      fprintf(t_fp, "v %f %f %f\n", u * 100.0f, h, v * 100.0f);
+      fprintf(t_fp, "vt %f %f\n", u, v);
+      fprintf(t_fp, "vn %f %f %f\n", -h, 0.9f, h * 0.5f);
+    }
+  }
+  for(int z = 0; z + 1 < t_side; z++) {
+    for(int x = 0; x + 1 < t_side; x++) {
+      int a = z * t_side + x + 1, b = a + 1, c = a + t_side + 1, d = a + t_side;
+      fprintf(t_fp, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c, d, d, d);
+    }
+  }
+
+  long t_size = ftell(t_fp);
+  fclose(t_fp);
+  return t_size;
+}
+
+/** loads a file with both readers t_runs times, prints the fastest runs and whether the arrays match */
+static bool bench(const char* t_file, int t_runs) {
+  double t_best_old = 0.0, t_best_new = 0.0;
+  bool t_same = true;
+
+  for(int r = 0; r < t_runs; r++) {
+    ScanfObjModel t_old;
+    nv::Model t_new;
+
+    std::chrono::high_resolution_clock::time_point t_start = std::chrono::high_resolution_clock::now();
+    bool t_old_loaded = t_old.load(t_file);
+    std::chrono::high_resolution_clock::time_point t_middle = std::chrono::high_resolution_clock::now();
+    bool t_new_loaded = t_new.loadModelFromFile(t_file);
+    std::chrono::high_resolution_clock::time_point t_end = std::chrono::high_resolution_clock::now();
+
+    if(!t_old_loaded || !t_new_loaded) {
+      printf("could not load %s\n", t_file);
+      return false;
+    }
+
+    double t_old_ms = std::chrono::duration<double, std::milli>(t_middle - t_start).count();
+    double t_new_ms = std::chrono::duration<double, std::milli>(t_end - t_middle).count();
+    t_best_old = (r == 0) ? t_old_ms : std::min(t_best_old, t_old_ms);
+    t_best_new = (r == 0) ? t_new_ms : std::min(t_best_new, t_new_ms);
+    t_same = t_same && same_model(t_old, t_new);
+  }
+
+  printf("%s: fscanf %.1f ms, scanner %.1f ms, %.1fx, arrays %s\n", t_file, t_best_old, t_best_new,
+         t_best_old / t_best_new, t_same ? "identical" : "DIFFER");
+  return t_same;
+}
+
+/** */
+int main(int argc, char** argv) {
+  int t_megabytes = 100;
+  int t_runs = 3;
+  int t_arg = 1;
+
+  for(; t_arg + 1 < argc && argv[t_arg][0] == '-'; t_arg += 2) {
+    if(strcmp(argv[t_arg], "-size") == 0) {
+      t_megabytes = atoi(argv[t_arg + 1]);
+    } else if(strcmp(argv[t_arg], "-runs") == 0) {
+      t_runs = atoi(argv[t_arg + 1]);
+    } else {
+      break;
+    }
+  }
+  if((t_arg < argc && argv[t_arg][0] == '-') || t_runs < 1) {
+    printf("usage: %s [-size megabytes] [-runs count] [model.obj ...]\n", argv[0]);
+    return 1;
+  }
+
+  vector<std::string> t_models(argv + t_arg, argv + argc);
+  if(t_models.empty()) {
+    t_models.assign(DEFAULT_MODELS, DEFAULT_MODELS + sizeof(DEFAULT_MODELS) / sizeof(DEFAULT_MODELS[0]));
+  }
+
+  bool t_ok = true;
+  for(size_t i = 0; i < t_models.size(); i++) {
+    t_ok = bench(t_models[i].c_str(), t_runs) && t_ok;
+  }
+
+  if(t_megabytes > 0) {
+    long t_size = write_synthetic(SYNTHETIC_FILENAME, t_megabytes);
+    if(!t_size) {
+      printf("could not write %s\n", SYNTHETIC_FILENAME);
+      return 1;
+    }
+    printf("synthetic mesh of %.1f MB\n", t_size / 1e6);
+    t_ok = bench(SYNTHETIC_FILENAME, t_runs) && t_ok;
+    remove(SYNTHETIC_FILENAME);
+  }
+
+  return t_ok ? 0 : 1;
+}
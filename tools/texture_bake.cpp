@@ -0,0 +1,134 @@
+// texture_bake: compresses textures to dds files offline. Nothing here needs a GL context,
+// so it runs on build machines without a GPU.
+//
+//   texture_bake [-bc1|-bc1a|-bc3|-bc4|-bc5] [-mips] [-box] [-srgb] input output.dds
+//
+// Without a format option colour images become BC1, colour images with alpha BC3,
+// grayscale images BC4 and grayscale images with alpha BC5. Compressed inputs keep
+// their format and blocks unless another format is asked for.
+//
+// -mips builds the full mipmap chain with the Kaiser filter, or the box filter with -box.
+// -srgb filters the colour channels in linear space, for colour textures.
+
+#include <nvImage.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+/** */
+struct BakeFormat {
+  const char* option;
+  GLenum format;
+  const char* name;
+};
+
+static const BakeFormat BAKE_FORMATS[] = {
+  { "-bc1", GL_COMPRESSED_RGB_S3TC_DXT1_EXT, "BC1" },
+  { "-bc1a", GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, "BC1 with 1 bit alpha" },
+  { "-bc3", GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, "BC3" },
+  { "-bc4", GL_COMPRESSED_LUMINANCE_LATC1_EXT, "BC4" },
+  { "-bc5", GL_COMPRESSED_LUMINANCE_ALPHA_LATC2_EXT, "BC5" },
+};
+static const int BAKE_FORMAT_COUNT = sizeof(BAKE_FORMATS) / sizeof(BAKE_FORMATS[0]);
+
+/** the format matching the channels of an image */
+static const BakeFormat* default_format(const nv::Image& t_image) {
+  switch(t_image.getFormat()) {
+    case GL_LUMINANCE:
+    case GL_ALPHA:
+      return &BAKE_FORMATS[3];
+    case GL_LUMINANCE_ALPHA:
+      return &BAKE_FORMATS[4];
+    case GL_RGBA:
+    case GL_BGRA:
+      return &BAKE_FORMATS[2];
+    default:
+      return &BAKE_FORMATS[0];
+  }
+}
+
+/** */
+int main(int argc, char** argv) {
+  const BakeFormat* t_format = NULL;
+  bool t_mips = false;
+  nv::Image::MipmapFilter t_filter = nv::Image::emfKaiser;
+  bool t_srgb = false;
+  int t_arg = 1;
+
+  for(; t_arg < argc && argv[t_arg][0] == '-'; t_arg++) {
+    const char* t_option = argv[t_arg];
+    bool t_known = true;
+
+    if(strcmp(t_option, "-mips") == 0) {
+      t_mips = true;
+    } else if(strcmp(t_option, "-box") == 0) {
+      t_filter = nv::Image::emfBox;
+    } else if(strcmp(t_option, "-srgb") == 0) {
+      t_srgb = true;
+    } else {
+      t_known = false;
+      for(int i = 0; i < BAKE_FORMAT_COUNT; i++) {
+        if(strcmp(t_option, BAKE_FORMATS[i].option) == 0) {
+          t_format = &BAKE_FORMATS[i];
+          t_known = true;
+        }
+      }
+    }
+
+    if(!t_known) {
+      break;
+    }
+  }
+  if(argc - t_arg != 2) {
+    printf("usage: %s [-bc1|-bc1a|-bc3|-bc4|-bc5] [-mips] [-box] [-srgb] input output.dds\n", argv[0]);
+    return 1;
+  }
+
+  const char* t_input = argv[t_arg];
+  const char* t_output = argv[t_arg + 1];
+
+  // the rows stay in file order from loading to writing, nothing is flipped
+  nv::Image t_image;
+  t_image.setFlipOnLoad(false);
+  if(!t_image.loadImageFromFile(t_input)) {
+    printf("could not load %s\n", t_input);
+    return 1;
+  }
+
+  std::chrono::high_resolution_clock::time_point t_start = std::chrono::high_resolution_clock::now();
+
+  // the blocks of a compressed input are only decoded when its format changes
+  if(t_image.isCompressed() && t_format && t_format->format != t_image.getFormat()) {
+    if(!t_image.decompress()) {
+      printf("%s can not be decoded\n", t_input);
+      return 1;
+    }
+  }
+
+  // levels are filtered before compressing, from the exact pixels
+  if(t_mips && !t_image.generateMipmaps(t_filter, t_srgb)) {
+    printf("could not build the mipmaps of %s\n", t_input);
+    return 1;
+  }
+
+  if(!t_image.isCompressed()) {
+    if(!t_format) {
+      t_format = default_format(t_image);
+    }
+    if(!t_image.compress(t_format->format)) {
+      printf("%s can not be compressed to %s\n", t_input, t_format->name);
+      return 1;
+    }
+  }
+  double t_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t_start).count();
+
+  if(!t_image.saveImageToFile(t_output)) {
+    printf("could not write %s\n", t_output);
+    return 1;
+  }
+
+  printf("%s: %dx%d, %d levels, %s in %.1f ms\n", t_output, t_image.getWidth(), t_image.getHeight(),
+         t_image.getMipLevels(), t_format ? t_format->name : "format kept", t_ms);
+  return 0;
+}